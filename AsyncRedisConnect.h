@@ -0,0 +1,620 @@
+#ifndef ASYNC_REDIS_CONNECT_H
+#define ASYNC_REDIS_CONNECT_H
+///////////////////////////////////////////////////////////////
+#include "RedisConnect.h"
+
+#ifdef XG_LINUX
+
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <sys/eventfd.h>
+
+// 基于 epoll 的异步Redis客户端。
+// 若干个事件循环线程负责全部连接的读写，套接字始终保持非阻塞模式，
+// 调用线程提交命令后立即返回 future 或在应答到达时回调，
+// 因此少量线程就能同时维持大量未完成的命令。
+class AsyncRedisConnect {
+public:
+	typedef RedisConnect::Buffer Buffer;
+	typedef RedisConnect::Writer Writer;
+	typedef RedisConnect::Command Command;
+
+	// 应答回调，在事件循环线程中执行，执行结果通过 cmd.getCode() 获取，回调中不能阻塞
+	typedef function<void(Command& cmd)> Callback;
+
+protected:
+	// 一条已提交的命令
+	struct Request {
+		Callback callback;
+		long long deadline; // 超时时间点（毫秒）
+		shared_ptr<Command> cmd;
+		bool handshake; // 是否为建立连接时自动发送的身份验证命令
+	};
+
+	// 连接状态
+	enum {
+		CLOSED, // 未连接
+		CONNECTING, // 等待非阻塞连接完成
+		HANDSHAKE, // 已连接，等待身份验证的应答
+		READY // 可以正常执行命令
+	};
+
+	class Loop;
+
+	// 一个非阻塞连接。queue 和 state 由提交线程和事件循环共同访问，需要加锁；
+	// 其余的发送、接收状态只在所属的事件循环线程中访问。
+	class Channel {
+	public:
+		Loop* loop = NULL; // 所属的事件循环
+		mutex mtx; // 保护 queue 和连接状态
+		bool queued = false; // 是否已加入事件循环的待发送列表
+		int state = CLOSED; // 连接状态
+		long long retry = 0; // 连接失败后，在此时间点（毫秒）之前提交的命令直接失败
+		deque<Request> queue; // 已提交尚未发送的命令
+
+		SOCKET sock = INVALID_SOCKET; // 非阻塞套接字
+		long long deadline = 0; // 连接超时时间点（毫秒）
+		int head = 0; // 下一条应答在 in 中的起始位置
+		int sent = 0; // out 中已发送的字节数
+		bool writing = false; // 是否在等待可写事件
+		Buffer in; // 接收缓冲区
+		Buffer out; // 发送缓冲区
+		Writer writer; // 请求序列化器
+		deque<Request> pending; // 已发送等待应答的命令
+	};
+
+	// 事件循环，在独立的线程中处理所属连接的读写事件
+	class Loop {
+	public:
+		int handle = -1; // epoll 句柄
+		int notify = -1; // 用于唤醒事件循环的 eventfd
+		thread worker; // 事件循环线程
+		mutex mtx; // 保护 dirty
+		atomic<bool> running; // 是否继续运行
+		vector<Channel*> dirty; // 有新命令待发送的连接
+		vector<Channel*> channels; // 所属的全部连接
+
+		Loop() : running(false) {}
+
+		// 唤醒事件循环
+		void wakeup() {
+			uint64_t val = 1;
+
+			if (::write(notify, &val, sizeof(val)) < 0) return;
+		}
+	};
+
+	static const int RECONNECT_INTERVAL = 1000; // 连接失败后的等待时间（毫秒）
+
+	int port = 0;
+	int timeout = 3000; // 连接和命令的超时时间（毫秒）
+	int memsz = 2 * 1024 * 1024; // 收发缓冲区常驻容量的上限，超过时在空闲后释放
+	string host;
+	string passwd;
+	mutex mtx; // 与 cond 配合等待首次连接的结果
+	condition_variable cond;
+	atomic<u_int> index; // 轮流选择连接的计数器
+	vector<unique_ptr<Loop>> loops;
+	vector<unique_ptr<Channel>> channels;
+
+	static long long GetTime() {
+		return chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	// 修改连接状态并唤醒等待首次连接结果的线程
+	void setState(Channel* channel, int state, long long retry = 0) {
+		channel->mtx.lock();
+		channel->state = state;
+		channel->retry = retry;
+		channel->mtx.unlock();
+
+		lock_guard<mutex> lk(mtx);
+
+		cond.notify_all();
+	}
+
+	// 发起非阻塞连接并加入事件循环，连接在可写事件中完成，不阻塞事件循环线程。
+	// 设置了密码时把 AUTH 命令放在发送缓冲区的最前面，随后提交的命令跟在它后面发送
+	bool open(Channel* channel) {
+		struct sockaddr_in addr;
+		struct epoll_event ev;
+		SOCKET sock = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+
+		if (RedisConnect::Socket::IsSocketClosed(sock)) return false;
+
+		memset(&addr, 0, sizeof(addr));
+
+		addr.sin_family = AF_INET;
+		addr.sin_port = htons(port);
+		addr.sin_addr.s_addr = inet_addr(host.c_str());
+
+		if (::connect(sock, (struct sockaddr*)(&addr), sizeof(addr)) < 0 && errno != EINPROGRESS) {
+			::close(sock);
+
+			return false;
+		}
+
+		memset(&ev, 0, sizeof(ev));
+
+		ev.events = EPOLLIN | EPOLLOUT;
+		ev.data.ptr = channel;
+
+		if (epoll_ctl(channel->loop->handle, EPOLL_CTL_ADD, sock, &ev) < 0) {
+			::close(sock);
+
+			return false;
+		}
+
+		channel->sock = sock;
+		channel->writing = true;
+		channel->deadline = GetTime() + timeout;
+
+		setState(channel, CONNECTING);
+
+		if (passwd.empty()) return true;
+
+		Request item = {NULL, channel->deadline, NewCommand("auth", passwd), true};
+
+		channel->writer.clear();
+		channel->writer.add(*item.cmd);
+
+		if (!channel->writer.dump(channel->out)) return false;
+
+		item.cmd->reset(channel->head);
+		channel->pending.push_back(std::move(item));
+
+		return true;
+	}
+
+	// 关闭连接并以指定的错误码结束全部未完成的命令，只在事件循环线程或停止后调用。
+	// 连接或身份验证失败时，RECONNECT_INTERVAL 毫秒内提交的命令直接失败
+	void fail(Channel* channel, int code) {
+		deque<Request> vec;
+
+		channel->mtx.lock();
+
+		int state = channel->state;
+
+		vec.swap(channel->pending);
+
+		for (Request& item : channel->queue) vec.push_back(std::move(item));
+
+		channel->queue.clear();
+		channel->mtx.unlock();
+
+		if (channel->sock != INVALID_SOCKET) {
+			epoll_ctl(channel->loop->handle, EPOLL_CTL_DEL, channel->sock, NULL);
+			::close(channel->sock);
+			channel->sock = INVALID_SOCKET;
+		}
+
+		channel->head = 0;
+		channel->sent = 0;
+		channel->writing = false;
+		channel->in.clear();
+		channel->out.clear();
+
+		setState(channel, CLOSED, state == READY ? 0 : GetTime() + RECONNECT_INTERVAL);
+
+		for (Request& item : vec) {
+			item.cmd->complete(code);
+
+			if (item.callback) item.callback(*item.cmd);
+		}
+	}
+
+	// 非阻塞连接完成后检查连接结果，没有待验证的身份信息时直接可用
+	bool finish(Channel* channel) {
+		int err = 0;
+		socklen_t len = sizeof(err);
+
+		if (getsockopt(channel->sock, SOL_SOCKET, SO_ERROR, (char*)(&err), &len) < 0 || err) return false;
+
+		setState(channel, channel->pending.size() > 0 && channel->pending.front().handshake ? HANDSHAKE : READY);
+
+		return true;
+	}
+
+	// 发送 out 中尚未发出的数据，发送缓冲区已满时等待可写事件，连接完成之前只缓存数据
+	bool flush(Channel* channel) {
+		Buffer& out = channel->out;
+
+		if (channel->state == CONNECTING) return true;
+
+		while (channel->sent < out.size()) {
+			int num = ::send(channel->sock, out.data() + channel->sent, out.size() - channel->sent, MSG_NOSIGNAL);
+
+			if (num > 0) {
+				channel->sent += num;
+
+				continue;
+			}
+
+			if (num < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) break;
+
+			return false;
+		}
+
+		bool writing = channel->sent < out.size();
+
+		if (!writing) {
+			out.clear();
+			channel->sent = 0;
+
+			if (out.capacity() > memsz) out.release();
+		}
+
+		// 只在等待状态变化时修改监听的事件
+		if (writing != channel->writing) {
+			struct epoll_event ev;
+
+			memset(&ev, 0, sizeof(ev));
+
+			ev.events = writing ? EPOLLIN | EPOLLOUT : EPOLLIN;
+			ev.data.ptr = channel;
+
+			epoll_ctl(channel->loop->handle, EPOLL_CTL_MOD, channel->sock, &ev);
+
+			channel->writing = writing;
+		}
+
+		return true;
+	}
+
+	// 将新提交的命令序列化到发送缓冲区并尝试发送，连接已断开时先发起非阻塞连接
+	void submit(Channel* channel) {
+		deque<Request> vec;
+
+		channel->mtx.lock();
+		channel->queued = false;
+
+		int state = channel->state;
+
+		channel->mtx.unlock();
+
+		if (state == CLOSED && !open(channel)) return fail(channel, RedisConnect::NETERR);
+
+		channel->mtx.lock();
+		vec.swap(channel->queue);
+		channel->mtx.unlock();
+
+		if (vec.size() > 0) {
+			Writer& writer = channel->writer;
+
+			writer.clear();
+
+			for (Request& item : vec) writer.add(*item.cmd);
+
+			if (!writer.dump(channel->out)) return fail(channel, RedisConnect::SYSERR);
+
+			if (writer.capacity() > memsz) writer.release();
+
+			for (Request& item : vec) {
+				if (channel->pending.empty()) item.cmd->reset(channel->head);
+
+				channel->pending.push_back(std::move(item));
+			}
+		}
+
+		if (!flush(channel)) fail(channel, RedisConnect::NETERR);
+	}
+
+	// 读取全部可读数据并按顺序解析出各条命令的应答，没有对应命令的数据直接丢弃
+	void receive(Channel* channel) {
+		Buffer& in = channel->in;
+		deque<Request>& pending = channel->pending;
+
+		while (true) {
+			// 已解析完的应答占据缓冲区一半以上时将其移走
+			if (channel->head > 0 && channel->head >= in.size() / 2) {
+				in.erase(channel->head);
+
+				if (pending.size() > 0) pending.front().cmd->shift(channel->head);
+
+				channel->head = 0;
+			}
+
+			char* dest = in.reserve(Buffer::MIN_SIZE);
+
+			if (dest == NULL) return fail(channel, RedisConnect::SYSERR);
+
+			int len = in.space();
+			int num = ::recv(channel->sock, dest, len, 0);
+
+			if (num == 0) return fail(channel, RedisConnect::NETCLOSE);
+
+			if (num < 0) {
+				if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+
+				if (errno == EINTR) continue;
+
+				return fail(channel, RedisConnect::NETERR);
+			}
+
+			in.commit(num);
+
+			while (pending.size() > 0) {
+				Command& cmd = *pending.front().cmd;
+				int res = cmd.parse(in);
+
+				if (res == RedisConnect::TIMEOUT) break;
+
+				cmd.complete(res);
+
+				if (res == RedisConnect::DATAERR) return fail(channel, RedisConnect::DATAERR);
+
+				// 下一条应答从本条结束处开始，存储区已交换给命令对象时从头开始
+				channel->head = in.size() > 0 ? cmd.decoder.getOffset() : 0;
+
+				Request item = std::move(pending.front());
+
+				pending.pop_front();
+
+				if (pending.size() > 0) pending.front().cmd->reset(channel->head);
+
+				if (item.handshake) {
+					if (res <= 0) return fail(channel, RedisConnect::AUTHFAIL);
+
+					if (pending.empty() || !pending.front().handshake) setState(channel, READY);
+				}
+
+				if (item.callback) item.callback(cmd);
+			}
+
+			// 没有等待应答的命令时，剩余数据不属于任何命令，丢弃后才能对齐后续的应答
+			if (pending.empty()) {
+				in.clear();
+				channel->head = 0;
+			}
+
+			// 没有读满说明套接字中的数据已经读完
+			if (num < len) break;
+		}
+
+		if (pending.empty() && in.capacity() > memsz) in.release();
+	}
+
+	// 检查连接和最早发出的命令是否超时，命令超时后应答流已经无法对齐，只能重建连接
+	void check(Loop* loop) {
+		long long now = GetTime();
+
+		for (Channel* channel : loop->channels) {
+			if (channel->state == CONNECTING && channel->deadline < now) {
+				fail(channel, RedisConnect::NETERR);
+			}
+			else if (channel->pending.size() > 0 && channel->pending.front().deadline < now) {
+				fail(channel, RedisConnect::TIMEOUT);
+			}
+		}
+	}
+
+	void run(Loop* loop) {
+		const int MAX_EVENTS = 64;
+		struct epoll_event evs[MAX_EVENTS];
+
+		while (loop->running) {
+			int cnt = epoll_wait(loop->handle, evs, MAX_EVENTS, RedisConnect::SOCKET_TIMEOUT * 10);
+
+			for (int i = 0; i < cnt; i++) {
+				Channel* channel = (Channel*)(evs[i].data.ptr);
+
+				if (channel == NULL) {
+					uint64_t val;
+
+					if (::read(loop->notify, &val, sizeof(val)) < 0) continue;
+
+					vector<Channel*> vec;
+
+					loop->mtx.lock();
+					vec.swap(loop->dirty);
+					loop->mtx.unlock();
+
+					for (Channel* item : vec) submit(item);
+
+					continue;
+				}
+
+				// 连接失败时也会报告可写事件，由 finish 检查连接结果
+				if (channel->state == CONNECTING) {
+					if ((evs[i].events & (EPOLLOUT | EPOLLERR | EPOLLHUP)) && !(finish(channel) && flush(channel))) {
+						fail(channel, RedisConnect::NETERR);
+					}
+
+					continue;
+				}
+
+				// 连接关闭前到达的应答仍然需要处理
+				if (evs[i].events & EPOLLIN) receive(channel);
+
+				if (channel->state == CLOSED) continue;
+
+				if (evs[i].events & (EPOLLERR | EPOLLHUP)) {
+					fail(channel, RedisConnect::NETERR);
+				}
+				else if ((evs[i].events & EPOLLOUT) && !flush(channel)) {
+					fail(channel, RedisConnect::NETERR);
+				}
+			}
+
+			check(loop);
+		}
+	}
+
+	// 把连接加入所属事件循环的待发送列表
+	void post(Channel* channel) {
+		Loop* loop = channel->loop;
+
+		loop->mtx.lock();
+		loop->dirty.push_back(channel);
+		loop->mtx.unlock();
+		loop->wakeup();
+	}
+
+public:
+	AsyncRedisConnect() : index(0) {}
+
+	~AsyncRedisConnect() {
+		close();
+	}
+
+	// 停止全部事件循环并关闭连接，未完成的命令以 NETCLOSE 结束
+	void close() {
+		for (unique_ptr<Loop>& loop : loops) {
+			loop->running = false;
+			loop->wakeup();
+
+			if (loop->worker.joinable()) loop->worker.join();
+		}
+
+		for (unique_ptr<Channel>& channel : channels) fail(channel.get(), RedisConnect::NETCLOSE);
+
+		for (unique_ptr<Loop>& loop : loops) {
+			::close(loop->handle);
+			::close(loop->notify);
+		}
+
+		channels.clear();
+		loops.clear();
+	}
+
+	// 建立 conns 个连接并分配给 threads 个事件循环线程，连接由事件循环线程以非阻塞方式建立，
+	// 等待全部连接有结果后返回，至少有一个连接成功即返回 true。memsz 为每个连接收发缓冲区的常驻容量上限
+	bool connect(const string& host, int port, const string& passwd = "", int timeout = 3000, int conns = 1, int threads = 1, int memsz = 2 * 1024 * 1024) {
+		close();
+
+		signal(SIGPIPE, SIG_IGN);
+
+		if (conns <= 0) conns = 1;
+		if (threads <= 0) threads = 1;
+		if (threads > conns) threads = conns;
+
+		this->host = host;
+		this->port = port;
+		this->memsz = memsz;
+		this->passwd = passwd;
+		this->timeout = timeout;
+
+		for (int i = 0; i < threads; i++) {
+			Loop* loop = new Loop();
+			struct epoll_event ev;
+
+			loops.push_back(unique_ptr<Loop>(loop));
+
+			loop->handle = epoll_create(1);
+			loop->notify = eventfd(0, EFD_NONBLOCK);
+
+			memset(&ev, 0, sizeof(ev));
+
+			ev.events = EPOLLIN;
+			ev.data.ptr = NULL;
+
+			epoll_ctl(loop->handle, EPOLL_CTL_ADD, loop->notify, &ev);
+		}
+
+		for (int i = 0; i < conns; i++) {
+			Channel* channel = new Channel();
+
+			channels.push_back(unique_ptr<Channel>(channel));
+
+			channel->loop = loops[i % threads].get();
+			channel->loop->channels.push_back(channel);
+		}
+
+		for (unique_ptr<Loop>& loop : loops) {
+			Loop* item = loop.get();
+
+			item->running = true;
+			item->worker = thread([this, item]() {
+				run(item);
+			});
+		}
+
+		for (unique_ptr<Channel>& channel : channels) post(channel.get());
+
+		int num = 0;
+		unique_lock<mutex> lk(mtx);
+
+		// 连接失败时设置了重试时间，连接超时由事件循环检查，这里多等待一个检查周期
+		cond.wait_for(lk, chrono::milliseconds(timeout + RedisConnect::SOCKET_TIMEOUT * 20), [&]() {
+			num = 0;
+
+			for (unique_ptr<Channel>& channel : channels) {
+				lock_guard<mutex> guard(channel->mtx);
+
+				if (channel->state == READY) {
+					++num;
+				}
+				else if (channel->state != CLOSED || channel->retry == 0) {
+					return false;
+				}
+			}
+
+			return true;
+		});
+
+		return num > 0;
+	}
+
+	// 异步执行命令，应答到达或失败后在事件循环线程中回调。
+	// 命令对象在回调之前不能被修改。断开的连接由事件循环线程以非阻塞方式重连，
+	// 连接失败后的 RECONNECT_INTERVAL 毫秒内提交的命令直接以 NETERR 结束。
+	void execute(shared_ptr<Command> cmd, Callback callback) {
+		if (channels.empty()) {
+			cmd->complete(RedisConnect::NETERR);
+
+			if (callback) callback(*cmd);
+
+			return;
+		}
+
+		Channel* channel = channels[index++ % channels.size()].get();
+		Request item = {callback, GetTime() + timeout, cmd, false};
+
+		channel->mtx.lock();
+
+		if (channel->state == CLOSED && GetTime() < channel->retry) {
+			channel->mtx.unlock();
+
+			cmd->complete(RedisConnect::NETERR);
+
+			if (callback) callback(*cmd);
+
+			return;
+		}
+
+		bool notify = !channel->queued;
+
+		channel->queue.push_back(std::move(item));
+		channel->queued = true;
+		channel->mtx.unlock();
+
+		if (notify) post(channel);
+	}
+
+	// 异步执行命令，返回的 future 在应答到达后得到命令的执行结果
+	future<int> execute(shared_ptr<Command> cmd) {
+		shared_ptr<promise<int>> res = make_shared<promise<int>>();
+		future<int> val = res->get_future();
+
+		execute(cmd, [res](Command& cmd) {
+			res->set_value(cmd.getCode());
+		});
+
+		return val;
+	}
+
+	// 创建一条命令，便于与 execute 配合使用
+	template<class DATA_TYPE, class ...ARGS>
+	static shared_ptr<Command> NewCommand(DATA_TYPE val, ARGS ...args) {
+		shared_ptr<Command> cmd = make_shared<Command>();
+
+		cmd->add(val, args...);
+
+		return cmd;
+	}
+};
+
+#endif
+
+#endif
@@ -0,0 +1,191 @@
+#ifndef CO_REDIS_CONNECT_H
+#define CO_REDIS_CONNECT_H
+///////////////////////////////////////////////////////////////
+#include "AsyncRedisConnect.h"
+
+#if defined(XG_LINUX) && defined(__cpp_impl_coroutine)
+
+#include <coroutine>
+
+// 基于 C++20 协程的Redis客户端，在 AsyncRedisConnect 的基础上提供可以 co_await 的命令接口：
+//     CoTask handle(CoRedisConnect& redis) {
+//         auto res = co_await redis.get("key");
+//         if (res.code > 0) puts(res.value.c_str());
+//     }
+// 协程在应答到达后由事件循环线程恢复执行，恢复后的代码同样不能长时间阻塞。
+// 同步的 RedisConnect 接口不受影响，可以在同一进程中混合使用。
+class CoRedisConnect : public AsyncRedisConnect {
+public:
+	// 带返回值的执行结果，code 与同步接口的返回值含义相同
+	template<class DATA_TYPE>
+	struct Result {
+		int code = 0;
+		DATA_TYPE value;
+
+		bool ok() const {
+			return code > 0;
+		}
+	};
+
+	// 等待一条命令完成的 awaitable，conv 在恢复时将命令结果转换为返回值
+	template<class DATA_TYPE>
+	class Awaiter {
+	protected:
+		shared_ptr<Command> cmd;
+		AsyncRedisConnect* redis;
+		DATA_TYPE (*conv)(Command& cmd);
+
+	public:
+		Awaiter(AsyncRedisConnect* redis, shared_ptr<Command> cmd, DATA_TYPE (*conv)(Command& cmd)) : cmd(cmd), redis(redis), conv(conv) {}
+
+		bool await_ready() const {
+			return false;
+		}
+
+		// 回调可能在 execute 返回之前就在事件循环线程中恢复协程，此后不能再访问 this
+		void await_suspend(std::coroutine_handle<> handle) {
+			redis->execute(cmd, [handle](Command&) {
+				handle.resume();
+			});
+		}
+
+		DATA_TYPE await_resume() {
+			return conv(*cmd);
+		}
+	};
+
+	// 不需要等待结果的协程返回类型，协程开始后立即执行，结束时自动释放
+	struct CoTask {
+		struct promise_type {
+			CoTask get_return_object() {
+				return CoTask();
+			}
+
+			std::suspend_never initial_suspend() noexcept {
+				return std::suspend_never();
+			}
+
+			std::suspend_never final_suspend() noexcept {
+				return std::suspend_never();
+			}
+
+			void return_void() {}
+
+			void unhandled_exception() {
+				std::terminate();
+			}
+		};
+	};
+
+protected:
+	static int GetCode(Command& cmd) {
+		return cmd.getCode();
+	}
+
+	// 整数类型的结果保存在 status 中，与同步接口的 ttl、hlen 一致
+	static int GetStatus(Command& cmd) {
+		return cmd.getCode() == OK ? cmd.getStatus() : cmd.getCode();
+	}
+
+	static Result<string> GetString(Command& cmd) {
+		Result<string> res;
+		Reply reply = cmd.getReply();
+
+		if ((res.code = cmd.getCode()) > 0) res.value.assign(reply.data(), reply.size());
+
+		return res;
+	}
+
+	static Result<vector<string>> GetList(Command& cmd) {
+		Result<vector<string>> res;
+
+		if ((res.code = cmd.getCode()) > 0) res.value = cmd.getDataList();
+
+		return res;
+	}
+
+	template<class DATA_TYPE, class ...ARGS>
+	Awaiter<DATA_TYPE> call(DATA_TYPE (*conv)(Command& cmd), ARGS ...args) {
+		return Awaiter<DATA_TYPE>(this, NewCommand(args...), conv);
+	}
+
+public:
+	typedef RedisConnect::Reply Reply;
+
+	static const int OK = RedisConnect::OK;
+
+	// 执行任意命令，恢复后通过 cmd 读取结果
+	Awaiter<int> execute(shared_ptr<Command> cmd) {
+		return Awaiter<int>(this, cmd, GetCode);
+	}
+
+	using AsyncRedisConnect::execute;
+
+	Awaiter<int> ping() {
+		return call(GetCode, "ping");
+	}
+
+	Awaiter<int> del(const string& key) {
+		return call(GetCode, "del", key);
+	}
+
+	Awaiter<int> ttl(const string& key) {
+		return call(GetStatus, "ttl", key);
+	}
+
+	Awaiter<int> hlen(const string& key) {
+		return call(GetStatus, "hlen", key);
+	}
+
+	Awaiter<int> expire(const string& key, int timeout) {
+		return call(GetCode, "expire", key, timeout);
+	}
+
+	Awaiter<Result<string>> get(const string& key) {
+		return call(GetString, "get", key);
+	}
+
+	Awaiter<Result<string>> hget(const string& key, const string& filed) {
+		return call(GetString, "hget", key, filed);
+	}
+
+	Awaiter<int> set(const string& key, const string& val, int timeout = 0) {
+		return timeout > 0 ? call(GetCode, "setex", key, timeout, val) : call(GetCode, "set", key, val);
+	}
+
+	Awaiter<int> hset(const string& key, const string& filed, const string& val) {
+		return call(GetCode, "hset", key, filed, val);
+	}
+
+	Awaiter<int> zadd(const string& key, const string& filed, int score) {
+		return call(GetCode, "zadd", key, score, filed);
+	}
+
+	Awaiter<Result<vector<string>>> zrange(const string& key, int start, int end, bool withscore = false) {
+		return withscore ? call(GetList, "zrange", key, start, end, "withscores") : call(GetList, "zrange", key, start, end);
+	}
+
+	// 执行Lua脚本，参数与 RedisConnect::eval 相同
+	template<class ...ARGS>
+	Awaiter<Result<vector<string>>> eval(const string& lua, const vector<string>& keys, ARGS ...args) {
+		shared_ptr<Command> cmd = NewCommand("eval", lua, (int)keys.size());
+
+		for (const string& key : keys) cmd->add(key);
+
+		addArgs(*cmd, args...);
+
+		return Awaiter<Result<vector<string>>>(this, cmd, GetList);
+	}
+
+protected:
+	static void addArgs(Command&) {}
+
+	template<class DATA_TYPE, class ...ARGS>
+	static void addArgs(Command& cmd, DATA_TYPE val, ARGS ...args) {
+		cmd.add(val, args...);
+	}
+};
+
+#endif
+
+#endif
@@ -0,0 +1,79 @@
+#include "RedisBench.h"
+#include "RedisMock.h"
+
+// 压力测试程序。未指定服务器地址时启动进程内的模拟服务器，
+// 用于在没有 Redis 的环境中测量客户端本身的开销。
+// 任意一项测试出现错误时返回非0值，可以用于回归测试。
+
+static void Usage(const char* name)
+{
+	printf("usage: %s [-h host] [-p port] [-a password] [-c clients] [-n requests] [-P pipeline] [-d datasize] [-r keyspace] [-t tests] [--mock]\n", name);
+	printf("%s", RedisBench::GetOptionHelp());
+	printf("  --mock  run against the in-process mock server (default when no host or port is given)\n");
+}
+
+int main(int argc, char** argv)
+{
+	RedisMock mock;
+	RedisBench::Config cfg;
+	bool remote = false;
+	bool local = false;
+
+	for (int i = 1; i < argc; i++)
+	{
+		string opt = argv[i];
+		const char* val = i + 1 < argc ? argv[i + 1] : NULL;
+
+		if (opt == "--mock")
+		{
+			local = true;
+
+			continue;
+		}
+
+		if (opt == "--help" || !RedisBench::SetOption(cfg, opt, val))
+		{
+			Usage(argv[0]);
+
+			return opt == "--help" ? 0 : -1;
+		}
+
+		if (opt == "-h" || opt == "-p") remote = true;
+
+		i++;
+	}
+
+	if (local || !remote)
+	{
+		mock.setScript(RedisBench::GetScript(), [](RedisMock* mock, const vector<string>& keys, const vector<string>&) {
+			return mock->call({"get", keys[0]});
+		});
+
+		if (!mock.start())
+		{
+			printf("start mock server failed\n");
+
+			return -1;
+		}
+
+		cfg.host = "127.0.0.1";
+		cfg.port = mock.getPort();
+	}
+
+	RedisBench bench(cfg);
+	long long errors = 0;
+	const RedisBench::Config& conf = bench.getConfig();
+
+	printf("server %s:%d%s  clients=%d requests=%lld pipeline=%d datasize=%d keyspace=%d\n",
+		conf.host.c_str(), conf.port, remote && !local ? "" : " (mock)",
+		conf.clients, conf.requests, conf.pipeline, conf.datasize, conf.keyspace);
+
+	bench.run([&](const RedisBench::Result& res) {
+		errors += res.errors;
+
+		printf("%s\n", RedisBench::ToString(res).c_str());
+		fflush(stdout);
+	});
+
+	return errors > 0 ? 1 : 0;
+}
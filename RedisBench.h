@@ -0,0 +1,277 @@
+#ifndef REDIS_BENCH_H
+#define REDIS_BENCH_H
+///////////////////////////////////////////////////////////////
+#include "RedisConnect.h"
+
+#include <random>
+
+// 多线程压力测试。每个线程循环从连接池取出连接，按管道深度一次发送一批命令，
+// 记录每批命令的往返时间，最后汇总吞吐量和延迟分位数。连接池容量等于线程数，
+// 测试走的是业务代码实际使用的 RedisPool/RedisConnect 路径。
+// 支持的测试：ping、set、get、hset、zadd、zrange、eval，键在 keyspace 范围内随机选择。
+class RedisBench {
+public:
+	typedef RedisConnect::Command Command;
+
+	struct Config {
+		string host = "127.0.0.1";
+		int port = 6379;
+		string passwd;
+		int clients = 50; // 并发线程数
+		long long requests = 100000; // 每项测试的请求数
+		int pipeline = 1; // 管道深度
+		int datasize = 3; // 写入值的字节数
+		int keyspace = 100000; // 随机键的个数
+		int timeout = 3000;
+		vector<string> tests; // 为空时执行全部测试
+	};
+
+	// 一项测试的结果，延迟单位为微秒
+	struct Result {
+		string name;
+		long long requests = 0;
+		long long errors = 0;
+		double seconds = 0;
+		RedisHistogram::Snapshot latency;
+
+		double getThroughput() const {
+			return seconds > 0 ? requests / seconds : 0;
+		}
+	};
+
+protected:
+	Config cfg;
+	string value;
+
+public:
+	// eval 测试使用的脚本
+	static const char* GetScript() {
+		return "return redis.call('get', KEYS[1])";
+	}
+
+	static const vector<string>& GetTestList() {
+		static const vector<string> tests = {"ping", "set", "get", "hset", "zadd", "zrange", "eval"};
+		return tests;
+	}
+
+	RedisBench(const Config& cfg) : cfg(cfg), value(std::max(cfg.datasize, 0), 'x') {
+		if (this->cfg.clients <= 0) this->cfg.clients = 1;
+
+		if (this->cfg.pipeline <= 0) this->cfg.pipeline = 1;
+
+		if (this->cfg.keyspace <= 0) this->cfg.keyspace = 1;
+
+		if (this->cfg.tests.empty()) this->cfg.tests = GetTestList();
+	}
+
+	// 命令行选项的说明，与 SetOption 支持的选项对应
+	static const char* GetOptionHelp() {
+		return "  -h  server host (default 127.0.0.1)\n"
+			"  -p  server port (default 6379)\n"
+			"  -a  password\n"
+			"  -c  number of parallel connections (default 50)\n"
+			"  -n  number of requests per test (default 100000)\n"
+			"  -P  number of commands sent in one pipeline (default 1)\n"
+			"  -d  value size of set/hset in bytes (default 3)\n"
+			"  -r  number of random keys (default 100000)\n"
+			"  -t  comma separated tests: ping,set,get,hset,zadd,zrange,eval (default all)\n";
+	}
+
+	// 按命令行选项设置一项配置，选项不支持或参数值无效时返回 false
+	static bool SetOption(Config& cfg, const string& opt, const char* val) {
+		if (val == NULL) return false;
+
+		if (opt == "-h") {
+			cfg.host = val;
+		}
+		else if (opt == "-a") {
+			cfg.passwd = val;
+		}
+		else if (opt == "-t") {
+			stringstream ss(val);
+			string item;
+
+			cfg.tests.clear();
+
+			while (getline(ss, item, ',')) {
+				if (item.length() > 0) cfg.tests.push_back(item);
+			}
+		}
+		else {
+			char* end = NULL;
+			long long num = strtoll(val, &end, 10);
+
+			if (*val == 0 || *end || num < 0) return false;
+
+			if (opt == "-p") {
+				cfg.port = (int)(num);
+			}
+			else if (opt == "-c") {
+				cfg.clients = (int)(num);
+			}
+			else if (opt == "-n") {
+				cfg.requests = num;
+			}
+			else if (opt == "-P") {
+				cfg.pipeline = (int)(num);
+			}
+			else if (opt == "-d") {
+				cfg.datasize = (int)(num);
+			}
+			else if (opt == "-r") {
+				cfg.keyspace = (int)(num);
+			}
+			else {
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	const Config& getConfig() const {
+		return cfg;
+	}
+
+	// 按测试名称生成一条命令，名称不支持时返回 false
+	bool create(const string& name, int idx, Command& cmd) const {
+		string key = "bench:key:" + to_string(idx);
+
+		if (name == "ping") {
+			cmd.add("ping");
+		}
+		else if (name == "set") {
+			cmd.add("set", key, value);
+		}
+		else if (name == "get") {
+			cmd.add("get", key);
+		}
+		else if (name == "hset") {
+			cmd.add("hset", "bench:hash", "field:" + to_string(idx), value);
+		}
+		else if (name == "zadd") {
+			cmd.add("zadd", "bench:zset", idx, "member:" + to_string(idx));
+		}
+		else if (name == "zrange") {
+			cmd.add("zrange", "bench:zset", 0, 99);
+		}
+		else if (name == "eval") {
+			cmd.add("eval", GetScript(), 1, key);
+		}
+		else {
+			return false;
+		}
+
+		return true;
+	}
+
+	// 执行一项测试，连接或命令失败计入 errors，键不存在不算失败
+	Result run(const string& name) {
+		Result res;
+		Command tmp;
+
+		res.name = name;
+
+		if (!create(name, 0, tmp)) {
+			res.errors = cfg.requests;
+
+			return res;
+		}
+
+		atomic<long long> next(0);
+		atomic<long long> errors(0);
+		vector<thread> workers;
+		vector<unique_ptr<RedisHistogram>> hists;
+		RedisPool pool(cfg.host, cfg.port, 0, cfg.passwd, cfg.timeout, 2 * 1024 * 1024, cfg.clients);
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+		// 每个线程使用各自的直方图，避免统计本身产生争用
+		for (int i = 0; i < cfg.clients; i++) hists.push_back(unique_ptr<RedisHistogram>(new RedisHistogram()));
+
+		for (int i = 0; i < cfg.clients; i++) {
+			workers.push_back(thread([&, i]() {
+				long long pos = 0;
+				minstd_rand rand(i + 1);
+				RedisHistogram& hist = *hists[i];
+				const int depth = cfg.pipeline;
+
+				while ((pos = next.fetch_add(depth)) < cfg.requests) {
+					int cnt = (int)(std::min<long long>(depth, cfg.requests - pos));
+					shared_ptr<RedisConnect> redis = pool.grasp();
+
+					if (!redis) {
+						errors += cnt;
+
+						continue;
+					}
+
+					vector<Command> cmds(cnt);
+
+					for (Command& cmd : cmds) create(name, rand() % cfg.keyspace, cmd);
+
+					chrono::steady_clock::time_point begin = chrono::steady_clock::now();
+
+					if (cnt == 1) {
+						redis->execute(cmds[0]);
+					}
+					else {
+						RedisConnect::Pipeline pipe;
+
+						for (Command& cmd : cmds) pipe.append(cmd);
+
+						redis->execute(pipe);
+					}
+
+					long long cost = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - begin).count();
+
+					// 管道中的每条命令都按整批的往返时间计入延迟
+					for (Command& cmd : cmds) {
+						int code = cmd.getCode();
+
+						if (code < 0 && code != RedisConnect::NOTFOUND) errors++;
+
+						hist.record(cost);
+					}
+				}
+			}));
+		}
+
+		for (thread& item : workers) item.join();
+
+		res.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+		res.requests = cfg.requests;
+		res.errors = errors;
+
+		for (auto& item : hists) res.latency.merge(item->snapshot());
+
+		return res;
+	}
+
+	// 按配置的顺序执行全部测试，callback 不为空时每项测试完成后调用
+	vector<Result> run(function<void(const Result&)> callback = NULL) {
+		vector<Result> vec;
+
+		for (const string& name : cfg.tests) {
+			vec.push_back(run(name));
+
+			if (callback) callback(vec.back());
+		}
+
+		return vec;
+	}
+
+	// 输出一项测试的结果，延迟单位为毫秒
+	static string ToString(const Result& res) {
+		char buf[256];
+		const RedisHistogram::Snapshot& data = res.latency;
+
+		snprintf(buf, sizeof(buf), "%-8s %12.2f requests/s  p50=%.3f p99=%.3f p999=%.3f max=%.3f ms  errors=%lld",
+			res.name.c_str(), res.getThroughput(),
+			data.percentile(0.5) / 1000.0, data.percentile(0.99) / 1000.0, data.percentile(0.999) / 1000.0, data.max / 1000.0,
+			res.errors);
+
+		return buf;
+	}
+};
+
+#endif
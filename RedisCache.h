@@ -0,0 +1,460 @@
+#ifndef REDIS_CACHE_H
+#define REDIS_CACHE_H
+///////////////////////////////////////////////////////////////
+#include "RedisConnect.h"
+
+#include <list>
+#include <unordered_map>
+
+// 客户端本地缓存。get/hget 的结果（包括键不存在）按键保存在分片的 LRU 表中，
+// 分片已满时按 TinyLFU 策略决定是否接纳新键：每次读取都在频率草图中计数，
+// 新键的访问频率高于将被淘汰的键时才写入缓存，避免一次性的遍历读取挤掉热点数据。
+// 一致性由一个专用连接保证：该连接以 RESP3 协议开启 CLIENT TRACKING BCAST，
+// 任何客户端修改了匹配前缀的键，服务端都会推送失效消息，监听线程据此删除本地缓存。
+// 专用连接断开期间可能丢失失效消息，因此断开和重连时清空全部缓存，断开期间不缓存。
+// 从服务端读取期间键被修改时，分片的版本号会变化，读到的旧值不会写入缓存。
+class RedisCache {
+protected:
+	typedef RedisConnect::Reply Reply;
+	typedef RedisConnect::Command Command;
+
+	// 一个值的读取结果
+	struct Value {
+		int code = 0; // 读取时的返回值，大于0或为 NOTFOUND
+		string data;
+	};
+
+	// 一个键的缓存内容：字符串值和读取过的哈希字段
+	struct Item {
+		Value val;
+		map<string, Value> fields;
+		list<string>::iterator pos; // 在 LRU 链表中的位置
+	};
+
+	// 估计键的访问频率的 Count-Min 草图：每个键在4行中各对应一个4位计数器，估计值取其中的最小值。
+	// 记录次数达到容量的10倍后全部计数器减半，使过去的热点逐渐冷却
+	class Sketch {
+	protected:
+		size_t mask = 0; // 每行计数器个数减一
+		size_t limit = 0; // 计数器减半前的记录次数
+		size_t samples = 0; // 上次减半之后的记录次数
+		vector<u_char> table;
+
+		size_t index(size_t hash, int row) const {
+			static const u_int64 seeds[] = {0x9E3779B97F4A7C15ULL, 0xC2B2AE3D27D4EB4FULL, 0x165667B19E3779F9ULL, 0xD6E8FEB86659FD93ULL};
+
+			return row * (mask + 1) + ((size_t)((hash * seeds[row]) >> 32) & mask);
+		}
+
+	public:
+		void init(size_t capacity) {
+			size_t width = 16;
+
+			while (width < capacity) width <<= 1;
+
+			mask = width - 1;
+			limit = capacity * 10;
+			table.assign(width * 4, 0);
+		}
+
+		void add(const string& key) {
+			size_t hash = std::hash<string>()(key);
+
+			for (int i = 0; i < 4; i++) {
+				u_char& val = table[index(hash, i)];
+
+				if (val < 15) val++;
+			}
+
+			if (++samples < limit) return;
+
+			for (u_char& val : table) val >>= 1;
+
+			samples /= 2;
+		}
+
+		int estimate(const string& key) const {
+			int res = 15;
+			size_t hash = std::hash<string>()(key);
+
+			for (int i = 0; i < 4; i++) res = std::min<int>(res, table[index(hash, i)]);
+
+			return res;
+		}
+	};
+
+	// 一个分片，使用各自的锁
+	struct Shard {
+		mutex mtx;
+		size_t size = 0; // 缓存的值个数
+		u_int64 epoch = 0; // 分片中有键失效时加一
+		list<string> lru; // 最近使用的键在前
+		unordered_map<string, Item> items;
+		Sketch sketch; // 分片内各键的访问频率
+	};
+
+	size_t capacity; // 每个分片最多缓存的值个数
+	vector<unique_ptr<Shard>> shards;
+	RedisPool* pool = NULL; // 读取数据使用的连接池
+	vector<string> prefixes; // 需要缓存的键前缀，为空时缓存全部键
+
+	thread worker; // 失效消息监听线程
+	bool running = false; // 由 mtx 保护
+	mutex mtx;
+	condition_variable cond;
+	atomic<bool> active; // 专用连接是否已开启跟踪，未开启时不使用缓存
+
+	atomic<long long> hits;
+	atomic<long long> misses;
+	atomic<long long> evicts;
+	atomic<long long> rejects;
+	atomic<long long> invalids;
+
+	Shard& getShard(const string& key) {
+		return *shards[std::hash<string>()(key) % shards.size()];
+	}
+
+	bool match(const string& key) const {
+		if (prefixes.empty()) return true;
+
+		for (const string& item : prefixes) {
+			if (key.compare(0, item.length(), item) == 0) return true;
+		}
+
+		return false;
+	}
+
+	// 查找缓存，调用前需持有分片的锁
+	static Value* Find(Shard& shard, const string& key, const string* field) {
+		auto it = shard.items.find(key);
+
+		if (it == shard.items.end()) return NULL;
+
+		Item& item = it->second;
+		Value* val = NULL;
+
+		if (field) {
+			auto pos = item.fields.find(*field);
+
+			if (pos != item.fields.end()) val = &pos->second;
+		}
+		else if (item.val.code) {
+			val = &item.val;
+		}
+
+		if (val) shard.lru.splice(shard.lru.begin(), shard.lru, item.pos);
+
+		return val;
+	}
+
+	// 写入缓存，读取期间分片有键失效或跟踪已中断时放弃写入。
+	// 分片已满时，新键的访问频率不高于最久未使用的键则不写入
+	void store(Shard& shard, u_int64 epoch, const string& key, const string* field, int code, const string& data) {
+		lock_guard<mutex> lk(shard.mtx);
+
+		if (shard.epoch != epoch || !active) return;
+
+		if (shard.size >= capacity && shard.lru.size() > 0 && shard.items.find(key) == shard.items.end()) {
+			if (shard.sketch.estimate(key) <= shard.sketch.estimate(shard.lru.back())) {
+				rejects++;
+
+				return;
+			}
+		}
+
+		auto res = shard.items.insert(make_pair(key, Item()));
+		Item& item = res.first->second;
+
+		if (res.second) {
+			shard.lru.push_front(key);
+			item.pos = shard.lru.begin();
+		}
+		else {
+			shard.lru.splice(shard.lru.begin(), shard.lru, item.pos);
+		}
+
+		Value& val = field ? item.fields[*field] : item.val;
+
+		if (val.code == 0) shard.size++;
+
+		val.code = code;
+		val.data = data;
+
+		// 淘汰最久未使用的键，当前键位于链表头部不会被淘汰
+		while (shard.size > capacity && shard.lru.size() > 1) {
+			auto it = shard.items.find(shard.lru.back());
+
+			shard.size -= it->second.fields.size() + (it->second.val.code ? 1 : 0);
+			shard.items.erase(it);
+			shard.lru.pop_back();
+			evicts++;
+		}
+	}
+
+	int read(const string& key, const string* field, string& val) {
+		u_int64 epoch = 0;
+		bool cached = active && match(key);
+		Shard& shard = getShard(key);
+
+		if (cached) {
+			lock_guard<mutex> lk(shard.mtx);
+
+			shard.sketch.add(key);
+
+			Value* res = Find(shard, key, field);
+
+			if (res) {
+				hits++;
+				val = res->data;
+
+				return res->code;
+			}
+
+			epoch = shard.epoch;
+		}
+
+		misses++;
+
+		shared_ptr<RedisConnect> redis = pool->grasp();
+
+		if (!redis) return RedisConnect::NETERR;
+
+		int code = field ? redis->hget(key, *field, val) : redis->get(key, val);
+
+		if (cached && (code > 0 || code == RedisConnect::NOTFOUND)) store(shard, epoch, key, field, code, val);
+
+		return code;
+	}
+
+	void invalidate(const string& key) {
+		Shard& shard = getShard(key);
+		lock_guard<mutex> lk(shard.mtx);
+		auto it = shard.items.find(key);
+
+		shard.epoch++;
+		invalids++;
+
+		if (it == shard.items.end()) return;
+
+		shard.size -= it->second.fields.size() + (it->second.val.code ? 1 : 0);
+		shard.lru.erase(it->second.pos);
+		shard.items.erase(it);
+	}
+
+	// 在专用连接上切换到 RESP3 并开启广播模式的键跟踪
+	bool track(RedisConnect& redis) {
+		Command cmd("client");
+
+		cmd.add("tracking", "on", "bcast");
+
+		for (const string& item : prefixes) cmd.add("prefix", item);
+
+		return redis.execute("hello", 3) > 0 && redis.execute(cmd) > 0;
+	}
+
+	// 监听失效消息，连接空闲时发送 PING 检测连接是否可用
+	void run() {
+		int idle = 0;
+		shared_ptr<RedisConnect> redis;
+
+		while (true) {
+			{
+				lock_guard<mutex> lk(mtx);
+
+				if (!running) break;
+			}
+
+			// 建立专用连接后先清空缓存再开启缓存，失败时每秒重试一次
+			if (!redis) {
+				if ((redis = pool->create()) && track(*redis)) {
+					clear();
+					active = true;
+					idle = 0;
+				}
+				else {
+					unique_lock<mutex> lk(mtx);
+
+					redis = NULL;
+					cond.wait_for(lk, chrono::seconds(1), [this]() {
+						return !running;
+					});
+
+					continue;
+				}
+			}
+
+			Command msg;
+			int code = redis->receive(msg, 1000);
+
+			if (code == RedisConnect::TIMEOUT) {
+				Command ping("ping");
+
+				if (++idle > 6 || (idle % 3 == 0 && redis->send(ping) < 0)) code = RedisConnect::NETERR;
+			}
+
+			if (code < 0 && code != RedisConnect::FAIL && code != RedisConnect::TIMEOUT) {
+				active = false;
+				redis = NULL;
+				clear();
+
+				continue;
+			}
+
+			if (code == RedisConnect::TIMEOUT) continue;
+
+			Reply reply = msg.getReply();
+
+			idle = 0;
+
+			if (reply.getType() != Reply::PUSH || reply[0].toString() != "invalidate") continue;
+
+			Reply keys = reply[1];
+
+			// 服务端执行 FLUSHALL 等命令时推送空值，表示全部键失效
+			if (keys.isNil()) {
+				clear();
+			}
+			else {
+				for (int i = 0; i < keys.size(); i++) invalidate(keys[i].toString());
+			}
+		}
+
+		active = false;
+		clear();
+	}
+
+public:
+	// capacity 为最多缓存的值个数，平均分配到各个分片
+	RedisCache(size_t capacity = 10000, int shards = 16) : active(false), hits(0), misses(0), evicts(0), rejects(0), invalids(0) {
+		if (shards <= 0) shards = 1;
+
+		this->capacity = std::max<size_t>(capacity / shards, 1);
+
+		for (int i = 0; i < shards; i++) {
+			Shard* shard = new Shard();
+
+			shard->sketch.init(this->capacity);
+			this->shards.push_back(unique_ptr<Shard>(shard));
+		}
+	}
+
+	~RedisCache() {
+		stop();
+	}
+
+	// 启动失效消息监听线程，prefixes 为需要缓存的键前缀，为空时缓存全部键。
+	// 广播模式下服务端会为每个匹配前缀的写操作推送消息，建议只缓存需要的前缀
+	bool start(RedisPool& pool, const vector<string>& prefixes = vector<string>()) {
+		lock_guard<mutex> lk(mtx);
+
+		if (worker.joinable()) return false;
+
+		this->pool = &pool;
+		this->prefixes = prefixes;
+
+		running = true;
+		worker = thread([this]() {
+			run();
+		});
+
+		return true;
+	}
+
+	// 使用默认连接池启动
+	bool start(const vector<string>& prefixes = vector<string>()) {
+		return start(RedisConnect::GetPool(), prefixes);
+	}
+
+	void stop() {
+		{
+			lock_guard<mutex> lk(mtx);
+
+			running = false;
+		}
+
+		cond.notify_all();
+
+		if (worker.joinable()) worker.join();
+	}
+
+	// 跟踪是否已开启，未开启时读取直接访问服务端
+	bool isActive() const {
+		return active;
+	}
+
+	// 清空全部缓存
+	void clear() {
+		for (auto& item : shards) {
+			Shard& shard = *item;
+			lock_guard<mutex> lk(shard.mtx);
+
+			shard.epoch++;
+			shard.size = 0;
+			shard.lru.clear();
+			shard.items.clear();
+		}
+	}
+
+	// 读取字符串值，返回值与 RedisConnect::get 相同
+	int get(const string& key, string& val) {
+		return read(key, NULL, val);
+	}
+
+	// 读取哈希字段，返回值与 RedisConnect::hget 相同
+	int hget(const string& key, const string& filed, string& val) {
+		return read(key, &filed, val);
+	}
+
+	string get(const string& key) {
+		string res;
+
+		get(key, res);
+
+		return res;
+	}
+
+	string hget(const string& key, const string& filed) {
+		string res;
+
+		hget(key, filed, res);
+
+		return res;
+	}
+
+	// 缓存的值个数
+	size_t size() {
+		size_t num = 0;
+
+		for (auto& item : shards) {
+			lock_guard<mutex> lk(item->mtx);
+
+			num += item->size;
+		}
+
+		return num;
+	}
+
+	long long getHitCount() const {
+		return hits;
+	}
+
+	long long getMissCount() const {
+		return misses;
+	}
+
+	long long getEvictCount() const {
+		return evicts;
+	}
+
+	// 访问频率不足而没有写入缓存的次数
+	long long getRejectCount() const {
+		return rejects;
+	}
+
+	// 收到的失效键个数
+	long long getInvalidateCount() const {
+		return invalids;
+	}
+};
+
+#endif
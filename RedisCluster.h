@@ -0,0 +1,564 @@
+#ifndef REDIS_CLUSTER_H
+#define REDIS_CLUSTER_H
+///////////////////////////////////////////////////////////////
+#include "RedisConnect.h"
+
+// Redis集群客户端。通过 CLUSTER SLOTS 加载槽位表，按键的 CRC16 值将命令发送到
+// 负责该槽位的节点，每个节点使用 RedisPoolRegistry 中各自的连接池。
+// 节点返回 -MOVED 时更新槽位表后重新发送，返回 -ASK 时先发送 ASKING 再重新发送，
+// 调用者看到的是最终节点的执行结果。对象可以在多个线程中共享使用。
+class RedisClusterConnect {
+public:
+	typedef RedisConnect::Reply Reply;
+	typedef RedisConnect::Command Command;
+
+	static const int SLOT_COUNT = 16384; // 集群槽位个数
+	static const int MAX_REDIRECT = 5; // 一条命令最多跟随重定向的次数
+
+protected:
+	int memsz = 2 * 1024 * 1024;
+	int timeout = 3000;
+	string passwd;
+
+	mutex mtx; // 串行化刷新槽位表
+	atomic<time_t> utime; // 最近一次刷新槽位表的时间
+	vector<pair<string, int>> nodes; // 已知的节点地址，刷新槽位表时依次尝试，由 mtx 保护
+	unique_ptr<atomic<RedisPool*>[]> slots; // 每个槽位对应的主节点连接池，连接池由注册表持有
+
+	RedisPool& getPool(const string& host, int port) {
+		return RedisPoolRegistry::Instance()->get(host, port, 0, passwd, timeout, memsz);
+	}
+
+	// 解析 "MOVED 3999 127.0.0.1:6381" 或 "ASK 3999 127.0.0.1:6381" 格式的错误信息
+	static bool ParseRedirect(const string& msg, const char* tag, string& host, int& port) {
+		size_t len = strlen(tag);
+
+		if (msg.compare(0, len, tag) != 0) return false;
+
+		size_t pos = msg.find(' ', len);
+		size_t end = msg.rfind(':');
+
+		if (pos == string::npos || end == string::npos || end <= pos) return false;
+
+		host = msg.substr(pos + 1, end - pos - 1);
+		port = atoi(msg.c_str() + end + 1);
+
+		return port > 0;
+	}
+
+	// 通过一个节点执行 CLUSTER SLOTS 并更新槽位表，节点未返回主机名时使用 host
+	bool load(RedisConnect& redis, const string& host, vector<pair<string, int>>& vec) {
+		Command cmd("cluster");
+
+		cmd.add("slots");
+
+		if (redis.execute(cmd) <= 0) return false;
+
+		Reply root = cmd.getReply();
+
+		for (int i = 0; i < root.size(); i++) {
+			Reply item = root[i];
+			Reply node = item[2];
+			string addr = node[0].toString();
+			int port = (int)(node[1].getInteger());
+			int start = (int)(item[0].getInteger());
+			int end = (int)(item[1].getInteger());
+
+			if (addr.empty() || addr == "?") addr = host;
+
+			if (port <= 0 || start < 0 || end >= SLOT_COUNT) continue;
+
+			RedisPool* pool = &getPool(addr, port);
+
+			for (int slot = start; slot <= end; slot++) slots[slot].store(pool, memory_order_release);
+
+			vec.push_back(make_pair(addr, port));
+		}
+
+		return vec.size() > 0;
+	}
+
+	// 获取命令的路由键所在的槽位，没有键的命令返回-1
+	static int GetSlot(const Command& cmd) {
+		const vector<string>& args = cmd.getArgList();
+
+		if (args.size() < 2) return -1;
+
+		const string& name = args[0];
+
+		// EVAL/EVALSHA/FCALL 的第一个键位于 numkeys 之后
+		if (strcasecmp(name.c_str(), "eval") == 0 || strcasecmp(name.c_str(), "evalsha") == 0 || strcasecmp(name.c_str(), "fcall") == 0) {
+			if (args.size() < 4 || atoi(args[2].c_str()) <= 0) return -1;
+
+			return GetSlot(args[3]);
+		}
+
+		return GetSlot(args[1]);
+	}
+
+public:
+	// CRC16/XMODEM 校验值，与 Redis 集群计算槽位的算法一致
+	static unsigned short CRC16(const char* buf, int len) {
+		static const vector<unsigned short> table = []() {
+			vector<unsigned short> vec(256);
+
+			for (int i = 0; i < 256; i++) {
+				unsigned short crc = i << 8;
+
+				for (int j = 0; j < 8; j++) crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+
+				vec[i] = crc;
+			}
+
+			return vec;
+		}();
+
+		unsigned short crc = 0;
+
+		for (int i = 0; i < len; i++) crc = (crc << 8) ^ table[((crc >> 8) ^ (unsigned char)(buf[i])) & 0xFF];
+
+		return crc;
+	}
+
+	// 获取键所在的槽位。键中包含非空的 {...} 时只计算第一对大括号中的内容
+	static int GetSlot(const char* key, int len) {
+		const char* str = (const char*)memchr(key, '{', len);
+
+		if (str) {
+			const char* end = (const char*)memchr(str + 1, '}', key + len - str - 1);
+
+			if (end && end > str + 1) return CRC16(str + 1, end - str - 1) & (SLOT_COUNT - 1);
+		}
+
+		return CRC16(key, len) & (SLOT_COUNT - 1);
+	}
+
+	static int GetSlot(const string& key) {
+		return GetSlot(key.c_str(), key.length());
+	}
+
+	RedisClusterConnect() : utime(0), slots(new atomic<RedisPool*>[SLOT_COUNT]) {
+		for (int i = 0; i < SLOT_COUNT; i++) slots[i].store(NULL, memory_order_relaxed);
+	}
+
+	// 连接到集群中的任意一个节点并加载槽位表
+	bool connect(const string& host, int port, const string& passwd = "", int timeout = 3000, int memsz = 2 * 1024 * 1024) {
+		RedisConnect::Startup();
+
+		{
+			lock_guard<mutex> lk(mtx);
+
+			this->memsz = memsz;
+			this->passwd = passwd;
+			this->timeout = timeout;
+
+			nodes.insert(nodes.begin(), make_pair(host, port));
+		}
+
+		return refresh(true);
+	}
+
+	// 重新加载槽位表，force 为 false 时一秒内最多刷新一次，正在刷新时直接返回
+	bool refresh(bool force = false) {
+		unique_lock<mutex> lk(mtx, defer_lock);
+
+		if (force) {
+			lk.lock();
+		}
+		else {
+			if (utime.load() == time(NULL) || !lk.try_lock()) return false;
+		}
+
+		utime = time(NULL);
+
+		for (size_t i = 0; i < nodes.size(); i++) {
+			vector<pair<string, int>> vec;
+			shared_ptr<RedisConnect> redis = getPool(nodes[i].first, nodes[i].second).grasp();
+
+			if (redis && load(*redis, nodes[i].first, vec)) {
+				// 成功的节点放在最前面，其余已知节点保留作为下次刷新的备选
+				vec.insert(vec.begin(), nodes[i]);
+
+				for (auto& item : nodes) {
+					if (std::find(vec.begin(), vec.end(), item) == vec.end()) vec.push_back(item);
+				}
+
+				nodes.swap(vec);
+
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	// 获取槽位对应的主节点连接池，槽位表中没有时返回任意一个已知节点的连接池
+	RedisPool* getPool(int slot) {
+		RedisPool* pool = slot >= 0 ? slots[slot].load(memory_order_acquire) : NULL;
+
+		if (pool) return pool;
+
+		if (slot >= 0 && refresh() && (pool = slots[slot].load(memory_order_acquire))) return pool;
+
+		lock_guard<mutex> lk(mtx);
+
+		return nodes.empty() ? NULL : &getPool(nodes[0].first, nodes[0].second);
+	}
+
+	// 执行命令并跟随 MOVED/ASK 重定向，节点不可用时刷新槽位表后换到新的节点重试。
+	// 命令没有在任何节点上执行时记录为 NETERR，调用者可以直接通过 cmd.getCode() 判断结果
+	int execute(Command& cmd) {
+		bool asking = false;
+		int slot = GetSlot(cmd);
+		int code = RedisConnect::NETERR;
+		RedisPool* pool = getPool(slot);
+
+		for (int i = 0; i <= MAX_REDIRECT && pool; i++) {
+			int port = 0;
+			string host;
+			shared_ptr<RedisConnect> redis = pool->grasp();
+
+			// 没有可用连接时命令还未发送，可以安全地换一个节点重试。
+			// 槽位表刷新失败、被限流或者仍指向同一个节点时不再重试，避免反复等待同一个连接池
+			if (!redis) {
+				RedisPool* next = refresh() ? getPool(slot) : NULL;
+
+				if (next == NULL || next == pool) break;
+
+				pool = next;
+
+				continue;
+			}
+
+			if (asking && redis->execute("asking") <= 0) return cmd.fail(redis->getErrorCode() ? RedisConnect::NETERR : RedisConnect::FAIL);
+
+			asking = false;
+
+			if ((code = redis->execute(cmd)) != RedisConnect::FAIL) return code;
+
+			const string& msg = cmd.getErrorString();
+
+			if (ParseRedirect(msg, "MOVED ", host, port)) {
+				pool = &getPool(host, port);
+
+				if (slot >= 0) slots[slot].store(pool, memory_order_release);
+
+				refresh();
+			}
+			else if (ParseRedirect(msg, "ASK ", host, port)) {
+				pool = &getPool(host, port);
+				asking = true;
+			}
+			else {
+				return code;
+			}
+		}
+
+		// 重定向次数超过上限时保留最后一次的执行结果
+		return code == RedisConnect::FAIL ? code : cmd.fail(code);
+	}
+
+	template<class DATA_TYPE, class ...ARGS>
+	int execute(DATA_TYPE val, ARGS ...args) {
+		Command cmd;
+
+		cmd.add(val, args...);
+
+		return execute(cmd);
+	}
+
+	template<class DATA_TYPE, class ...ARGS>
+	int execute(vector<string>& vec, DATA_TYPE val, ARGS ...args) {
+		Command cmd;
+
+		cmd.add(val, args...);
+
+		int code = execute(cmd);
+
+		if (code > 0) vec = cmd.getDataList();
+
+		return code;
+	}
+
+protected:
+	// 以管道方式在一个节点上执行一组命令，收到重定向的命令再逐条执行。
+	// 没有可用连接时管道未发送：槽位表刷新后改由其它节点负责的命令逐条执行，其余记录为 NETERR
+	void send(RedisPool* pool, const vector<Command*>& vec) {
+		shared_ptr<RedisConnect> redis = pool ? pool->grasp() : NULL;
+
+		if (!redis) {
+			bool moved = refresh();
+
+			for (Command* cmd : vec) {
+				if (moved && getPool(GetSlot(*cmd)) != pool) {
+					execute(*cmd);
+				}
+				else {
+					cmd->fail(RedisConnect::NETERR);
+				}
+			}
+
+			return;
+		}
+
+		RedisConnect::Pipeline pipe;
+
+		for (Command* cmd : vec) pipe.append(*cmd);
+
+		redis->execute(pipe);
+		redis = NULL;
+
+		for (Command* cmd : vec) {
+			int port = 0;
+			string host;
+			const string& msg = cmd->getErrorString();
+
+			if (cmd->getCode() == RedisConnect::FAIL && (ParseRedirect(msg, "MOVED ", host, port) || ParseRedirect(msg, "ASK ", host, port))) {
+				execute(*cmd);
+			}
+		}
+	}
+
+public:
+	// 按节点分组执行多条命令：每个节点一个管道，各节点的管道由常驻的工作线程并行发送
+	void dispatch(const vector<Command*>& cmds) {
+		map<RedisPool*, vector<Command*>> group;
+		vector<function<void()>> tasks;
+
+		for (Command* cmd : cmds) group[getPool(GetSlot(*cmd))].push_back(cmd);
+
+		for (auto& item : group) {
+			RedisPool* pool = item.first;
+			const vector<Command*>* vec = &item.second;
+
+			tasks.push_back([this, pool, vec]() {
+				send(pool, *vec);
+			});
+		}
+
+		RedisWorkerPool::Instance()->run(tasks);
+	}
+
+	// 将键按槽位分组，每个槽位生成一条命令，pos 中保存各命令的键在 keys 中的下标
+	static void Split(const char* name, const vector<string>& keys, vector<Command>& cmds, vector<vector<int>>& pos) {
+		map<int, int> idx;
+
+		cmds.clear();
+		pos.clear();
+		cmds.reserve(keys.size());
+
+		for (int i = 0; i < (int)(keys.size()); i++) {
+			auto res = idx.insert(make_pair(GetSlot(keys[i]), (int)(cmds.size())));
+
+			if (res.second) {
+				cmds.push_back(Command(name));
+				pos.push_back(vector<int>());
+			}
+
+			cmds[res.first->second].add(keys[i]);
+			pos[res.first->second].push_back(i);
+		}
+	}
+
+	static vector<Command*> GetPointers(vector<Command>& cmds) {
+		vector<Command*> vec;
+
+		for (Command& cmd : cmds) vec.push_back(&cmd);
+
+		return vec;
+	}
+
+public:
+	// 批量获取多个键的值，按槽位拆分后各节点并行执行，vals 与 keys 一一对应，
+	// 不存在的键对应空字符串。成功时返回键的个数，否则返回第一个失败命令的错误码
+	int mget(const vector<string>& keys, vector<string>& vals) {
+		vector<Command> cmds;
+		vector<vector<int>> pos;
+
+		vals.clear();
+
+		if (keys.empty()) return 0;
+
+		Split("mget", keys, cmds, pos);
+		dispatch(GetPointers(cmds));
+
+		for (size_t i = 0; i < cmds.size(); i++) {
+			if (cmds[i].getCode() <= 0) return cmds[i].getCode();
+		}
+
+		vals.resize(keys.size());
+
+		for (size_t i = 0; i < cmds.size(); i++) {
+			Reply reply = cmds[i].getReply();
+
+			for (size_t j = 0; j < pos[i].size(); j++) vals[pos[i][j]] = reply[j].toString();
+		}
+
+		return keys.size();
+	}
+
+	// 批量设置多个键的值，按槽位拆分后各节点并行执行，全部成功时返回 OK
+	int mset(const map<string, string>& kvs) {
+		map<int, int> idx;
+		vector<Command> cmds;
+
+		if (kvs.empty()) return 0;
+
+		cmds.reserve(kvs.size());
+
+		for (auto& item : kvs) {
+			auto res = idx.insert(make_pair(GetSlot(item.first), (int)(cmds.size())));
+
+			if (res.second) cmds.push_back(Command("mset"));
+
+			cmds[res.first->second].add(item.first, item.second);
+		}
+
+		dispatch(GetPointers(cmds));
+
+		for (Command& cmd : cmds) {
+			if (cmd.getCode() <= 0) return cmd.getCode();
+		}
+
+		return RedisConnect::OK;
+	}
+
+	// 批量删除多个键，按槽位拆分后各节点并行执行，成功时返回实际删除的键的个数
+	int del(const vector<string>& keys) {
+		int num = 0;
+		vector<Command> cmds;
+		vector<vector<int>> pos;
+
+		if (keys.empty()) return 0;
+
+		Split("del", keys, cmds, pos);
+		dispatch(GetPointers(cmds));
+
+		for (Command& cmd : cmds) {
+			if (cmd.getCode() <= 0) return cmd.getCode();
+
+			num += cmd.getStatus();
+		}
+
+		return num;
+	}
+
+	int del(const string& key) {
+		return execute("del", key);
+	}
+
+	int ttl(const string& key) {
+		Command cmd("ttl");
+
+		cmd.add(key);
+
+		return execute(cmd) == RedisConnect::OK ? cmd.getStatus() : cmd.getCode();
+	}
+
+	int hlen(const string& key) {
+		Command cmd("hlen");
+
+		cmd.add(key);
+
+		return execute(cmd) == RedisConnect::OK ? cmd.getStatus() : cmd.getCode();
+	}
+
+	int expire(const string& key, int timeout) {
+		return execute("expire", key, timeout);
+	}
+
+	int hdel(const string& key, const string& filed) {
+		return execute("hdel", key, filed);
+	}
+
+	int get(const string& key, string& val) {
+		Command cmd("get");
+
+		cmd.add(key);
+
+		if (execute(cmd) > 0) {
+			Reply reply = cmd.getReply();
+
+			val.assign(reply.data(), reply.size());
+		}
+
+		return cmd.getCode();
+	}
+
+	int hget(const string& key, const string& filed, string& val) {
+		Command cmd("hget");
+
+		cmd.add(key, filed);
+
+		if (execute(cmd) > 0) {
+			Reply reply = cmd.getReply();
+
+			val.assign(reply.data(), reply.size());
+		}
+
+		return cmd.getCode();
+	}
+
+	string get(const string& key) {
+		string res;
+
+		get(key, res);
+
+		return res;
+	}
+
+	string hget(const string& key, const string& filed) {
+		string res;
+
+		hget(key, filed, res);
+
+		return res;
+	}
+
+	int set(const string& key, const string& val, int timeout = 0) {
+		return timeout > 0 ? execute("setex", key, timeout, val) : execute("set", key, val);
+	}
+
+	int hset(const string& key, const string& filed, const string& val) {
+		return execute("hset", key, filed, val);
+	}
+
+	int zrem(const string& key, const string& filed) {
+		return execute("zrem", key, filed);
+	}
+
+	int zadd(const string& key, const string& filed, int score) {
+		return execute("zadd", key, score, filed);
+	}
+
+	int zrange(vector<string>& vec, const string& key, int start, int end, bool withscore = false) {
+		return withscore ? execute(vec, "zrange", key, start, end, "withscores") : execute(vec, "zrange", key, start, end);
+	}
+
+	// 执行Lua脚本，全部键需要位于同一个槽位（可以使用 {...} 指定）
+	template<class ...ARGS>
+	int eval(vector<string>& vec, const string& lua, const vector<string>& keys, ARGS ...args) {
+		Command cmd("eval");
+
+		cmd.add(lua);
+		cmd.add((int)(keys.size()));
+
+		for (const string& key : keys) cmd.add(key);
+
+		AddArgs(cmd, args...);
+
+		if (execute(cmd) > 0) vec = cmd.getDataList();
+
+		return cmd.getCode();
+	}
+
+protected:
+	static void AddArgs(Command&) {}
+
+	template<class DATA_TYPE, class ...ARGS>
+	static void AddArgs(Command& cmd, DATA_TYPE val, ARGS ...args) {
+		cmd.add(val, args...);
+	}
+};
+
+#endif
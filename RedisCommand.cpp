@@ -1,4 +1,5 @@
-#include "RedisConnect.h"
+#include "RedisBench.h"
+#include "RedisTransfer.h"
 
 #define ColorPrint(__COLOR__, __FMT__, ...)		\
 SetConsoleTextColor(__COLOR__);					\
@@ -41,6 +42,158 @@ bool CheckCommand(const char* fmt, ...)
 	return false;
 }
 
+// 输出导入导出的进度，数据可能写到标准输出，因此进度输出到标准错误
+void PrintProgress(const RedisTransfer::Progress& progress, bool finished, const char* name)
+{
+	fprintf(stderr, "\r已%s%lld条 %.0f ops/s %.2f MB 错误%lld条   ", name, progress.commands, progress.getThroughput(), progress.bytes / 1024.0 / 1024.0, progress.errors);
+
+	if (finished) fprintf(stderr, "\n共耗时%.3f秒\n", progress.seconds);
+
+	if (finished && progress.error.length() > 0) fprintf(stderr, "错误信息：%s\n", progress.error.c_str());
+}
+
+// 批量导入导出：
+//   --pipe [-c 连接数] [-P 管道深度]              从标准输入读取命令
+//   --import 文件 [-c 连接数] [-P 管道深度]       从文件读取命令或导出文件
+//   --export 模式 [文件]                          导出匹配的键，未指定文件时写到标准输出
+int Transfer(int argc, char** argv, const char* host, int port, const char* passwd)
+{
+	FILE* fp = NULL;
+	string mode = argv[1];
+	RedisTransfer::Config cfg;
+	const char* target = NULL;
+	int idx = 2;
+
+	cfg.host = host;
+	cfg.port = port;
+	cfg.passwd = passwd ? passwd : "";
+
+	if (mode != "--pipe")
+	{
+		if (argc <= idx || (mode != "--import" && mode != "--export"))
+		{
+			fprintf(stderr, "usage: %s --pipe | --import file | --export pattern [file] [-c clients] [-P pipeline]\n", argv[0]);
+
+			return -1;
+		}
+
+		target = argv[idx++];
+	}
+
+	for (; idx < argc; idx++)
+	{
+		string opt = argv[idx];
+
+		if (opt == "-c" && idx + 1 < argc)
+		{
+			cfg.clients = atoi(argv[++idx]);
+		}
+		else if (opt == "-P" && idx + 1 < argc)
+		{
+			cfg.pipeline = atoi(argv[++idx]);
+		}
+		else if (mode == "--export" && fp == NULL && opt != "-")
+		{
+			if ((fp = fopen(opt.c_str(), "wb")) == NULL)
+			{
+				fprintf(stderr, "打开文件[%s]失败\n", opt.c_str());
+
+				return -1;
+			}
+		}
+		else if (mode != "--export" || opt != "-")
+		{
+			fprintf(stderr, "无效的参数[%s]\n", opt.c_str());
+
+			return -1;
+		}
+	}
+
+	RedisConnect::Startup();
+
+	RedisTransfer transfer(cfg);
+
+	int res = 0;
+	long long errors = 0;
+
+	if (mode == "--export")
+	{
+		if (fp == NULL) fp = stdout;
+
+		res = transfer.exportTo(target, fp, [&](const RedisTransfer::Progress& progress, bool finished){
+			errors = progress.errors;
+			PrintProgress(progress, finished, "导出");
+		});
+	}
+	else
+	{
+		if (target && (fp = fopen(target, "rb")) == NULL)
+		{
+			fprintf(stderr, "打开文件[%s]失败\n", target);
+
+			return -1;
+		}
+
+		if (fp == NULL) fp = stdin;
+
+		res = transfer.importFrom(fp, [&](const RedisTransfer::Progress& progress, bool finished){
+			errors = progress.errors;
+			PrintProgress(progress, finished, "执行");
+		});
+	}
+
+	if (fp != stdin && fp != stdout) fclose(fp);
+
+	if (res < 0)
+	{
+		fprintf(stderr, "REDIS[%s][%d]%s失败[%d]\n", host, port, mode == "--export" ? "导出" : "导入", res);
+
+		return -1;
+	}
+
+	return errors > 0 ? 1 : 0;
+}
+
+// 压力测试：bench [-c 连接数] [-n 请求数] [-P 管道深度] [-d 数据大小] [-r 键数量] [-t 测试列表]，
+// 通过 RedisPool 和 RedisConnect 执行，与业务代码的调用路径相同。有请求失败时返回1
+int Bench(int argc, char** argv, const char* host, int port, const char* passwd)
+{
+	RedisBench::Config cfg;
+
+	cfg.host = host;
+	cfg.port = port;
+	cfg.passwd = passwd ? passwd : "";
+
+	for (int i = 2; i < argc; i += 2)
+	{
+		if (!RedisBench::SetOption(cfg, argv[i], i + 1 < argc ? argv[i + 1] : NULL))
+		{
+			printf("usage: %s bench [-h host] [-p port] [-a password] [-c clients] [-n requests] [-P pipeline] [-d datasize] [-r keyspace] [-t tests]\n", argv[0]);
+			printf("%s", RedisBench::GetOptionHelp());
+
+			return -1;
+		}
+	}
+
+	RedisConnect::Startup();
+
+	RedisBench bench(cfg);
+	long long errors = 0;
+	const RedisBench::Config& conf = bench.getConfig();
+
+	printf("server %s:%d  clients=%d requests=%lld pipeline=%d datasize=%d keyspace=%d\n",
+		conf.host.c_str(), conf.port, conf.clients, conf.requests, conf.pipeline, conf.datasize, conf.keyspace);
+
+	bench.run([&](const RedisBench::Result& res){
+		errors += res.errors;
+
+		ColorPrint(res.errors > 0 ? eRED : eGREEN, "%s\n", RedisBench::ToString(res).c_str());
+		fflush(stdout);
+	});
+
+	return errors > 0 ? 1 : 0;
+}
+
 int main(int argc, char** argv)
 {
 	auto GetCmdParam = [&](int idx){
@@ -57,7 +210,7 @@ int main(int argc, char** argv)
 	int port = 6379;
 	const char* host = getenv("REDIS_HOST");
 	const char* passwd = getenv("REDIS_PASSWORD");
-    cout << passwd<< endl;
+
 	if (host)
 	{
 		if (ptr = strchr(host, ':'))
@@ -70,6 +223,10 @@ int main(int argc, char** argv)
 
 	if (host == NULL || *host == 0) host = "127.0.0.1";
 
+	if (cmd && strncmp(cmd, "--", 2) == 0) return Transfer(argc, argv, host, port, passwd);
+
+	if (cmd && strcmp(cmd, "bench") == 0) return Bench(argc, argv, host, port, passwd);
+
 	if (redis.connect(host, port))
 	{
 		if (passwd && *passwd)
@@ -96,32 +253,35 @@ int main(int argc, char** argv)
 
 		if (tmp == "DELS" && key && *key)
 		{
-			vector<string> vec;
-
-			if (redis.keys(vec, key) > 0)
+			if (CheckCommand("确认要删除匹配[%s]的键值？", key))
 			{
-				if (CheckCommand("确认要删除键值[%s]？", key))
-				{
-					ColorPrint(eWHITE, "%s\n", "--------------------------------------");
+				ColorPrint(eWHITE, "%s\n", "--------------------------------------");
 
-					for (const string& item : vec)
-					{
-						if (redis.del(item))
-						{
-							ColorPrint(eGREEN, "删除键值[%s]成功\n", item.c_str());
-						}
-						else
-						{
-							ColorPrint(eRED, "删除键值[%s]失败\n", item.c_str());
-						}
-					}
+				long long scanned = 0;
+				long long deleted = 0;
 
-					ColorPrint(eWHITE, "%s\n\n", "--------------------------------------");
+				res = redis.dels(key, scanned, deleted, [](long long scanned, long long deleted){
+					printf("\r已扫描%lld个键值，已删除%lld个键值", scanned, deleted);
+					fflush(stdout);
+				});
+
+				if (scanned > 0) printf("\n");
+
+				// 扫描到的键可能在删除之前已过期或被其它客户端删除，两个数量分别输出
+				if (res < 0)
+				{
+					ColorPrint(eRED, "删除键值[%s]失败[%s]\n", key, redis.getErrorString().c_str());
 				}
-			}
-			else
-			{
-				ColorPrint(eRED, "删除键值[%s]失败\n", key);
+				else if (scanned == 0)
+				{
+					ColorPrint(eRED, "没有匹配[%s]的键值\n", key);
+				}
+				else
+				{
+					ColorPrint(eGREEN, "共扫描到%lld个键值，删除%lld个键值\n", scanned, deleted);
+				}
+
+				ColorPrint(eWHITE, "%s\n\n", "--------------------------------------");
 			}
 		}
 		else
@@ -2,6 +2,11 @@
 #define REDIS_CONNECT_H
 ///////////////////////////////////////////////////////////////
 #include "ResPool.h"
+#include "RedisMetrics.h"
+
+#include <map>
+#include <random>
+#include <unordered_set>
 
 #ifdef XG_LINUX
 
@@ -21,6 +26,8 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <sys/syscall.h>
+#include <sys/uio.h>
+#include <limits.h>
 
 #define ioctlsocket ioctl // 非阻塞模式
 #define INVALID_SOCKET (SOCKET)(-1)
@@ -31,6 +38,9 @@ typedef int SOCKET;
 
 using namespace std;
 
+class RedisPool;
+class AsyncRedisConnect;
+
 // 该类提供了一种简单和方便的方法来连接到Redis服务器并执行命令。
 // 它还提供了一些有用的方法来处理Redis命令和实现分布式锁。
 class RedisConnect {
@@ -58,7 +68,12 @@ public:
 // 设置限制条件
 public:
 	static int POOL_MAXLEN; // 连接池最大容量
+	static int POOL_WAITTIME; // 连接池耗尽时获取连接的最长等待毫秒数
+	static int POOL_MINIDLE; // 后台维护线程保持的最少空闲连接数，为0时不启动维护线程
 	static int SOCKET_TIMEOUT; // 超时阈值
+	static const int SCAN_COUNT = 1000; // SCAN 类命令每批建议返回的元素个数
+	static const int LOCK_MIN_BACKOFF = 10; // 获取锁失败后首次重试的等待毫秒数
+	static const int LOCK_MAX_BACKOFF = 1000; // 获取锁失败后重试的最长等待毫秒数
 
 
 public:
@@ -221,6 +236,17 @@ public:
 			return IsSocketClosed(sock);
 		}
 
+		SOCKET getHandle() const {
+			return sock;
+		}
+
+		// 设置套接字为阻塞或非阻塞模式
+		bool setBlocking(bool flag) {
+			u_long mode = flag ? 0 : 1;
+
+			return ioctlsocket(sock, FIONBIO, &mode) == 0;
+		}
+
 		// 设置套接字的发送超时时间
 		bool setSendTimeout(int timeout) {
 			return SocketSetSendTimeout(sock, timeout);
@@ -251,7 +277,7 @@ public:
 
 			while (writed < count) {
 				// // 使用send函数进行写入操作
-				if ((num = send(sock, str + writed, count - writed, 0)) > 0) {
+				if ((num = ::send(sock, str + writed, count - writed, 0)) > 0) {
 					if (num > 8) {
 						times = 0;
 					}
@@ -277,6 +303,52 @@ public:
 			return writed;
 		}
 
+#ifdef XG_LINUX
+		// 通过 writev 将多个不连续的数据块一次写入套接字，返回实际写入的字节数。
+		// 部分写入时调整剩余的数据块继续写入，超时和错误的处理与 write 相同。
+		int write(struct iovec* vec, int cnt) {
+			int num = 0;
+			int times = 0;
+			int writed = 0;
+
+			while (cnt > 0) {
+				if ((num = ::writev(sock, vec, cnt < IOV_MAX ? cnt : IOV_MAX)) > 0) {
+					if (num > 8) {
+						times = 0;
+					}
+					else {
+						if (++times > 100) return TIMEOUT;
+					}
+
+					writed += num;
+
+					// 跳过已经写完的数据块
+					while (cnt > 0 && (size_t)(num) >= vec->iov_len) {
+						num -= vec->iov_len;
+						++vec;
+						--cnt;
+					}
+
+					if (cnt > 0) {
+						vec->iov_base = (char*)(vec->iov_base) + num;
+						vec->iov_len -= num;
+					}
+				}
+				else {
+					if (IsSocketTimeout()) {
+						if (++times > 100) return TIMEOUT;
+
+						continue;
+					}
+
+					return NETERR;
+				}
+			}
+
+			return writed;
+		}
+#endif
+
 		// read函数的作用是从套接字读取指定长度的数据，并将读取的数据存储到指定的缓冲区中，返回实际读取的字节数。
 		// 其中completed参数用于指定读取方式。
 		// 如果completed为true，则使用循环的方式进行读取操作，直到读取完成或者出现错误
@@ -333,368 +405,1475 @@ public:
 
 	};
 
-    // 封装redis命令
-    class Command {
-		friend RedisConnect;
-
-	protected:
-		int status; //  Redis 命令执行的状态码
-		string msg; // Redis 命令执行的输出信息
-		vector<string> res; // Redis 命令执行的结果，以字符串数组的形式保存
-		vector<string> vec; // Redis 命令的参数，以字符串数组的形式保存
-	
+	// 可伸缩的数据缓冲区。接收应答时按需成倍扩容，不再受固定容量的限制；
+	// 完整的应答可以通过交换存储区直接转移给命令对象，避免逐个复制元素。
+	class Buffer {
 	protected:
-		//  解析Redis 命令的返回结果
-		int parse(const char* msg, int len) {
-			// 如果是 $，则说明这是一个字符串类型的返回结果，需要调用 parseNode 函数解析该节点，并返回相应的状态码。
-			if (*msg == '$')
-			{
-				const char* end = parseNode(msg, len);
-
-				if (end == NULL) return DATAERR;
-
-				switch (end - msg) {
-					case 0: return TIMEOUT;
-					case -1: return NOTFOUND;
-				}
-
-				return OK;
-			}
-
-			const char* str = msg + 1;
-			const char* end = strstr(str, "\r\n");
+		int len; // 已写入的字节数
+		int cap; // 已分配的容量
+		char* buf; // 存储区
 
-			if (end == NULL) return TIMEOUT;
-
-			// 如果 Redis 命令返回结果的第一个字符为 +、- 、:, 则说明该结果为状态码、错误信息或整数值类型的返回结果。
-			if (*msg == '+' || *msg == '-' || *msg == ':') {
-				this->status = OK;
-				this->msg = string(str, end);
+	public:
+		static const int MIN_SIZE = 4 * 1024; // 首次分配的容量
 
-				if (*msg == '+') return OK;
-				if (*msg == '-') return FAIL;
+		Buffer() : len(0), cap(0), buf(NULL) {}
 
-				this->status = atoi(str);
+		Buffer(const Buffer& obj) : len(0), cap(0), buf(NULL) {
+			assign(obj.buf, obj.len);
+		}
 
-				return OK;
-			}
+		Buffer& operator=(const Buffer& obj) {
+			if (this != &obj) assign(obj.buf, obj.len);
 
-			// 说明该结果为数组类型的返回结果。
-			if (*msg == '*') {
-				int cnt = atoi(str);
-				const char* tail = msg + len;
+			return *this;
+		}
 
-				vec.clear();
-				str = end + 2;
+		~Buffer() {
+			free(buf);
+		}
 
-				while (cnt > 0) {
-					if (*str == '*') return parse(str, tail - str);
+		char* data() const {
+			return buf;
+		}
 
-					end = parseNode(str, tail - str);
+		int size() const {
+			return len;
+		}
 
-					if (end == NULL) return DATAERR;
-					if (end == str) return TIMEOUT;
+		int space() const {
+			return cap - len;
+		}
 
-					str = end;
-					cnt--;
-				}
+		int capacity() const {
+			return cap;
+		}
 
-				return res.size();
-			}
+		void clear() {
+			len = 0;
+		}
 
-			return DATAERR;
+		void swap(Buffer& obj) {
+			std::swap(len, obj.len);
+			std::swap(cap, obj.cap);
+			std::swap(buf, obj.buf);
 		}
 
-		// 将字符串值解析成一个字符串，并将该字符串保存到 res 数组中。
-		const char* parseNode(const char* msg, int len) {
-			const char* str = msg + 1;
-			const char* end = strstr(str, "\r\n");
+		// 释放存储区，缓冲区回到初始状态
+		void release() {
+			free(buf);
+			buf = NULL;
+			len = cap = 0;
+		}
 
-			if (end == NULL) return msg;
+		// 保证尾部至少有 sz 字节可写，返回写入位置，内存不足时返回NULL
+		char* reserve(int sz) {
+			if (cap - len >= sz) return buf + len;
 
-			int sz = atoi(str);
+			int num = cap > MIN_SIZE ? cap : MIN_SIZE;
 
-			if (sz < 0) return msg + sz;
+			while (num - len < sz) num <<= 1;
 
-			str = end + 2;
-			end = str + sz + 2;
+			char* tmp = (char*)realloc(buf, num);
 
-			if (msg + len < end) return msg;
+			if (tmp == NULL) return NULL;
 
-			res.push_back(string(str, str + sz));
+			buf = tmp;
+			cap = num;
 
-			return end;
+			return buf + len;
 		}
-	
-	public:
-		Command():status(0) {}
 
-		Command(const string& cmd) {
-			vec.push_back(cmd);
-			this->status = 0;
+		// 确认写入 sz 字节
+		void commit(int sz) {
+			len += sz;
 		}
 
-		void add(const char* val) {
-			vec.push_back(val);
+		// 移走头部的 sz 字节
+		void erase(int sz) {
+			if ((len -= sz) > 0) memmove(buf, buf + sz, len);
 		}
 
-		void add(const string& val) {
-			vec.push_back(val);
-		}
+		bool append(const char* data, int sz) {
+			if (sz <= 0) return true;
 
-		template<class DATA_TYPE> 
-		void add(DATA_TYPE val) {
-			add(to_string(val));
-		}
+			char* dest = reserve(sz);
 
-		template<class DATA_TYPE, class ...ARGS> 
-		void add(DATA_TYPE val, ARGS ...args) {
-			add(val);
-			add(args...);
-		}
+			if (dest == NULL) return false;
 
-	public:
-		string toString() {
-			ostringstream out;
-			out << "*" << vec.size() << "\r\n";
-			for (const string& item : vec) {
-				out << "$" << item.length() << "\r\n" << item << "\r\n";
-			}
-			return out.str();
-		}
+			memcpy(dest, data, sz);
+			len += sz;
 
-		string get(int idx) const {
-			return res.at(idx);
+			return true;
 		}
 
-		const vector<string>& getDataList() const {
-			return res;
-		}
+		bool assign(const char* data, int sz) {
+			len = 0;
 
-		// 通过连接 Redis 服务器并向服务器发送 Redis 命令，
-		// 然后等待 Redis 服务器返回执行结果，并将结果解析成相应的数据结构。
-		int getResult(RedisConnect* redis, int timeout) {
-			auto doWork = [&]() {
-				// 将 Redis 命令转换成字符串后保存到 msg 变量中。
-				string msg = toString();
-				// 获取 Redis 连接对象中的 Socket 对象
-				Socket& sock = redis->sock;
+			if (sz <= 0) return true;
 
-				// 将 Redis 命令发送到 Redis 服务器
-				if (sock.write(msg.c_str(), msg.length()) < 0) return NETERR;
+			char* dest = reserve(sz);
 
-				// 定义一些变量，用于读取 Redis 服务器的响应消息
-				int len = 0;
-				int delay = 0;
-				int readed = 0;
-				char* dest = redis->buffer;
-				const int maxsz = redis->memsz;
+			if (dest == NULL) return false;
 
-				// 进入一个循环，不停地读取 Redis 服务器的响应消息
-				while (readed < maxsz) {
-					// 从 Socket 对象中读取响应消息
-					if ((len = sock.read(dest + readed, maxsz - readed, false)) < 0) return len;
+			memcpy(dest, data, len = sz);
 
-					// 如果读取到的数据长度为 0，则说明 Redis 服务器暂时没有响应消息，需要等待一段时间 
-					if (len == 0) {
-						delay += SOCKET_TIMEOUT;
+			return true;
+		}
+	};
 
-						if (delay > timeout) return TIMEOUT;
-					}
-					else {
-						dest[readed += len] = 0;
-						 // 如果解析失败，则继续等待 Redis 服务器的响应消息
-						if ((len = parse(dest, readed)) == TIMEOUT)
-						{
-							delay = 0;
-						}
-						else
-						{
-							return len;
-						}
-					}
-				}
+    // 可续传的RESP应答解析器，支持RESP2和RESP3的全部类型。它记录下一个待解析元素的位置
+	// 和尚未解析完的聚合类型层级，新数据到达后从上次停下的位置继续，已经扫描过的字节
+	// 不会重复扫描，因此分多次到达的大数组应答也只需要线性时间。
+	class Decoder {
+	protected:
+		// 尚未解析完的聚合类型
+		struct Level {
+			char type; // 类型前缀
+			int cnt; // 剩余元素个数
+		};
 
-				return PARAMERR;
-			};
+		int pos; // 下一个待解析元素的起始位置
+		int scan; // 查找行结束符的起始位置
+		int mute; // 所在的属性层数，属性(|)中的元素不回调
+		vector<Level> stack; // 尚未解析完的各层聚合类型
 
-			status = 0;
-			msg.clear();
+		// 读取长度前缀，负数统一为-1。前缀只能由数字组成并紧跟行结束符，
+		// 不能像 atoi 那样跳过空白读到下一行；超过上限的长度无法存入接收缓冲区，
+		// 按格式错误处理，同时保证之后计算位置和元素个数时不会溢出
+		static bool GetLength(const char* str, int& cnt) {
+			long long val = 0;
+			bool neg = *str == '-';
 
-			redis->code = doWork();
+			if (neg) str++;
 
-			if (redis->code < 0 && msg.empty())
-			{
-				switch (redis->code)
-				{
-				case SYSERR:
-					msg = "system error";
-					break;
-				case NETERR:
-					msg = "network error";
-					break;
-				case DATAERR:
-					msg = "protocol error";
-					break;
-				case TIMEOUT:
-					msg = "response timeout";
-					break;
-				case NOTFOUND:
-					msg = "element not found";
-					break;
-				default:
-					msg = "unknown error";
-					break;
+			if (*str < '0' || *str > '9') return false;
+
+			while (*str >= '0' && *str <= '9') {
+				if ((val = val * 10 + (*str++ - '0')) > MAX_LENGTH) {
+					if (!neg) return false;
+
+					val = MAX_LENGTH;
 				}
 			}
 
-			redis->status = status;
-			redis->msg = msg;
+			if (*str != '\r') return false;
 
-			return redis->code;
+			cnt = neg ? -1 : (int)(val);
+
+			return true;
 		}
-    };
 
-protected:
-    int code = 0; // 表示Redis服务器返回的错误代码。
-    int port = 0; // Redis服务器的端口号。
-    int memsz = 0; // Redis服务器分配的内存大小。
-    int status = 0; // 表示Redis命令的执行状态。
-    int timeout = 0; // Redis命令的超时时间（以毫秒为单位）。
-    char* buffer = NULL; // 用于存储从Redis服务器接收的数据的缓冲区。
+	public:
+		static const int MAX_LENGTH = 0x3FFFFFFF; // 长度前缀的上限
 
-    string msg; // Redis服务器返回的错误消息。
-    string host; // Redis服务器的主机名或IP地址。
-    Socket sock; // 用于与Redis服务器建立TCP连接的Socket对象。
-    string passwd; // Redis服务器的密码（如果有）。
 
-public:
-    ~RedisConnect() {
-        close();
-    }
+		Decoder() {
+			reset();
+		}
 
-public:
-    int getStatus() const {
-        return status;
-    }
+		// 从指定位置开始解析一个新的应答
+		void reset(int offset = 0) {
+			pos = scan = offset;
+			mute = 0;
+			stack.clear();
+		}
 
-    int getErrorCode() const {
-        if(sock.isClosed())
-            return FAIL;
-        return code < 0? code : 0;
-    }
+		// 缓冲区头部的 len 个字节被移走后同步调整解析位置
+		void shift(int len) {
+			pos -= len;
+			scan -= len;
+		}
 
-    string getErrorString() const {
-        return msg;
-    }
+		// 当前应答已解析部分的结束位置
+		int getOffset() const {
+			return pos;
+		}
 
-public:
-	// 用于关闭与Redis服务器的连接，并释放任何内存分配。
-    void close() {
-        if(buffer) {
-            delete[] buffer;
-            buffer = NULL;
-        }
-        sock.close();
-    }
+		// 解析 data 中从上次停止位置到 len 之间的数据，每解析出一个元素就回调 handler：
+		// 标量元素回调 onValue(type, str, len)，空值的 len 为 -1；
+		// 聚合元素先回调 onBegin(type, cnt)，全部子元素解析完毕后回调 onEnd()，
+		// 其中 MAP 的 cnt 为键和值的总个数。
+		// 返回 OK 表示一个完整应答已解析完毕，TIMEOUT 表示数据不足，DATAERR 表示格式错误。
+		template<class HANDLER>
+		int decode(const char* data, int len, HANDLER& handler) {
+			while (pos < len) {
+				const char* str = data + pos;
 
-	// 用于重新连接到Redis服务器。
-    bool reconnect() {
-        if(host.empty())
-            return false;
-        return connect(host, port, timeout, memsz) && auth(passwd) > 0;
-    }
+				// memchr 由标准库以向量指令实现，远快于逐字节比较的 strstr
+				const char* end = (const char*)memchr(data + scan, '\n', len - scan);
 
+				if (end == NULL) {
+					scan = len;
 
-	// 该函数的作用是执行Redis命令，并返回命令的结果
-    int execute(Command& cmd) {
-        return cmd.getResult(this, timeout);
-    }
+					return TIMEOUT;
+				}
 
-	// 该函数的作用是执行Redis命令，并返回命令的结果。
-	// 它使用可变参数模板来接受任意数量和类型的参数，使其更加灵活和通用。
-    template<class DATA_TYPE, class ...ARGS>
-	int execute(DATA_TYPE val, ARGS ...args) {
-		Command cmd;
+				if (end - str < 2 || end[-1] != '\r') return DATAERR;
 
-		cmd.add(val, args...);
+				int cnt = 0;
+				char type = *str;
+				int head = end + 1 - data;
 
-		return cmd.getResult(this, timeout);
-	}
+				switch (type) {
+					// 带长度前缀的字符串、格式化文本和二进制错误信息
+					case '$':
+					case '=':
+					case '!':
+						if (!GetLength(str + 1, cnt)) return DATAERR;
 
-	// 用于执行Redis命令并将结果存储在一个字符串向量中，并返回Redis服务器返回的错误代码。
-    template<class DATA_TYPE, class ...ARGS>
-	int execute(vector<string>& vec, DATA_TYPE val, ARGS ...args) {
-		Command cmd;
+						if (cnt < 0) {
+							if (mute == 0) handler.onValue(type, NULL, -1);
 
-		cmd.add(val, args...);
+							break;
+						}
 
-		cmd.getResult(this, timeout);
+						// 字符串尚未完整到达，下次仍从首行结束处开始检查
+						if (len < (long long)(head) + cnt + 2) {
+							scan = end - data;
 
-		if (code > 0) std::swap(vec, cmd.res);
+							return TIMEOUT;
+						}
 
-		return code;
-	}
+						if (data[head + cnt] != '\r' || data[head + cnt + 1] != '\n') return DATAERR;
 
+						if (mute == 0) handler.onValue(type, data + head, cnt);
 
-	// 该函数首先调用close()函数关闭先前的连接（如果有的话）。
-	// 在建立新连接之前，先调用close()函数是一个良好的编程实践，可以确保代码的健壮性和可靠性。
-	// 然后，它使用Socket类的connect()函数尝试建立到Redis服务器的新连接。
-    bool connect(const string& host, int port, int timeout = 3000, int memsz = 2 * 1024 * 1024) {
-		close();
+						head += cnt + 2;
 
-		if (sock.connect(host, port, timeout))
-		{
-			sock.setSendTimeout(SOCKET_TIMEOUT);
-			sock.setRecvTimeout(SOCKET_TIMEOUT);
+						break;
+					// 数组、映射、集合、推送消息和属性
+					case '*':
+					case '%':
+					case '~':
+					case '>':
+					case '|':
+						if (!GetLength(str + 1, cnt)) return DATAERR;
 
-			this->host = host;
-			this->port = port;
-			this->memsz = memsz;
-			this->timeout = timeout;
-			this->buffer = new char[memsz + 1];
-		}
+						if (cnt < 0) {
+							if (mute == 0) handler.onValue(type, NULL, -1);
 
-		return buffer ? true : false;
-	}
+							break;
+						}
 
-public:
-    int ping() {
-		return execute("ping");
-	}
+						if (type == '%' || type == '|') cnt <<= 1;
 
-	int del(const string& key) {
-		return execute("del", key);
-	}
-	
-	int ttl(const string& key) {
-		return execute("ttl", key) == OK ? status : code;
-	}
-	
-	// 用于获取指定哈希表中的字段数量。
-	int hlen(const string& key) {
-		return execute("hlen", key) == OK ? status : code;
-	}
+						if (type == '|') {
+							if (cnt == 0) break;
 
-    int auth(const string& passwd) {
-		this->passwd = passwd;
+							++mute;
+						}
+						else if (mute == 0) {
+							handler.onBegin(type, cnt);
 
-		if (passwd.empty()) return OK;
+							if (cnt == 0) handler.onEnd();
+						}
 
-		return execute("auth", passwd);
-	}
+						if (cnt > 0) {
+							Level item = {type, cnt};
 
-	// 用于获取指定键名对应的字符串值
-	int get(const string& key, string& val) {
-		vector<string> vec;
+							stack.push_back(item);
+							pos = scan = head;
 
-		if (execute(vec, "get", key) <= 0) return code;
+							continue;
+						}
 
-		val = vec[0];
+						break;
+					// 单行的状态、错误、整数、浮点数、布尔值、大整数和空值
+					case '+':
+					case '-':
+					case ':':
+					case ',':
+					case '#':
+					case '(':
+					case '_':
+						if (mute == 0) handler.onValue(type, str + 1, type == '_' ? -1 : end - str - 2);
+
+						break;
+					default:
+						return DATAERR;
+				}
+
+				pos = scan = head;
+
+				// 一个元素解析完毕，逐层减少所属聚合类型的剩余元素个数。
+				// 属性只是附加信息，不计入所属聚合类型的元素个数。
+				while (type != '|') {
+					if (stack.empty()) return OK;
+
+					if (--stack.back().cnt > 0) break;
+
+					type = stack.back().type;
+					stack.pop_back();
+
+					if (type == '|') {
+						--mute;
+					}
+					else if (mute == 0) {
+						handler.onEnd();
+					}
+				}
+			}
+
+			return TIMEOUT;
+		}
+	};
+
+	class Command;
+
+	// 应答树中一个节点的只读视图，节点数据保存在所属的 Command 对象中，
+	// 在该命令下一次执行之前有效。
+	class Reply {
+		friend class Command;
+
+	public:
+		// 节点类型，取值为对应的RESP类型前缀
+		enum Type {
+			NIL = '_',
+			STATUS = '+',
+			ERRMSG = '-',
+			INTEGER = ':',
+			STRING = '$',
+			DOUBLE = ',',
+			BOOLEAN = '#',
+			BIGNUM = '(',
+			VERBATIM = '=',
+			ARRAY = '*',
+			MAP = '%',
+			SET = '~',
+			PUSH = '>'
+		};
+
+	protected:
+		int idx; // 节点下标
+		const Command* cmd; // 所属的命令
+
+		Reply(const Command* cmd, int idx) : idx(idx), cmd(cmd) {}
+
+	public:
+		Reply() : idx(-1), cmd(NULL) {}
+
+		Type getType() const {
+			if (cmd == NULL) return NIL;
+
+			const Command::Node& item = cmd->nodes[idx];
+
+			if (item.len < 0) return NIL;
+
+			switch (item.type) {
+				case '$': return STRING;
+				case '!': return ERRMSG;
+			}
+
+			return (Type)(item.type);
+		}
+
+		// 聚合类型返回子元素个数（MAP为键和值的总个数），其他类型返回文本长度
+		int size() const {
+			return cmd == NULL || cmd->nodes[idx].len < 0 ? 0 : cmd->nodes[idx].len;
+		}
+
+		// 节点的文本内容，空值和聚合类型返回空字符串
+		const char* data() const {
+			if (cmd == NULL || isAggregate() || size() == 0) return "";
+
+			return cmd->data.data() + cmd->nodes[idx].offset;
+		}
+
+#if __cplusplus >= 201703L
+		// 以 string_view 的形式访问节点文本，不复制数据。C++11 下由 data() 和 size() 提供同样的指针和长度
+		std::string_view view() const {
+			return std::string_view(data(), size());
+		}
+#endif
+
+		// 获取聚合类型的第 idx 个子元素，越界时返回空值节点
+		Reply operator[](int idx) const {
+			if (idx < 0 || idx >= size() || !isAggregate()) return Reply();
+
+			const vector<Command::Node>& nodes = cmd->nodes;
+
+			// 子元素都是标量时按下标直接定位，否则沿兄弟节点依次查找
+			if (nodes[this->idx].next - this->idx - 1 == nodes[this->idx].len) return Reply(cmd, this->idx + 1 + idx);
+
+			int pos = this->idx + 1;
+
+			while (idx-- > 0) pos = nodes[pos].next;
+
+			return Reply(cmd, pos);
+		}
+
+		bool isNil() const {
+			return getType() == NIL;
+		}
+
+		bool isError() const {
+			return getType() == ERRMSG;
+		}
+
+		bool isAggregate() const {
+			Type type = getType();
+
+			return type == ARRAY || type == MAP || type == SET || type == PUSH;
+		}
+
+		string toString() const {
+			return isAggregate() ? string() : string(data(), size());
+		}
+
+		long long getInteger() const {
+			return getType() == BOOLEAN ? *data() == 't' : atoll(data());
+		}
+
+		double getDouble() const {
+			return strtod(data(), NULL);
+		}
+	};
+
+    // 封装redis命令
+    class Command {
+		friend RedisConnect;
+		friend class Reply;
+		friend class Decoder;
+		friend class Pipeline;
+		friend class ::AsyncRedisConnect;
+
+	protected:
+		// 应答树的节点，子节点紧跟在父节点之后按先序排列
+		struct Node {
+			char type; // 类型前缀
+			int len; // 文本长度或子元素个数，空值为-1
+			int next; // 下一个兄弟节点的下标
+			int offset; // 文本相对于应答起始处的位置
+		};
+
+		int base; // 应答在接收缓冲区中的起始位置
+		int code; // 命令的执行结果
+		int status; //  Redis 命令执行的状态码
+		int leaves; // 应答树中标量节点的个数
+		string msg; // Redis 命令执行的输出信息
+		Buffer data; // 应答的原始数据，节点文本直接指向其中，重复执行时复用
+		const char* src; // 正在解析的接收缓冲区
+		Decoder decoder; // 应答解析器，数据分多次到达时保留解析进度
+		vector<int> path; // 构建应答树时尚未结束的聚合节点
+		vector<Node> nodes; // 应答树的节点存储区，重复执行时复用
+		vector<string> vec; // Redis 命令的参数，以字符串数组的形式保存
+		mutable bool flat; // res 是否已经由应答树生成
+		mutable vector<string> res; // Redis 命令执行的结果，以字符串数组的形式保存
+	
+	protected:
+		// 解析 Redis 命令的返回结果。msg 为接收缓冲区中的全部数据，应答从 base 处开始，
+		// 每次调用从上次停止的位置继续解析，应答不完整时返回 TIMEOUT。
+		// 应答完整后将其复制到命令对象中，之后接收缓冲区可以被复用。
+		int parse(const char* msg, int len) {
+			int val = decode(msg, len);
+
+			if (val != OK) return val;
+
+			data.assign(msg + base, decoder.getOffset() - base);
+			base = 0;
+
+			return getParseResult();
+		}
+
+		// 解析接收缓冲区中的应答。应答独占整个缓冲区时直接交换存储区，
+		// 节点文本即为接收到的原始数据，整个过程不复制任何元素。
+		int parse(Buffer& buf) {
+			int val = decode(buf.data(), buf.size());
+
+			if (val != OK) return val;
+
+			if (base == 0 && decoder.getOffset() == buf.size()) {
+				data.swap(buf);
+				buf.clear();
+			}
+			else {
+				data.assign(buf.data() + base, decoder.getOffset() - base);
+				base = 0;
+			}
+
+			return getParseResult();
+		}
+
+		int decode(const char* msg, int len) {
+			src = msg;
+
+			return decoder.decode(msg, len, *this);
+		}
+
+		// 接收缓冲区头部的 len 个字节被移走后同步调整解析位置
+		void shift(int len) {
+			base -= len;
+			decoder.shift(len);
+		}
+
+		// 根据应答树的根节点计算返回值
+		int getParseResult() {
+			const Node& root = nodes[0];
+			const char* str = this->data.data() + root.offset;
+
+			// 空数组沿用旧的返回值，其他空值表示元素不存在
+			if (root.len < 0) return root.type == '*' ? 0 : NOTFOUND;
+
+			switch (root.type) {
+				// 状态码、错误信息和整数值类型的返回结果
+				case '+':
+				case '-':
+				case '!':
+				case ':':
+					this->status = root.type == ':' ? atoi(str) : OK;
+					this->msg = string(str, root.len);
+
+					return root.type == '-' || root.type == '!' ? FAIL : OK;
+				case ',':
+				case '(':
+					this->msg = string(str, root.len);
+
+					return OK;
+				case '#':
+					this->status = *str == 't' ? 1 : 0;
+					this->msg = string(str, root.len);
+
+					return OK;
+				case '$':
+				case '=':
+					return OK;
+			}
+
+			// 聚合类型的返回结果以全部标量元素的个数作为返回值
+			return leaves;
+		}
+
+		// 标量元素追加为叶子节点，节点只记录文本相对于应答起始处的位置
+		void onValue(char type, const char* str, int len) {
+			Node item = {type, len, (int)nodes.size() + 1, len > 0 ? (int)(str - src) - base : 0};
+
+			nodes.push_back(item);
+			++leaves;
+		}
+
+		void onBegin(char type, int cnt) {
+			Node item = {type, cnt, 0, 0};
+
+			path.push_back(nodes.size());
+			nodes.push_back(item);
+		}
+
+		void onEnd() {
+			nodes[path.back()].next = nodes.size();
+			path.pop_back();
+		}
+
+		// 将应答树中的标量元素按顺序展开到 res 数组中，空值以空字符串占位。
+		// 单个字符串的返回结果展开为一个元素，其他标量类型的结果保存在 msg 中。
+		vector<string>& flatten() const {
+			if (flat) return res;
+
+			flat = true;
+			res.clear();
+
+			if (nodes.empty()) return res;
+
+			const Node& root = nodes[0];
+
+			if (root.type == '$' || root.type == '=') {
+				if (root.len >= 0) res.push_back(string(data.data() + root.offset, root.len));
+
+				return res;
+			}
+
+			if (root.next == 1) return res;
+
+			res.reserve(leaves);
+
+			for (const Node& item : nodes) {
+				if (IsAggregate(item)) continue;
+
+				res.push_back(item.len > 0 ? string(data.data() + item.offset, item.len) : string());
+			}
+
+			return res;
+		}
+
+		static bool IsAggregate(const Node& item) {
+			if (item.len < 0) return false;
+
+			return item.type == '*' || item.type == '%' || item.type == '~' || item.type == '>';
+		}
+
+		// 清空上一次执行留下的结果
+		void reset(int offset = 0) {
+			base = offset;
+			code = 0;
+			status = 0;
+			leaves = 0;
+			flat = false;
+			msg.clear();
+			res.clear();
+			data.clear();
+			path.clear();
+			nodes.clear();
+			decoder.reset(offset);
+		}
+
+		// 记录执行结果，并为没有错误信息的错误码补充说明
+		int complete(int code) {
+			this->code = code;
+
+			if (code < 0 && msg.empty())
+			{
+				switch (code)
+				{
+				case SYSERR:
+					msg = "system error";
+					break;
+				case NETERR:
+					msg = "network error";
+					break;
+				case DATAERR:
+					msg = "protocol error";
+					break;
+				case TIMEOUT:
+					msg = "response timeout";
+					break;
+				case NOTFOUND:
+					msg = "element not found";
+					break;
+				default:
+					msg = "unknown error";
+					break;
+				}
+			}
+
+			return code;
+		}
+
+	public:
+		Command() {
+			reset();
+		}
+
+		Command(const string& cmd) {
+			vec.push_back(cmd);
+			reset();
+		}
+
+		void add(char* val) {
+			vec.push_back(val);
+		}
+
+		void add(const char* val) {
+			vec.push_back(val);
+		}
+
+		void add(const string& val) {
+			vec.push_back(val);
+		}
+
+		// 整数参数直接格式化到栈上，其他类型仍使用 to_string 转换
+		template<class DATA_TYPE> 
+		void add(DATA_TYPE val) {
+			addValue(val, std::is_integral<DATA_TYPE>());
+		}
+
+		template<class DATA_TYPE, class ...ARGS> 
+		void add(DATA_TYPE val, ARGS ...args) {
+			add(val);
+			add(args...);
+		}
+
+	protected:
+		template<class DATA_TYPE>
+		void addValue(DATA_TYPE val, std::true_type) {
+			char buf[24];
+
+			if (std::is_signed<DATA_TYPE>::value) {
+				vec.push_back(string(buf, IntToString((long long)(val), buf)));
+			}
+			else {
+				vec.push_back(string(buf, IntToString((unsigned long long)(val), buf)));
+			}
+		}
+
+		template<class DATA_TYPE>
+		void addValue(DATA_TYPE val, std::false_type) {
+			add(to_string(val));
+		}
+
+	public:
+		// 将整数格式化为十进制文本写入 dest，返回文本长度，dest 至少需要 21 个字节
+		static int IntToString(unsigned long long val, char* dest) {
+			char tmp[24];
+			char* end = tmp + sizeof(tmp);
+			char* str = end;
+
+			do {
+				*--str = '0' + val % 10;
+			} while (val /= 10);
+
+			memcpy(dest, str, end - str);
+
+			return end - str;
+		}
+
+		static int IntToString(long long val, char* dest) {
+			if (val >= 0) return IntToString((unsigned long long)(val), dest);
+
+			*dest = '-';
+
+			return IntToString(0ULL - (unsigned long long)(val), dest + 1) + 1;
+		}
+
+		string toString() const {
+			Writer writer;
+
+			writer.add(*this);
+
+			return writer.toString();
+		}
+
+		string get(int idx) const {
+			return flatten().at(idx);
+		}
+
+		const vector<string>& getDataList() const {
+			return flatten();
+		}
+
+		// 命令的参数列表，第一个元素为命令名称
+		const vector<string>& getArgList() const {
+			return vec;
+		}
+
+		// 获取应答树的根节点，尚未收到应答时返回空值节点
+		Reply getReply() const {
+			return nodes.empty() ? Reply() : Reply(this, 0);
+		}
+
+		int getCode() const {
+			return code;
+		}
+
+		int getStatus() const {
+			return status;
+		}
+
+		string getErrorString() const {
+			return msg;
+		}
+
+		// 命令没有发送时（例如没有可用的连接）记录失败原因，返回 code
+		int fail(int code) {
+			reset();
+
+			return complete(code);
+		}
+
+	protected:
+		// 将命令序列化后发送到 Redis 服务器
+		int write(RedisConnect* redis) {
+			Writer& writer = redis->writer;
+
+			writer.clear();
+			writer.add(*this);
+
+			return writer.send(redis->sock) < 0 ? NETERR : OK;
+		}
+
+		// 读取并解析一条应答。接收缓冲区中已有的数据优先解析，
+		// 应答之后多余的数据保留在缓冲区中，供下一次读取使用。
+		// probe 不为空时记录接收的字节数和首批数据到达的时间。
+		int read(RedisConnect* redis, int timeout, RedisMetrics::Probe* probe = NULL) {
+			// 定义一些变量，用于读取 Redis 服务器的响应消息
+			int len = 0;
+			int delay = 0;
+			Socket& sock = redis->sock;
+			Buffer& buf = redis->buffer;
+
+			auto consume = [&]() {
+				int val = parse(buf);
+
+				// 应答独占缓冲区时存储区已交换，否则删除已解析的部分
+				if (val != TIMEOUT && buf.size() > 0) buf.erase(decoder.getOffset());
+
+				return val;
+			};
+
+			if (buf.size() > 0 && (len = consume()) != TIMEOUT) return len;
+
+			// 进入一个循环，不停地读取 Redis 服务器的响应消息
+			while (true) {
+				// 缓冲区按需扩容，应答大小不再受限制
+				char* dest = buf.reserve(Buffer::MIN_SIZE);
+
+				if (dest == NULL) return SYSERR;
+
+				// 从 Socket 对象中读取响应消息
+				if ((len = sock.read(dest, buf.space(), false)) < 0) return len;
+
+				// 如果读取到的数据长度为 0，则说明 Redis 服务器暂时没有响应消息，需要等待一段时间 
+				if (len == 0) {
+					delay += SOCKET_TIMEOUT;
+
+					if (delay > timeout) return TIMEOUT;
+
+					continue;
+				}
+
+				delay = 0;
+				buf.commit(len);
+
+				if (probe) probe->receive(len);
+
+				// 应答不完整时继续等待，下次从上次停止的位置接着解析
+				if ((len = consume()) != TIMEOUT) return len;
+			}
+		}
+
+		// 记录执行结果到连接对象中
+		int finish(RedisConnect* redis, int code) {
+			redis->code = complete(code);
+			redis->status = status;
+			redis->msg = msg;
+
+			return redis->code;
+		}
+
+	public:
+		// 通过连接 Redis 服务器并向服务器发送 Redis 命令，
+		// 然后等待 Redis 服务器返回执行结果，并将结果解析成相应的数据结构。
+		int getResult(RedisConnect* redis, int timeout) {
+			if (RedisMetrics::IsEnabled()) return trace(redis, timeout);
+
+			int res = write(redis);
+
+			reset();
+
+			if (res == OK) {
+				redis->buffer.clear();
+				res = read(redis, timeout);
+			}
+
+			res = finish(redis, res);
+			redis->recycle();
+
+			return res;
+		}
+
+		// 开启统计时的 getResult，分别记录发送、首字节和完整应答的耗时
+		int trace(RedisConnect* redis, int timeout) {
+			RedisMetrics* metrics = RedisMetrics::Instance();
+			RedisMetrics::Command* stat = metrics->get(vec.empty() ? string() : vec[0]);
+			RedisMetrics::Probe probe;
+			int res = write(redis);
+			chrono::steady_clock::time_point mark = chrono::steady_clock::now();
+
+			stat->write.record(chrono::duration_cast<chrono::microseconds>(mark - probe.start).count());
+			metrics->send(redis->writer.length());
+
+			reset();
+
+			if (res == OK) {
+				redis->buffer.clear();
+				res = read(redis, timeout, &probe);
+				mark = chrono::steady_clock::now();
+
+				// 应答在发送之前已经到达缓冲区时以解析完成的时间作为首字节时间
+				stat->ttfb.record(chrono::duration_cast<chrono::microseconds>((probe.bytes > 0 ? probe.first : mark) - probe.start).count());
+				stat->reply.record(chrono::duration_cast<chrono::microseconds>(mark - probe.start).count());
+				metrics->receive(probe.bytes);
+			}
+
+			res = finish(redis, res);
+			redis->recycle();
+
+			stat->calls.fetch_add(1, memory_order_relaxed);
+
+			if (res < 0 && metrics->error(res)) stat->errors.fetch_add(1, memory_order_relaxed);
+
+			return res;
+		}
+
+		// 只接收一条应答或服务端推送的消息，不发送命令，超时后未解析完的数据保留在接收缓冲区中。
+		// 用于 RESP3 推送消息、发布订阅等由服务端主动发送数据的场景
+		int receive(RedisConnect* redis, int timeout) {
+			reset();
+
+			int res = finish(redis, read(redis, timeout));
+
+			redis->utime = time(NULL);
+
+			return res;
+		}
+
+		// 只发送命令，不等待应答
+		int send(RedisConnect* redis) {
+			reset();
+
+			return finish(redis, write(redis));
+		}
+    };
+
+	// 请求序列化器。RESP头部和较小的参数写入可复用的缓冲区，较大的参数直接引用
+	// Command 中的字符串，通过 writev 与头部一起发出，整个过程不再复制大参数。
+	class Writer {
+	protected:
+		// 待发送的数据片段，data 为 NULL 时表示位于 head 缓冲区的 offset 处
+		struct Segment {
+			const char* data;
+			int offset;
+			int len;
+		};
+
+		Buffer head; // RESP头部和小参数
+		vector<Segment> segs; // 按发送顺序排列的数据片段
+#ifdef XG_LINUX
+		vector<struct iovec> iov; // 发送时使用的数据块列表，重复使用避免内存分配
+#endif
+
+		// 复制数据到 head 缓冲区，与前一个缓冲区片段相邻时直接合并
+		bool copy(const char* data, int len) {
+			char* dest = head.reserve(len);
+
+			if (dest == NULL) return false;
+
+			memcpy(dest, data, len);
+
+			if (segs.size() > 0 && segs.back().data == NULL) {
+				segs.back().len += len;
+			}
+			else {
+				Segment item = {NULL, head.size(), len};
+
+				segs.push_back(item);
+			}
+
+			head.commit(len);
+
+			return true;
+		}
+
+		// 写入 RESP 头部，如 *3\r\n 或 $5\r\n
+		bool header(char type, size_t len) {
+			char buf[32];
+			int sz = Command::IntToString((unsigned long long)(len), buf + 1) + 1;
+
+			buf[0] = type;
+			buf[sz++] = '\r';
+			buf[sz++] = '\n';
+
+			return copy(buf, sz);
+		}
+
+	public:
+		static const int COPY_LIMIT = 4 * 1024; // 超过该长度的参数不复制
+
+		Writer() {}
+
+		// 复制的序列化器只保留头部数据，数据块列表在发送时重新生成
+		Writer(const Writer& obj) : head(obj.head), segs(obj.segs) {}
+
+		Writer& operator=(const Writer& obj) {
+			head = obj.head;
+			segs = obj.segs;
+
+			return *this;
+		}
+
+		void clear() {
+			head.clear();
+			segs.clear();
+		}
+
+		// 释放缓冲区，用于回收偶发的超大请求占用的内存
+		void release() {
+			clear();
+			head.release();
+			vector<Segment>().swap(segs);
+#ifdef XG_LINUX
+			vector<struct iovec>().swap(iov);
+#endif
+		}
+
+		int capacity() const {
+			return head.capacity();
+		}
+
+		// 待发送的总字节数
+		long long length() const {
+			long long len = 0;
+
+			for (const Segment& item : segs) len += item.len;
+
+			return len;
+		}
+
+		// 序列化一条命令，大参数只记录地址，发送前命令对象必须保持有效
+		bool add(const Command& cmd) {
+			if (!header('*', cmd.vec.size())) return false;
+
+			for (const string& item : cmd.vec) {
+				if (!header('$', item.length())) return false;
+
+#ifdef XG_LINUX
+				if (item.length() >= COPY_LIMIT) {
+					Segment seg = {item.c_str(), 0, (int)(item.length())};
+
+					segs.push_back(seg);
+				}
+				else
+#endif
+				{
+					if (!copy(item.c_str(), item.length())) return false;
+				}
+
+				if (!copy("\r\n", 2)) return false;
+			}
+
+			return true;
+		}
+
+		// 将全部片段一次写入套接字，返回写入的字节数或错误码
+		int send(Socket& sock) {
+			if (segs.size() == 1) return sock.write(head.data() + segs[0].offset, segs[0].len);
+
+#ifdef XG_LINUX
+			iov.resize(segs.size());
+
+			for (size_t i = 0; i < segs.size(); i++) {
+				const Segment& item = segs[i];
+
+				iov[i].iov_base = (void*)(item.data ? item.data : head.data() + item.offset);
+				iov[i].iov_len = item.len;
+			}
+
+			return sock.write(iov.data(), iov.size());
+#else
+			return sock.write(head.data(), head.size());
+#endif
+		}
+
+		// 将全部片段按顺序追加到 out 中，用于非阻塞发送时保存尚未发出的数据
+		bool dump(Buffer& out) const {
+			for (const Segment& item : segs) {
+				if (!out.append(item.data ? item.data : head.data() + item.offset, item.len)) return false;
+			}
+
+			return true;
+		}
+
+		string toString() const {
+			string res;
+
+			for (const Segment& item : segs) {
+				res.append(item.data ? item.data : head.data() + item.offset, item.len);
+			}
+
+			return res;
+		}
+	};
+
+	// 命令管道：一次性发送多条命令，再按顺序从数据流中解析出各自的应答，
+	// 批量操作时只需要一次网络往返。
+	class Pipeline {
+		friend RedisConnect;
+
+	protected:
+		deque<Command> cmds; // 由管道创建的命令
+		vector<Command*> vec; // 按发送顺序排列的命令
+
+	public:
+		// 创建一条新命令并加入管道
+		template<class DATA_TYPE, class ...ARGS>
+		Command& add(DATA_TYPE val, ARGS ...args) {
+			cmds.push_back(Command());
+
+			Command& cmd = cmds.back();
+
+			cmd.add(val, args...);
+			vec.push_back(&cmd);
+
+			return cmd;
+		}
+
+		// 将外部命令加入管道，执行结果直接写回该命令
+		Command& append(Command& cmd) {
+			vec.push_back(&cmd);
+
+			return cmd;
+		}
+
+		void clear() {
+			vec.clear();
+			cmds.clear();
+		}
+
+		int size() const {
+			return vec.size();
+		}
+
+		Command& get(int idx) {
+			return *vec.at(idx);
+		}
+
+		// 发送全部命令并解析应答，每条命令的结果保存在各自的 Command 对象中。
+		// 返回 OK 表示所有应答均已收到，否则返回网络或协议错误码。
+		int getResult(RedisConnect* redis, int timeout) {
+			int idx = 0;
+			const int cnt = vec.size();
+			RedisMetrics::Probe probe;
+			RedisMetrics::Command* stat = RedisMetrics::IsEnabled() ? RedisMetrics::Instance()->get("pipeline") : NULL;
+			chrono::steady_clock::time_point mark;
+
+			auto doWork = [&]() {
+				Socket& sock = redis->sock;
+				Writer& writer = redis->writer;
+
+				writer.clear();
+
+				for (Command* cmd : vec) writer.add(*cmd);
+
+				// 所有命令合并为一次写入
+				if (writer.send(sock) < 0) return NETERR;
+
+				if (stat) {
+					mark = chrono::steady_clock::now();
+					stat->write.record(chrono::duration_cast<chrono::microseconds>(mark - probe.start).count());
+					RedisMetrics::Instance()->send(writer.length());
+				}
+
+				int len = 0;
+				int delay = 0;
+				Buffer& buf = redis->buffer;
+
+				buf.clear();
+
+				while (idx < cnt) {
+					Command* cmd = vec[idx];
+
+					// 已解析完的应答占据缓冲区一半以上时将其移走，避免缓冲区无限增长
+					if (cmd->base > 0 && cmd->base >= buf.size() / 2) {
+						buf.erase(cmd->base);
+						cmd->shift(cmd->base);
+					}
+
+					char* dest = buf.reserve(Buffer::MIN_SIZE);
+
+					if (dest == NULL) return SYSERR;
+
+					if ((len = sock.read(dest, buf.space(), false)) < 0) return len;
+
+					if (len == 0) {
+						delay += SOCKET_TIMEOUT;
+
+						if (delay > timeout) return TIMEOUT;
+
+						continue;
+					}
+
+					delay = 0;
+					buf.commit(len);
+
+					if (stat) probe.receive(len);
+
+					// 依次解析已经到达的应答，后一条应答从前一条结束的位置开始，
+					// 缓冲区的存储区已经交换给前一条命令时则从头开始
+					while (idx < cnt) {
+						cmd = vec[idx];
+
+						if ((len = cmd->parse(buf)) == TIMEOUT) break;
+
+						cmd->complete(len);
+
+						if (len == DATAERR) return DATAERR;
+
+						if (++idx < cnt) vec[idx]->reset(buf.size() > 0 ? cmd->decoder.getOffset() : 0);
+					}
+				}
+
+				return OK;
+			};
+
+			for (Command* cmd : vec) cmd->reset();
+
+			redis->code = doWork();
+			redis->recycle();
+			redis->status = 0;
+			redis->msg.clear();
+
+			// 未收到应答的命令统一记录失败原因
+			if (redis->code < 0) {
+				while (idx < cnt) vec[idx++]->complete(redis->code);
+
+				redis->msg = vec.back()->msg;
+			}
+
+			// 管道整体按 pipeline 统计耗时，各条命令的错误分别计数
+			if (stat) {
+				RedisMetrics* metrics = RedisMetrics::Instance();
+
+				mark = chrono::steady_clock::now();
+
+				if (probe.bytes > 0) {
+					stat->ttfb.record(chrono::duration_cast<chrono::microseconds>(probe.first - probe.start).count());
+					stat->reply.record(chrono::duration_cast<chrono::microseconds>(mark - probe.start).count());
+					metrics->receive(probe.bytes);
+				}
+
+				stat->calls.fetch_add(1, memory_order_relaxed);
+
+				if (redis->code < 0) stat->errors.fetch_add(1, memory_order_relaxed);
+
+				for (Command* cmd : vec) {
+					if (cmd->code < 0) metrics->error(cmd->code);
+				}
+			}
+
+			return redis->code;
+		}
+	};
+
+protected:
+    int db = 0; // 当前选择的数据库编号。
+    int code = 0; // 表示Redis服务器返回的错误代码。
+    int port = 0; // Redis服务器的端口号。
+    int memsz = 0; // 接收缓冲区常驻容量的上限，超过时命令执行完毕即释放。
+    int status = 0; // 表示Redis命令的执行状态。
+    int timeout = 0; // Redis命令的超时时间（以毫秒为单位）。
+    Buffer buffer; // 用于存储从Redis服务器接收的数据的缓冲区，按需扩容。
+    Writer writer; // 请求序列化器，头部缓冲区在多次请求之间复用。
+    time_t utime = 0; // 最近一次执行命令的时间。
+
+    string msg; // Redis服务器返回的错误消息。
+    string host; // Redis服务器的主机名或IP地址。
+    Socket sock; // 用于与Redis服务器建立TCP连接的Socket对象。
+    string passwd; // Redis服务器的密码（如果有）。
+
+public:
+    ~RedisConnect() {
+        close();
+    }
+
+public:
+    int getStatus() const {
+        return status;
+    }
+
+    int getDatabase() const {
+        return db;
+    }
+
+    int getErrorCode() const {
+        if(sock.isClosed())
+            return FAIL;
+        return code < 0? code : 0;
+    }
+
+    string getErrorString() const {
+        return msg;
+    }
+
+	// 连接是否已不可用：已关闭，或上一条命令因网络、超时或协议错误而中断，
+	// 此时接收缓冲区中可能残留未读完的应答。错误应答和空值不影响连接继续使用
+	bool isBroken() const {
+		return sock.isClosed() || (code < 0 && code != FAIL && code != NOTFOUND);
+	}
+
+public:
+	// 用于关闭与Redis服务器的连接，并释放任何内存分配。
+    void close() {
+        buffer.release();
+        sock.close();
+    }
+
+	// 空闲超过指定秒数时释放接收缓冲区，连接池在取出连接时调用
+	void trim(int idle = 30) {
+		if (utime + idle < time(NULL)) buffer.release();
+	}
+
+	// 用于重新连接到Redis服务器。
+    bool reconnect() {
+        if(host.empty())
+            return false;
+        return connect(host, port, timeout, memsz) && auth(passwd) > 0 && (db == 0 || select(db) > 0);
+    }
+
+
+	// 该函数的作用是执行Redis命令，并返回命令的结果
+    int execute(Command& cmd) {
+        return cmd.getResult(this, timeout);
+    }
+
+	// 只发送命令不等待应答，应答或推送消息通过 receive 读取
+	int send(Command& cmd) {
+		return cmd.send(this);
+	}
+
+	// 接收一条应答或服务端推送的消息，timeout 小于等于0时使用连接的超时时间
+	int receive(Command& cmd, int timeout = 0) {
+		return cmd.receive(this, timeout > 0 ? timeout : this->timeout);
+	}
+
+	// 以管道方式批量执行命令，每条命令的结果保存在管道内各自的 Command 对象中
+	int execute(Pipeline& pipe) {
+		if (pipe.size() == 0) return OK;
+
+		return pipe.getResult(this, timeout);
+	}
+
+	// 该函数的作用是执行Redis命令，并返回命令的结果。
+	// 它使用可变参数模板来接受任意数量和类型的参数，使其更加灵活和通用。
+    template<class DATA_TYPE, class ...ARGS>
+	int execute(DATA_TYPE val, ARGS ...args) {
+		Command cmd;
+
+		cmd.add(val, args...);
+
+		return cmd.getResult(this, timeout);
+	}
+
+	// 用于执行Redis命令并将结果存储在一个字符串向量中，并返回Redis服务器返回的错误代码。
+    template<class DATA_TYPE, class ...ARGS>
+	int execute(vector<string>& vec, DATA_TYPE val, ARGS ...args) {
+		Command cmd;
+
+		cmd.add(val, args...);
+
+		cmd.getResult(this, timeout);
+
+		if (code > 0) std::swap(vec, cmd.flatten());
+
+		return code;
+	}
+
+
+	// 该函数首先调用close()函数关闭先前的连接（如果有的话）。
+	// 在建立新连接之前，先调用close()函数是一个良好的编程实践，可以确保代码的健壮性和可靠性。
+	// 然后，它使用Socket类的connect()函数尝试建立到Redis服务器的新连接。
+    bool connect(const string& host, int port, int timeout = 3000, int memsz = 2 * 1024 * 1024) {
+		close();
+
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		bool res = sock.connect(host, port, timeout);
+
+		if (RedisMetrics::IsEnabled()) {
+			RedisMetrics* metrics = RedisMetrics::Instance();
+
+			metrics->recordConnect(chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count());
+
+			if (!res) metrics->error(NETERR);
+		}
+
+		if (res)
+		{
+			sock.setSendTimeout(SOCKET_TIMEOUT);
+			sock.setRecvTimeout(SOCKET_TIMEOUT);
+
+			this->host = host;
+			this->port = port;
+			this->memsz = memsz;
+			this->timeout = timeout;
+
+			return true;
+		}
+
+		return false;
+	}
+
+protected:
+	// 命令执行完毕后记录时间，接收缓冲区超过常驻容量上限时立即释放
+	void recycle() {
+		utime = time(NULL);
+
+		if (buffer.capacity() > memsz) buffer.release();
+
+		if (writer.capacity() > memsz) writer.release();
+	}
+
+public:
+    int ping() {
+		return execute("ping");
+	}
+
+	int del(const string& key) {
+		return execute("del", key);
+	}
+	
+	int ttl(const string& key) {
+		return execute("ttl", key) == OK ? status : code;
+	}
+	
+	// 用于获取指定哈希表中的字段数量。
+	int hlen(const string& key) {
+		return execute("hlen", key) == OK ? status : code;
+	}
+
+    int auth(const string& passwd) {
+		this->passwd = passwd;
+
+		if (passwd.empty()) return OK;
+
+		return execute("auth", passwd);
+	}
+
+	// 切换当前连接使用的数据库，重新连接后自动恢复
+	int select(int db) {
+		if (execute("select", db) > 0) this->db = db;
+
+		return code;
+	}
+
+	// 用于获取指定键名对应的字符串值
+	int get(const string& key, string& val) {
+		Command cmd("get");
+
+		cmd.add(key);
+
+		if (cmd.getResult(this, timeout) <= 0) return code;
+
+		Reply reply = cmd.getReply();
+
+		val.assign(reply.data(), reply.size());
+
+		return code;
+	}
+	
+	// 批量获取多个键的值，vals 与 keys 一一对应，不存在的键对应空字符串，成功时返回键的个数
+	int mget(const vector<string>& keys, vector<string>& vals) {
+		vals.clear();
+
+		if (keys.empty()) return 0;
+
+		Command cmd("mget");
+
+		for (const string& key : keys) cmd.add(key);
+
+		if (cmd.getResult(this, timeout) > 0) std::swap(vals, cmd.flatten());
+
+		return code;
+	}
+
+	// 批量设置多个键的值
+	int mset(const map<string, string>& kvs) {
+		if (kvs.empty()) return 0;
+
+		Command cmd("mset");
+
+		for (auto& item : kvs) cmd.add(item.first, item.second);
+
+		return cmd.getResult(this, timeout);
+	}
 
-		return code;
+	// 批量删除多个键，成功时返回实际删除的键的个数
+	int del(const vector<string>& keys) {
+		if (keys.empty()) return 0;
+
+		Command cmd("del");
+
+		for (const string& key : keys) cmd.add(key);
+
+		return cmd.getResult(this, timeout) == OK ? status : code;
 	}
-	
+
 	// 用于减少指定键名对应的数字值。
 	int decr(const string& key, int val = 1) {
 		return execute("decrby", key, val);
@@ -710,11 +1889,172 @@ public:
 		return execute("expire", key, timeout);
 	}
 
-	// 用于获取所有匹配指定模式的键名。
+	// 用于获取所有匹配指定模式的键名。使用 SCAN 分批获取并去除重复的键，
+	// 不会像 KEYS 那样长时间阻塞服务器，成功时返回键的个数。
 	int keys(vector<string>& vec, const string& key) {
-		return execute(vec, "keys", key);
+		unordered_set<string> found;
+
+		vec.clear();
+
+		int res = scan(key, [&](vector<string>& batch) {
+			for (string& item : batch) {
+				if (found.insert(item).second) vec.push_back(std::move(item));
+			}
+
+			return true;
+		});
+
+		return res > 0 ? (int)(vec.size()) : res;
+	}
+
+	// 按游标分批遍历匹配的键。cursor 首次为0，每次调用后更新为下一批的游标，
+	// 重新变为0时遍历结束。每批元素个数由服务器决定，count 只是建议值，
+	// 遍历期间被修改的键可能重复出现或者缺失。成功时返回值大于0。
+	int scan(unsigned long long& cursor, vector<string>& vec, const string& pattern = "*", int count = SCAN_COUNT) {
+		return scan("scan", NULL, cursor, vec, pattern, count);
+	}
+
+	// 按游标分批遍历哈希表，vec 中依次为字段和值
+	int hscan(const string& key, unsigned long long& cursor, vector<string>& vec, const string& pattern = "*", int count = SCAN_COUNT) {
+		return scan("hscan", &key, cursor, vec, pattern, count);
+	}
+
+	// 按游标分批遍历集合
+	int sscan(const string& key, unsigned long long& cursor, vector<string>& vec, const string& pattern = "*", int count = SCAN_COUNT) {
+		return scan("sscan", &key, cursor, vec, pattern, count);
+	}
+
+	// 按游标分批遍历有序集合，vec 中依次为元素和分数
+	int zscan(const string& key, unsigned long long& cursor, vector<string>& vec, const string& pattern = "*", int count = SCAN_COUNT) {
+		return scan("zscan", &key, cursor, vec, pattern, count);
+	}
+
+	// 遍历全部匹配的键，每取得一批调用一次 func，func 返回 false 时提前结束。
+	// 同一时刻只保存一批数据，内存占用与键的总数无关。成功时返回OK。
+	int scan(const string& pattern, function<bool(vector<string>&)> func, int count = SCAN_COUNT) {
+		return scan("scan", NULL, pattern, func, count);
+	}
+
+	int hscan(const string& key, const string& pattern, function<bool(vector<string>&)> func, int count = SCAN_COUNT) {
+		return scan("hscan", &key, pattern, func, count);
+	}
+
+	int sscan(const string& key, const string& pattern, function<bool(vector<string>&)> func, int count = SCAN_COUNT) {
+		return scan("sscan", &key, pattern, func, count);
+	}
+
+	int zscan(const string& key, const string& pattern, function<bool(vector<string>&)> func, int count = SCAN_COUNT) {
+		return scan("zscan", &key, pattern, func, count);
+	}
+
+	// 使用 SCAN 分批遍历匹配的键，每批键拆分为多条 UNLINK 命令通过管道一次发送，
+	// 服务器不支持 UNLINK（4.0以下版本）时改用 DEL。scanned 返回遍历到的键的个数，
+	// deleted 返回实际删除的个数，遍历之后被其它客户端删除或已过期的键不计入。
+	// 每删除一批调用一次 func。成功时返回OK，失败时返回第一条失败命令的错误码
+	int dels(const string& pattern, long long& scanned, long long& deleted, function<void(long long, long long)> func = NULL) {
+		int res = OK;
+		const size_t step = 100;
+		const char* name = "unlink";
+
+		scanned = deleted = 0;
+
+		// 通过管道发送一批删除命令，服务器不支持 UNLINK 时返回 NOTFOUND
+		auto remove = [&](const vector<string>& vec) {
+			Pipeline pipe;
+
+			for (size_t pos = 0; pos < vec.size(); ) {
+				Command& cmd = pipe.add(name);
+
+				for (size_t end = std::min(pos + step, vec.size()); pos < end; pos++) cmd.add(vec[pos]);
+			}
+
+			if (execute(pipe) < 0) return code;
+
+			for (int i = 0; i < pipe.size(); i++) {
+				Command& cmd = pipe.get(i);
+
+				if (cmd.getCode() == OK) {
+					deleted += cmd.getStatus();
+
+					continue;
+				}
+
+				if (strcmp(name, "unlink") == 0 && cmd.getErrorString().find("unknown command") != string::npos) return NOTFOUND;
+
+				msg = cmd.getErrorString();
+
+				return code = cmd.getCode() < 0 ? cmd.getCode() : FAIL;
+			}
+
+			return OK;
+		};
+
+		int val = scan(pattern, [&](vector<string>& vec) {
+			if (vec.empty()) return true;
+
+			scanned += vec.size();
+
+			if ((res = remove(vec)) == NOTFOUND) {
+				name = "del";
+				res = remove(vec);
+			}
+
+			if (res < 0) return false;
+
+			if (func) func(scanned, deleted);
+
+			return true;
+		});
+
+		if (res < 0) return code = res;
+
+		return val < 0 ? val : OK;
+	}
+
+protected:
+	// 执行一次 SCAN 类命令，key 为 NULL 时遍历整个数据库。
+	// 应答为游标和元素数组，展开后第一个元素即为游标。
+	int scan(const char* name, const string* key, unsigned long long& cursor, vector<string>& vec, const string& pattern, int count) {
+		Command cmd(name);
+
+		vec.clear();
+
+		if (key) cmd.add(*key);
+
+		cmd.add(to_string(cursor));
+
+		if (pattern.length() > 0 && pattern != "*") cmd.add("match", pattern);
+
+		if (count > 0) cmd.add("count", count);
+
+		if (cmd.getResult(this, timeout) <= 0) return code;
+
+		vector<string>& res = cmd.flatten();
+
+		if (res.empty() || cmd.getReply().getType() != Reply::ARRAY) return code = DATAERR;
+
+		cursor = strtoull(res[0].c_str(), NULL, 10);
+
+		vec.assign(make_move_iterator(res.begin() + 1), make_move_iterator(res.end()));
+
+		return code;
+	}
+
+	int scan(const char* name, const string* key, const string& pattern, function<bool(vector<string>&)>& func, int count) {
+		vector<string> vec;
+		unsigned long long cursor = 0;
+
+		do {
+			if (scan(name, key, cursor, vec, pattern, count) <= 0) return code;
+
+			if (!func(vec)) break;
+		} while (cursor > 0);
+
+		return OK;
 	}
 
+public:
+
 	// 用于删除哈希表中指定字段。
 	int hdel(const string& key, const string& filed) {
 		return execute("hdel", key, filed);
@@ -722,11 +2062,15 @@ public:
 
 	// 用于获取哈希表中指定字段的值。
 	int hget(const string& key, const string& filed, string& val) {
-		vector<string> vec;
+		Command cmd("hget");
+
+		cmd.add(key, filed);
 
-		if (execute(vec, "hget", key, filed) <= 0) return code;
+		if (cmd.getResult(this, timeout) <= 0) return code;
 
-		val = vec[0];
+		Reply reply = cmd.getReply();
+
+		val.assign(reply.data(), reply.size());
 
 		return code;
 	}
@@ -805,7 +2149,7 @@ public:
 
 		cmd.getResult(this, timeout);
 	
-		if (code > 0) std::swap(vec, cmd.res);
+		if (code > 0) std::swap(vec, cmd.flatten());
 
 		return code;
 	}
@@ -834,25 +2178,28 @@ public:
 		// 声明了一个线程本地存储的字符数组id
 		thread_local char id[0xFF] = {0};
 
-		// 用于获取当前主机的IP地址。
-		auto GetHost = [](){
+		// 用于获取当前主机的IP地址。gethostbyname 和 inet_ntoa 使用静态缓冲区，
+		// 多个线程同时调用会相互覆盖，因此只在静态变量初始化时调用一次。
+		static const string host = [](){
 			char hostname[0xFF];
 
-			if (gethostname(hostname, sizeof(hostname)) < 0) return "unknow host";
+			if (gethostname(hostname, sizeof(hostname)) < 0) return string("unknow host");
 
 			struct hostent* data = gethostbyname(hostname);
 
-			return (const char*)inet_ntoa(*(struct in_addr*)(data->h_addr_list[0]));
-		};
+			if (data == NULL || data->h_addr_list[0] == NULL) return string(hostname);
 
-		// 如果id数组为空，则调用GetHost()函数获取当前主机的IP地址、进程ID和线程ID，
+			return string(inet_ntoa(*(struct in_addr*)(data->h_addr_list[0])));
+		}();
+
+		// 如果id数组为空，则使用当前主机的IP地址、进程ID和线程ID，
 		// 并使用snprintf()函数将它们格式化为字符串。
 		if (*id == 0)
 		{
 #ifdef XG_LINUX
-			snprintf(id, sizeof(id) - 1, "%s:%ld:%ld", GetHost(), (long)getpid(), (long)syscall(SYS_gettid));
+			snprintf(id, sizeof(id) - 1, "%s:%ld:%ld", host.c_str(), (long)getpid(), (long)syscall(SYS_gettid));
 #else
-			snprintf(id, sizeof(id) - 1, "%s:%ld:%ld", GetHost(), (long)GetCurrentProcessId(), (long)GetCurrentThreadId());
+			snprintf(id, sizeof(id) - 1, "%s:%ld:%ld", host.c_str(), (long)GetCurrentProcessId(), (long)GetCurrentThreadId());
 #endif
 		}
 
@@ -860,55 +2207,64 @@ public:
 		return id;
 	}
 
+	// 释放锁的Lua脚本，作用是检查指定键的值是否等于 ARGV[1] 中的锁ID，如果相等，则删除该键，并返回1；否则，返回0。
+	static const char* GetUnlockScript() {
+		return "if redis.call('get',KEYS[1])==ARGV[1] then return redis.call('del',KEYS[1]) else return 0 end";
+	}
+
 	// 用于释放指定键的锁。
     bool unlock(const string& key) {
-		// Lua脚本的作用是检查指定键的值是否等于当前线程的锁ID，如果相等，则删除该键，并返回1；否则，返回0。
-		const char* lua = "if redis.call('get',KEYS[1])==ARGV[1] then return redis.call('del',KEYS[1]) else return 0 end";
+		return unlock(key, getLockId());
+	}
+
+	// 释放由 id 持有的锁，锁的值不是 id 时不做任何修改
+	bool unlock(const string& key, const string& id) {
+		return eval(GetUnlockScript(), key, id) > 0 && status == OK;
+	}
 
-		return eval(lua, key, getLockId()) > 0 && status == OK;
+	// 尝试获取一次锁，不等待，id 为持有者标识，ttl 为过期毫秒数
+	bool tryLock(const string& key, const string& id, int ttl) {
+		return execute("set", key, id, "nx", "px", ttl) == OK;
 	}
 
-	// 用于获取指定键的锁。
+	// 用于获取指定键的锁，锁被占用时按指数退避重试，最多等待 timeout 秒。
+	// 键已存在时 SET NX 返回空值，只有返回 OK 才表示获取成功
 	bool lock(const string& key, int timeout = 30) {
-		int delay = timeout * 1000;
+		int delay = LOCK_MIN_BACKOFF;
+		chrono::steady_clock::time_point deadline = chrono::steady_clock::now() + chrono::seconds(timeout);
 
-		for (int i = 0; i < delay; i += 10) {
-			if (execute("set", key, getLockId(), "nx", "ex", timeout) >= 0) 
-				return true;
+		while (execute("set", key, getLockId(), "nx", "ex", timeout) != OK) {
+			long long remain = chrono::duration_cast<chrono::milliseconds>(deadline - chrono::steady_clock::now()).count();
 
-			Sleep(10);
+			if (remain <= 0) return false;
+
+			Sleep(std::min<long long>(GetBackoff(delay), remain));
 		}
 
-		return false;
+		return true;
 	}
 
-protected:
-	// 用于从连接池中获取一个RedisConnect对象。
-    virtual shared_ptr<RedisConnect> grasp() const {
-		// ResPool类的构造函数接受两个参数，一个是lambda表达式，用于创建RedisConnect对象，
-		// 另一个是连接池中最多保存的对象数量。
-		// 在这里，使用lambda表达式创建RedisConnect对象，并将其添加到连接池中。
-		static ResPool<RedisConnect> pool([&]() {
-			shared_ptr<RedisConnect> redis = make_shared<RedisConnect>();
-
-			if (redis && redis->connect(host, port, timeout, memsz)) {
-				if (redis->auth(passwd)) 
-                    return redis;
-			}
+	// 指数退避的等待毫秒数，在 delay 的一半到 delay 之间随机选择，避免多个客户端同时重试，
+	// 同时将 delay 加倍，上限为 LOCK_MAX_BACKOFF
+	static int GetBackoff(int& delay) {
+		thread_local minstd_rand rand((unsigned)(std::hash<thread::id>()(this_thread::get_id()) ^ time(NULL)));
 
-			return redis = NULL;
-		}, POOL_MAXLEN);
+		int res = delay / 2 + rand() % (delay / 2 + 1);
 
-		// 首先从连接池中获取一个可用的对象。
-		shared_ptr<RedisConnect> redis = pool.get();
+		// 静态常量不能按引用传给 std::min
+		delay = delay * 2 < LOCK_MAX_BACKOFF ? delay * 2 : (int)(LOCK_MAX_BACKOFF);
 
-		if (redis && redis->getErrorCode()) {
-			pool.disable(redis);
+		return res;
+	}
 
-			return grasp();
-		}
+protected:
+	// 用于从连接池中获取一个RedisConnect对象。
+    virtual shared_ptr<RedisConnect> grasp() const;
 
-		return redis;
+	// 默认连接池，由 Setup 的参数决定，连接池本身由 RedisPoolRegistry 持有
+	static atomic<RedisPool*>& GetDefaultPool() {
+		static atomic<RedisPool*> pool(NULL);
+		return pool;
 	}
 
 public:
@@ -925,23 +2281,57 @@ public:
 		return &redis;
 	}
 
+	// 判断命令是否为只读命令
+	static bool IsReadOnly(const string& name) {
+		static const char* names[] = {
+			"exists", "get", "getrange", "hexists", "hget", "hgetall", "hkeys", "hlen", "hmget", "hscan",
+			"hstrlen", "hvals", "keys", "lindex", "llen", "lrange", "mget", "pttl", "scan", "scard",
+			"sismember", "smembers", "srandmember", "sscan", "strlen", "ttl", "type", "zcard", "zcount",
+			"zrange", "zrangebyscore", "zrank", "zrevrange", "zrevrank", "zscan", "zscore"
+		};
+
+		char buf[16];
+
+		if (name.length() >= sizeof(buf)) return false;
+
+		for (size_t i = 0; i <= name.length(); i++) buf[i] = tolower(name.c_str()[i]);
+
+		return std::binary_search(std::begin(names), std::end(names), (const char*)(buf), [](const char* a, const char* b) {
+			return strcmp(a, b) < 0;
+		});
+	}
+
+	// 默认连接池，连接参数来自 GetTemplate()
+	static RedisPool& GetPool();
+
 	static void SetMaxConnCount(int maxlen) {
 		if (maxlen > 0) POOL_MAXLEN = maxlen;
 	}
+
+	// 设置最少空闲连接数，需在 Setup 之前调用
+	static void SetMinIdleCount(int minidle) {
+		if (minidle >= 0) POOL_MINIDLE = std::min(minidle, POOL_MAXLEN);
+	}
 	
 	// 用于获取一个共享的RedisConnect对象。
 	static shared_ptr<RedisConnect> Instance() {
 		return GetTemplate()->grasp();
 	}
     
-	// 用于设置Redis服务器的地址、端口、超时时间、内存限制和密码等参数。
-	static void Setup(const string& host, int port, const string& passwd = "", int timeout = 3000, int memsz = 2 * 1024 * 1024) {
+	// 初始化网络环境，Setup 和其它客户端类在建立连接前调用
+	static void Startup() {
 #ifdef XG_LINUX
-		// 该函数首先根据操作系统类型屏蔽SIGPIPE信号，以避免在网络连接断开后向已关闭的socket发送数据导致程序崩溃。
+		// 根据操作系统类型屏蔽SIGPIPE信号，以避免在网络连接断开后向已关闭的socket发送数据导致程序崩溃。
 		signal(SIGPIPE, SIG_IGN);
 #else
 		WSADATA data; WSAStartup(MAKEWORD(2, 2), &data);
 #endif
+	}
+
+	// 用于设置Redis服务器的地址、端口、超时时间、内存限制和密码等参数。
+	static void Setup(const string& host, int port, const string& passwd = "", int timeout = 3000, int memsz = 2 * 1024 * 1024) {
+		Startup();
+
 		RedisConnect* redis = GetTemplate();
 
 		redis->host = host;
@@ -949,10 +2339,352 @@ public:
 		redis->memsz = memsz;
 		redis->passwd = passwd;
 		redis->timeout = timeout;
+
+		// 重新设置后默认连接池指向新的服务器，设置了最少空闲连接数时立即创建连接池以便预先建立连接
+		GetDefaultPool().store(NULL);
+
+		if (POOL_MINIDLE > 0) GetPool();
+	}
+};
+
+// 连接到同一个Redis服务器（主机、端口、数据库、密码均相同）的连接池，
+// 各个连接池的容量、最少空闲连接数等参数可以分别设置，并各自统计使用情况。
+class RedisPool : public ResPool<RedisConnect> {
+protected:
+	int db;
+	int port;
+	int memsz;
+	int timeout;
+	string host;
+	string passwd;
+	atomic<long long> grasps; // 获取连接的次数
+	atomic<long long> fails; // 获取连接失败的次数
+	atomic<long long> connects; // 建立连接的次数
+	atomic<long long> errors; // 建立连接失败的次数
+	atomic<long long> rtt; // 命令往返时间的滑动平均值（微秒），0表示尚未测量
+
+public:
+	// 按连接池的参数建立一个新连接，该连接不属于连接池，用于订阅、推送消息等专用场景
+	shared_ptr<RedisConnect> create() {
+		shared_ptr<RedisConnect> redis = make_shared<RedisConnect>();
+
+		connects++;
+
+		if (redis->connect(host, port, timeout, memsz) && redis->auth(passwd) > 0) {
+			if (db == 0 || redis->select(db) > 0) return redis;
+		}
+
+		errors++;
+
+		return NULL;
+	}
+
+	RedisPool(const string& host, int port, int db = 0, const string& passwd = "", int timeout = 3000, int memsz = 2 * 1024 * 1024, int maxlen = RedisConnect::POOL_MAXLEN)
+		: ResPool<RedisConnect>([this]() { return create(); }, maxlen), db(db), port(port), memsz(memsz), timeout(timeout), host(host), passwd(passwd), grasps(0), fails(0), connects(0), errors(0), rtt(0) {
+		// 维护线程在后台预先建立连接，定期检查空闲连接并释放其接收缓冲区
+		if (RedisConnect::POOL_MINIDLE > 0) {
+			setMinIdle(std::min(RedisConnect::POOL_MINIDLE, maxlen));
+			setChecker([](RedisConnect& redis) {
+				redis.trim();
+
+				return redis.ping() > 0;
+			});
+			start();
+		}
+	}
+
+	// 维护线程会调用 create，需要在成员析构之前停止
+	~RedisPool() {
+		stop();
+	}
+
+	// 获取一个可用的连接，已断开或出错中断的连接被丢弃后重新获取
+	shared_ptr<RedisConnect> grasp(int wait = RedisConnect::POOL_WAITTIME) {
+		long long waited = 0;
+		shared_ptr<RedisConnect> redis;
+
+		grasps++;
+
+		while ((redis = get(wait, &waited)) && redis->isBroken()) disable(redis);
+
+		if (RedisMetrics::IsEnabled()) RedisMetrics::Instance()->recordWait(waited);
+
+		if (redis) {
+			redis->trim();
+		}
+		else {
+			fails++;
+		}
+
+		return redis;
+	}
+
+	int getPort() const {
+		return port;
+	}
+
+	int getDatabase() const {
+		return db;
+	}
+
+	const string& getHost() const {
+		return host;
+	}
+
+	// 连接池名称，格式为 host:port/db，不包含密码
+	string getName() const {
+		return host + ":" + to_string(port) + "/" + to_string(db);
+	}
+
+	long long getGraspCount() const {
+		return grasps;
+	}
+
+	long long getFailCount() const {
+		return fails;
+	}
+
+	long long getConnectCount() const {
+		return connects;
+	}
+
+	long long getConnectErrorCount() const {
+		return errors;
+	}
+
+	// 命令往返时间的滑动平均值（微秒）
+	long long getRTT() const {
+		return rtt;
+	}
+
+	// 记录一次命令的往返时间，按 1/8 的权重计入滑动平均值
+	void record(long long usec) {
+		long long val = rtt.load(memory_order_relaxed);
+
+		while (!rtt.compare_exchange_weak(val, val == 0 ? usec : val + (usec - val) / 8, memory_order_relaxed));
+	}
+};
+
+// 按服务器地址管理连接池，同一地址只创建一个连接池。连接池创建后保留到进程退出，
+// 因此取得的引用可以长期保存，需要访问多个服务器（读写分离、按键分片等）时使用。
+class RedisPoolRegistry {
+protected:
+	mutex mtx;
+	map<string, shared_ptr<RedisPool>> pools;
+
+	static string GetKey(const string& host, int port, int db, const string& passwd) {
+		return host + ":" + to_string(port) + "/" + to_string(db) + "\n" + passwd;
+	}
+
+public:
+	// 获取指定服务器的连接池，不存在时按给定参数创建
+	RedisPool& get(const string& host, int port, int db = 0, const string& passwd = "", int timeout = 3000, int memsz = 2 * 1024 * 1024, int maxlen = 0) {
+		lock_guard<mutex> lk(mtx);
+
+		shared_ptr<RedisPool>& pool = pools[GetKey(host, port, db, passwd)];
+
+		if (!pool) pool = make_shared<RedisPool>(host, port, db, passwd, timeout, memsz, maxlen > 0 ? maxlen : RedisConnect::POOL_MAXLEN);
+
+		return *pool;
+	}
+
+	// 查找指定服务器的连接池，不存在时返回NULL
+	RedisPool* find(const string& host, int port, int db = 0, const string& passwd = "") {
+		lock_guard<mutex> lk(mtx);
+
+		auto it = pools.find(GetKey(host, port, db, passwd));
+
+		return it == pools.end() ? NULL : it->second.get();
+	}
+
+	// 获取全部连接池，用于统计和监控
+	vector<RedisPool*> getPools() {
+		vector<RedisPool*> vec;
+		lock_guard<mutex> lk(mtx);
+
+		for (auto& item : pools) vec.push_back(item.second.get());
+
+		return vec;
+	}
+
+	static RedisPoolRegistry* Instance() {
+		static RedisPoolRegistry registry;
+		return &registry;
+	}
+};
+
+// 常驻的工作线程组，用于把一组短任务（例如发往多个节点的管道）并行执行，
+// 避免每次批量操作都创建线程。线程在任务多于空闲线程时按需创建，最多 MAX_THREADS 个；
+// 调用线程在等待期间也会执行队列中的任务，因此线程全部繁忙时不会死锁。
+class RedisWorkerPool {
+public:
+	static const int MAX_THREADS = 64;
+
+protected:
+	// 一次 run 调用提交的任务，全部完成后唤醒调用线程
+	struct Batch {
+		int remain;
+		mutex mtx;
+		condition_variable cond;
+	};
+
+	struct Task {
+		function<void()> func;
+		Batch* batch;
+	};
+
+	int idle = 0; // 没有在执行任务的线程数
+	bool stopping = false;
+	mutex mtx; // 保护以上成员和 tasks
+	condition_variable cond;
+	deque<Task> tasks;
+	vector<thread> workers;
+
+	static void Finish(Task& task) {
+		task.func();
+
+		lock_guard<mutex> lk(task.batch->mtx);
+
+		if (--task.batch->remain == 0) task.batch->cond.notify_all();
+	}
+
+	void work() {
+		unique_lock<mutex> lk(mtx);
+
+		while (true) {
+			if (tasks.size() > 0) {
+				Task task = std::move(tasks.front());
+
+				tasks.pop_front();
+				idle--;
+				lk.unlock();
+
+				Finish(task);
+
+				lk.lock();
+				idle++;
+
+				continue;
+			}
+
+			if (stopping) break;
+
+			cond.wait(lk);
+		}
+	}
+
+public:
+	RedisWorkerPool() = default;
+	RedisWorkerPool(const RedisWorkerPool&) = delete;
+	RedisWorkerPool& operator=(const RedisWorkerPool&) = delete;
+
+	~RedisWorkerPool() {
+		{
+			lock_guard<mutex> lk(mtx);
+
+			stopping = true;
+		}
+
+		cond.notify_all();
+
+		for (thread& item : workers) item.join();
+	}
+
+	// 并行执行全部任务，第一个任务在调用线程中执行，全部完成后返回
+	void run(vector<function<void()>>& funcs) {
+		Batch batch;
+
+		if (funcs.empty()) return;
+
+		batch.remain = funcs.size() - 1;
+
+		if (batch.remain > 0) {
+			{
+				lock_guard<mutex> lk(mtx);
+
+				for (size_t i = 1; i < funcs.size(); i++) tasks.push_back(Task{std::move(funcs[i]), &batch});
+
+				while ((int)(tasks.size()) > idle && (int)(workers.size()) < MAX_THREADS) {
+					idle++;
+					workers.push_back(thread([this]() {
+						work();
+					}));
+				}
+			}
+
+			cond.notify_all();
+		}
+
+		funcs[0]();
+
+		while (true) {
+			Task task;
+
+			{
+				lock_guard<mutex> lk(mtx);
+
+				if (tasks.empty()) break;
+
+				task = std::move(tasks.front());
+				tasks.pop_front();
+			}
+
+			Finish(task);
+		}
+
+		unique_lock<mutex> lk(batch.mtx);
+
+		batch.cond.wait(lk, [&batch]() {
+			return batch.remain == 0;
+		});
+	}
+
+	static RedisWorkerPool* Instance() {
+		static RedisWorkerPool pool;
+		return &pool;
 	}
 };
 
+inline RedisPool& RedisConnect::GetPool() {
+	RedisPool* pool = GetDefaultPool().load(memory_order_acquire);
+
+	if (pool) return *pool;
+
+	RedisConnect* redis = GetTemplate();
+
+	pool = &RedisPoolRegistry::Instance()->get(redis->host, redis->port, 0, redis->passwd, redis->timeout, redis->memsz);
+
+	GetDefaultPool().store(pool, memory_order_release);
+
+	return *pool;
+}
+
+inline void RedisMetrics::Collect(Snapshot& res) {
+	for (RedisPool* pool : RedisPoolRegistry::Instance()->getPools()) {
+		PoolSnapshot item;
+
+		item.name = pool->getName();
+		item.length = pool->getLength();
+		item.used = pool->getUsedCount();
+		item.grasps = pool->getGraspCount();
+		item.fails = pool->getFailCount();
+		item.connects = pool->getConnectCount();
+		item.errors = pool->getConnectErrorCount();
+		item.waits = pool->getWaitCount();
+		item.waittime = pool->getWaitTime();
+		item.rtt = pool->getRTT();
+
+		res.pools.push_back(item);
+	}
+}
+
+inline shared_ptr<RedisConnect> RedisConnect::grasp() const {
+	return GetPool().grasp();
+}
+
 int RedisConnect::POOL_MAXLEN = 8;
+int RedisConnect::POOL_WAITTIME = 3000;
+int RedisConnect::POOL_MINIDLE = 0;
 int RedisConnect::SOCKET_TIMEOUT = 10;
 
 #endif
\ No newline at end of file
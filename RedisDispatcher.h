@@ -0,0 +1,239 @@
+#ifndef REDIS_DISPATCHER_H
+#define REDIS_DISPATCHER_H
+///////////////////////////////////////////////////////////////
+#include "RedisConnect.h"
+
+#include <deque>
+
+// 跨线程的自动批量发送。调用线程把命令放入队列后等待结果，少量发送线程每次取出
+// 队列中已有的全部命令（最多 maxbatch 条），通过一个连接以管道方式一次发出，
+// 收到应答后唤醒各个调用线程。一个发送线程只占用一个连接，高并发时可以用远少于
+// 调用线程数的连接获得更高的吞吐量。
+// 事务、阻塞、订阅和切换数据库等依赖连接状态的命令不参与合并，直接从连接池取连接执行。
+class RedisDispatcher {
+public:
+	typedef RedisConnect::Reply Reply;
+	typedef RedisConnect::Command Command;
+
+protected:
+	// 调用线程栈上的等待对象
+	struct Waiter {
+		int code = 0;
+		bool done = false;
+		Command* cmd;
+		mutex mtx;
+		condition_variable cond;
+
+		Waiter(Command* cmd) : cmd(cmd) {}
+	};
+
+	RedisPool* pool;
+	int maxbatch;
+	bool running = false; // 由 mtx 保护
+	mutex mtx;
+	condition_variable cond;
+	deque<Waiter*> queue;
+	vector<thread> workers;
+	atomic<long long> batches; // 发送的批次数
+	atomic<long long> cmds; // 经过合并发送的命令数
+
+	// 判断命令是否依赖连接状态，这类命令不能与其它线程的命令合并发送
+	static bool IsExclusive(const string& name) {
+		static const char* names[] = {
+			"blmove", "blpop", "brpop", "brpoplpush", "bzpopmax", "bzpopmin", "client", "discard", "exec", "hello",
+			"monitor", "multi", "psubscribe", "select", "subscribe", "unwatch", "wait", "watch", "xread", "xreadgroup"
+		};
+
+		char buf[16];
+
+		if (name.length() >= sizeof(buf)) return false;
+
+		for (size_t i = 0; i <= name.length(); i++) buf[i] = tolower(name.c_str()[i]);
+
+		return std::binary_search(std::begin(names), std::end(names), (const char*)(buf), [](const char* a, const char* b) {
+			return strcmp(a, b) < 0;
+		});
+	}
+
+	int run(Command& cmd) {
+		shared_ptr<RedisConnect> redis = pool->grasp();
+
+		return redis ? redis->execute(cmd) : cmd.fail(RedisConnect::NETERR);
+	}
+
+	void loop() {
+		vector<Waiter*> vec;
+		shared_ptr<RedisConnect> redis;
+
+		while (true) {
+			{
+				unique_lock<mutex> lk(mtx);
+
+				cond.wait(lk, [this]() {
+					return !running || !queue.empty();
+				});
+
+				if (queue.empty()) break;
+
+				while (queue.size() > 0 && (int)(vec.size()) < maxbatch) {
+					vec.push_back(queue.front());
+					queue.pop_front();
+				}
+			}
+
+			RedisConnect::Pipeline pipe;
+
+			// 发送线程一直持有同一个连接，连接出错后重新获取
+			if (!redis || redis->getErrorCode()) redis = pool->grasp();
+
+			for (Waiter* item : vec) pipe.append(*item->cmd);
+
+			if (redis) redis->execute(pipe);
+
+			batches++;
+			cmds += vec.size();
+
+			for (Waiter* item : vec) {
+				lock_guard<mutex> lk(item->mtx);
+
+				item->code = redis ? item->cmd->getCode() : item->cmd->fail(RedisConnect::NETERR);
+				item->done = true;
+				item->cond.notify_one();
+			}
+
+			vec.clear();
+		}
+	}
+
+public:
+	RedisDispatcher(RedisPool& pool, int maxbatch = 256) : pool(&pool), maxbatch(maxbatch > 0 ? maxbatch : 1), batches(0), cmds(0) {}
+
+	~RedisDispatcher() {
+		stop();
+	}
+
+	// 启动发送线程，每个线程占用一个连接
+	bool start(int threads = 2) {
+		lock_guard<mutex> lk(mtx);
+
+		if (running) return false;
+
+		running = true;
+
+		for (int i = 0; i < threads; i++) {
+			workers.push_back(thread([this]() {
+				loop();
+			}));
+		}
+
+		return true;
+	}
+
+	// 停止发送线程，队列中剩余的命令发送完毕后返回
+	void stop() {
+		{
+			lock_guard<mutex> lk(mtx);
+
+			running = false;
+		}
+
+		cond.notify_all();
+
+		for (thread& item : workers) item.join();
+
+		workers.clear();
+	}
+
+	// 执行命令，返回后 cmd 中保存执行结果。发送线程未启动时直接执行
+	int execute(Command& cmd) {
+		const vector<string>& args = cmd.getArgList();
+
+		if (args.empty() || IsExclusive(args[0])) return run(cmd);
+
+		Waiter waiter(&cmd);
+
+		{
+			lock_guard<mutex> lk(mtx);
+
+			if (!running) return run(cmd);
+
+			queue.push_back(&waiter);
+		}
+
+		cond.notify_one();
+
+		unique_lock<mutex> lk(waiter.mtx);
+
+		waiter.cond.wait(lk, [&]() {
+			return waiter.done;
+		});
+
+		return waiter.code;
+	}
+
+	template<class DATA_TYPE, class ...ARGS>
+	int execute(DATA_TYPE val, ARGS ...args) {
+		Command cmd;
+
+		cmd.add(val, args...);
+
+		return execute(cmd);
+	}
+
+	int del(const string& key) {
+		return execute("del", key);
+	}
+
+	int get(const string& key, string& val) {
+		Command cmd("get");
+
+		cmd.add(key);
+
+		if (execute(cmd) > 0) {
+			Reply reply = cmd.getReply();
+
+			val.assign(reply.data(), reply.size());
+		}
+
+		return cmd.getCode();
+	}
+
+	int hget(const string& key, const string& filed, string& val) {
+		Command cmd("hget");
+
+		cmd.add(key, filed);
+
+		if (execute(cmd) > 0) {
+			Reply reply = cmd.getReply();
+
+			val.assign(reply.data(), reply.size());
+		}
+
+		return cmd.getCode();
+	}
+
+	int set(const string& key, const string& val, int timeout = 0) {
+		return timeout > 0 ? execute("setex", key, timeout, val) : execute("set", key, val);
+	}
+
+	int hset(const string& key, const string& filed, const string& val) {
+		return execute("hset", key, filed, val);
+	}
+
+	// 平均每批发送的命令数
+	double getBatchSize() const {
+		long long num = batches;
+
+		return num > 0 ? (double)(cmds) / num : 0;
+	}
+
+	long long getBatchCount() const {
+		return batches;
+	}
+
+	long long getCommandCount() const {
+		return cmds;
+	}
+};
+
+#endif
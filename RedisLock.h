@@ -0,0 +1,252 @@
+#ifndef REDIS_LOCK_H
+#define REDIS_LOCK_H
+///////////////////////////////////////////////////////////////
+#include "RedisConnect.h"
+
+// 分布式锁。获取失败时按指数退避并加入随机抖动后重试，也可以订阅释放通知，
+// 持有者释放锁时立即唤醒等待方，而不是由所有等待方轮询。
+// 每次获取成功时在同一个脚本内递增 {key}:fence 计数器，得到单调递增的防护令牌（fencing token），
+// 写入共享资源时携带令牌，资源方拒绝比已见过的令牌更小的请求，可以防止持有者因长时间停顿
+// 导致锁过期后仍然写入。持有期间后台看门狗线程每隔 ttl/3 延长一次过期时间，续期失败时
+// isHeld 返回 false，表示锁可能已被其他客户端取得。
+// 同一个对象不能被多个线程同时使用；对象析构时自动释放锁。
+class RedisLock {
+public:
+	typedef RedisConnect::Command Command;
+
+	// 获取锁：KEYS[1] 为锁，KEYS[2] 为令牌计数器，ARGV[1] 为持有者标识，ARGV[2] 为过期毫秒数。
+	// 成功时返回防护令牌，锁已被占用时返回0
+	static const char* GetLockScript() {
+		return "if redis.call('set',KEYS[1],ARGV[1],'nx','px',ARGV[2]) then return redis.call('incr',KEYS[2]) else return 0 end";
+	}
+
+	// 续期：仍由 ARGV[1] 持有时重新设置过期时间并返回1，否则返回0
+	static const char* GetRenewScript() {
+		return "if redis.call('get',KEYS[1])==ARGV[1] then return redis.call('pexpire',KEYS[1],ARGV[2]) else return 0 end";
+	}
+
+	// 释放：仍由 ARGV[1] 持有时删除锁，并向 ARGV[2] 频道发布释放通知
+	static const char* GetUnlockScript() {
+		return "if redis.call('get',KEYS[1])==ARGV[1] then redis.call('del',KEYS[1]) redis.call('publish',ARGV[2],ARGV[1]) return 1 else return 0 end";
+	}
+
+protected:
+	int ttl; // 锁的过期毫秒数
+	string key;
+	string id; // 持有者标识，每个对象不同
+	RedisPool* pool;
+	bool notify = false;
+	bool watchdog = true;
+	long long token = 0;
+	atomic<bool> held;
+
+	mutex mtx;
+	condition_variable cond;
+	bool stopping = false;
+	thread worker; // 看门狗线程
+
+	// 执行脚本，fence 为 true 时令牌计数器作为第二个键传入。
+	// 成功时返回脚本的整数结果，失败时返回错误码
+	long long eval(const char* script, bool fence, const string& arg) {
+		Command cmd("eval");
+		shared_ptr<RedisConnect> redis = pool->grasp();
+
+		if (!redis) return RedisConnect::NETERR;
+
+		if (fence) {
+			cmd.add(script, 2, key, getFenceKey(), id, arg);
+		}
+		else {
+			cmd.add(script, 1, key, id, arg);
+		}
+
+		if (redis->execute(cmd) < 0) return redis->getErrorCode();
+
+		return cmd.getReply().getInteger();
+	}
+
+	// 定期续期，直到释放锁或续期失败。网络错误时继续重试，
+	// 距离上次成功续期超过 ttl 后认为锁已丢失
+	void run() {
+		chrono::steady_clock::time_point last = chrono::steady_clock::now();
+		unique_lock<mutex> lk(mtx);
+
+		while (!cond.wait_for(lk, chrono::milliseconds(std::max(ttl / 3, 1)), [this]() { return stopping; })) {
+			lk.unlock();
+
+			long long res = eval(GetRenewScript(), false, to_string(ttl));
+			chrono::steady_clock::time_point now = chrono::steady_clock::now();
+
+			lk.lock();
+
+			if (res > 0) {
+				last = now;
+			}
+			else if (res == 0 || now - last >= chrono::milliseconds(ttl)) {
+				held = false;
+
+				break;
+			}
+		}
+	}
+
+	void startWatchdog() {
+		stopping = false;
+		worker = thread([this]() {
+			run();
+		});
+	}
+
+	void stopWatchdog() {
+		{
+			lock_guard<mutex> lk(mtx);
+
+			stopping = true;
+		}
+
+		cond.notify_all();
+
+		if (worker.joinable()) worker.join();
+	}
+
+	// 订阅释放通知，成功时返回专用连接
+	shared_ptr<RedisConnect> subscribe() {
+		Command cmd("subscribe");
+		shared_ptr<RedisConnect> redis = pool->create();
+
+		cmd.add(getChannel());
+
+		if (redis && redis->send(cmd) >= 0 && redis->receive(cmd) > 0) return redis;
+
+		return NULL;
+	}
+
+public:
+	// ttl 为锁的过期毫秒数，看门狗开启时只在持有者失去响应后才会过期
+	RedisLock(const string& key, int ttl = 30000, RedisPool& pool = RedisConnect::GetPool()) : ttl(std::max(ttl, 3)), key(key), pool(&pool), held(false) {
+		static atomic<long long> seq(0);
+
+		id = string(RedisConnect::GetTemplate()->getLockId()) + ":" + to_string(++seq);
+	}
+
+	~RedisLock() {
+		unlock();
+	}
+
+	RedisLock(const RedisLock&) = delete;
+	RedisLock& operator=(const RedisLock&) = delete;
+
+	// 等待时订阅释放通知，需要为每个等待方建立一个专用连接
+	void setNotify(bool notify) {
+		this->notify = notify;
+	}
+
+	// 是否在持有期间自动续期，默认开启
+	void setWatchdog(bool watchdog) {
+		this->watchdog = watchdog;
+	}
+
+	const string& getKey() const {
+		return key;
+	}
+
+	const string& getId() const {
+		return id;
+	}
+
+	// 令牌计数器与锁使用相同的哈希标签，集群中两者位于同一个槽位，脚本不会返回 CROSSSLOT。
+	// 锁名本身带有非空的 {...} 时直接沿用，否则以整个锁名作为哈希标签；
+	// 锁名中有 '}' 但没有有效的哈希标签时无法构造同槽位的键名，只能用于单实例
+	string getFenceKey() const {
+		size_t pos = key.find('{');
+		size_t end = pos == string::npos ? pos : key.find('}', pos + 1);
+
+		if ((end != string::npos && end > pos + 1) || key.find('}') != string::npos) return key + ":fence";
+
+		return "{" + key + "}:fence";
+	}
+
+	string getChannel() const {
+		return key + ":release";
+	}
+
+	// 最近一次获取成功时得到的防护令牌
+	long long getToken() const {
+		return token;
+	}
+
+	// 是否仍然持有锁，看门狗续期失败后返回 false
+	bool isHeld() const {
+		return held;
+	}
+
+	// 尝试获取一次，不等待
+	bool tryLock() {
+		if (held) return false;
+
+		// 回收续期失败后已经退出的看门狗线程
+		stopWatchdog();
+
+		long long res = eval(GetLockScript(), true, to_string(ttl));
+
+		if (res <= 0) return false;
+
+		token = res;
+		held = true;
+
+		if (watchdog) startWatchdog();
+
+		return true;
+	}
+
+	// 获取锁，最多等待 wait 毫秒。未开启释放通知时按指数退避轮询；开启时在退避间隔内
+	// 等待释放通知，收到通知后立即重试。持有者异常退出时锁靠过期释放，不会发布通知，
+	// 因此仍需按退避间隔重试
+	bool lock(int wait = 30000) {
+		int delay = RedisConnect::LOCK_MIN_BACKOFF;
+		shared_ptr<RedisConnect> sub;
+		chrono::steady_clock::time_point deadline = chrono::steady_clock::now() + chrono::milliseconds(wait);
+
+		if (held) return false;
+
+		// 先订阅再尝试获取，避免在两者之间发生的释放被错过
+		if (notify) sub = subscribe();
+
+		while (!tryLock()) {
+			long long remain = chrono::duration_cast<chrono::milliseconds>(deadline - chrono::steady_clock::now()).count();
+
+			if (remain <= 0) return false;
+
+			int ms = (int)(std::min<long long>(RedisConnect::GetBackoff(delay), remain));
+
+			if (sub) {
+				Command msg;
+				int code = sub->receive(msg, std::max(ms, 1));
+
+				// 收到通知后从最短间隔重新开始退避，连接出错时改为轮询
+				if (code > 0) {
+					delay = RedisConnect::LOCK_MIN_BACKOFF;
+				}
+				else if (code != RedisConnect::TIMEOUT) {
+					sub = NULL;
+				}
+			}
+			else {
+				Sleep(ms);
+			}
+		}
+
+		return true;
+	}
+
+	// 释放锁，锁已丢失或已被释放时返回 false
+	bool unlock() {
+		stopWatchdog();
+
+		if (!held.exchange(false)) return false;
+
+		return eval(GetUnlockScript(), false, getChannel()) > 0;
+	}
+};
+
+#endif
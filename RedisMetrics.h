@@ -0,0 +1,556 @@
+#ifndef REDIS_METRICS_H
+#define REDIS_METRICS_H
+///////////////////////////////////////////////////////////////
+#include "typedef.h"
+
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+
+using namespace std;
+
+// 对数线性直方图，数值单位为微秒。按最高有效位分组，每组再线性分成16个桶，
+// 相对误差不超过1/16。记录数值只有几次无锁的原子加法，可以在多个线程中并发调用。
+class RedisHistogram {
+public:
+	static const int SUB_BITS = 4;
+	static const int SUB_COUNT = 1 << SUB_BITS;
+	static const int MAX_BITS = 36; // 超过 2^36 微秒（约19小时）的数值记入最后一个桶
+	static const int BUCKET_COUNT = (MAX_BITS - SUB_BITS + 1) * SUB_COUNT;
+
+	// 直方图某一时刻的副本
+	struct Snapshot {
+		long long sum = 0;
+		long long max = 0;
+		long long count = 0;
+		vector<long long> buckets;
+
+		double mean() const {
+			return count > 0 ? (double)(sum) / count : 0;
+		}
+
+		// 合并另一个副本的数据
+		void merge(const Snapshot& obj) {
+			if (buckets.size() < obj.buckets.size()) buckets.resize(obj.buckets.size());
+
+			for (size_t i = 0; i < obj.buckets.size(); i++) buckets[i] += obj.buckets[i];
+
+			sum += obj.sum;
+			count += obj.count;
+			max = std::max(max, obj.max);
+		}
+
+		// 返回分位数 q（0到1之间）对应的数值，取所在桶的上界
+		long long percentile(double q) const {
+			if (count <= 0) return 0;
+
+			long long num = 0;
+			long long pos = (long long)(q * count + 0.999999);
+
+			if (pos < 1) pos = 1;
+
+			for (size_t i = 0; i < buckets.size(); i++) {
+				if ((num += buckets[i]) >= pos) return std::min<long long>(GetUpper(i), max);
+			}
+
+			return max;
+		}
+	};
+
+protected:
+	atomic<long long> sum;
+	atomic<long long> max;
+	atomic<long long> buckets[BUCKET_COUNT];
+
+	static int HighBit(u_int64 val) {
+#ifdef __GNUC__
+		return 63 - __builtin_clzll(val);
+#else
+		int num = 0;
+
+		while (val >>= 1) num++;
+
+		return num;
+#endif
+	}
+
+public:
+	// 数值所在桶的下标，小于16的数值每个数值一个桶
+	static int GetIndex(u_int64 val) {
+		if (val >= (1ULL << MAX_BITS)) val = (1ULL << MAX_BITS) - 1;
+
+		if (val < SUB_COUNT) return (int)(val);
+
+		int shift = HighBit(val) - SUB_BITS;
+
+		return (shift + 1) * SUB_COUNT + (int)((val >> shift) & (SUB_COUNT - 1));
+	}
+
+	// 桶中可以记录的最大数值
+	static long long GetUpper(int idx) {
+		if (idx < SUB_COUNT) return idx;
+
+		int shift = idx / SUB_COUNT - 1;
+
+		return ((long long)(SUB_COUNT + idx % SUB_COUNT + 1) << shift) - 1;
+	}
+
+	RedisHistogram() : sum(0), max(0) {
+		for (auto& item : buckets) item.store(0, memory_order_relaxed);
+	}
+
+	void record(long long val) {
+		if (val < 0) val = 0;
+
+		buckets[GetIndex(val)].fetch_add(1, memory_order_relaxed);
+		sum.fetch_add(val, memory_order_relaxed);
+
+		long long tmp = max.load(memory_order_relaxed);
+
+		while (val > tmp && !max.compare_exchange_weak(tmp, val, memory_order_relaxed));
+	}
+
+	// 记录期间生成的副本中各个字段可能相差几次记录，总数以各桶之和为准
+	Snapshot snapshot() const {
+		Snapshot res;
+
+		res.buckets.resize(BUCKET_COUNT);
+
+		for (int i = 0; i < BUCKET_COUNT; i++) res.count += (res.buckets[i] = buckets[i].load(memory_order_relaxed));
+
+		res.sum = sum.load(memory_order_relaxed);
+		res.max = max.load(memory_order_relaxed);
+
+		return res;
+	}
+
+	void reset() {
+		for (auto& item : buckets) item.store(0, memory_order_relaxed);
+
+		sum.store(0, memory_order_relaxed);
+		max.store(0, memory_order_relaxed);
+	}
+};
+
+// 客户端的执行统计：建立连接耗时、连接池等待时间，按命令名称统计的发送耗时、
+// 首字节到达时间（TTFB）和完整应答时间，以及收发字节数、按返回值统计的错误次数。
+// 默认关闭，关闭时执行命令只多一次判断；通过 Enable(true) 开启后全局生效。
+// 统计结果可以通过 snapshot 获取副本，或通过 toPrometheus 输出 Prometheus 文本格式。
+class RedisMetrics {
+public:
+	static const int NAME_SIZE = 32; // 命令名称的最大长度，超过时记入 other
+	static const int TABLE_SIZE = 256; // 最多分别统计的命令个数
+	static const int ERROR_COUNT = 16;
+	static const int NOTFOUND = -9; // 与 RedisConnect::NOTFOUND 相同，空值应答单独计数，不算作错误
+
+	// 一个命令的统计数据，创建后保留到进程退出
+	struct Command {
+		char name[NAME_SIZE];
+		atomic<long long> calls;
+		atomic<long long> errors;
+		RedisHistogram write; // 发送请求的耗时
+		RedisHistogram ttfb; // 开始发送到收到第一批应答数据的时间
+		RedisHistogram reply; // 开始发送到应答解析完成的时间
+
+		Command(const char* name) : calls(0), errors(0) {
+			strncpy(this->name, name, NAME_SIZE - 1);
+			this->name[NAME_SIZE - 1] = 0;
+		}
+	};
+
+	// 一次请求的接收记录，由读取应答的代码填写
+	struct Probe {
+		long long bytes = 0;
+		chrono::steady_clock::time_point start;
+		chrono::steady_clock::time_point first;
+
+		Probe() : start(chrono::steady_clock::now()) {}
+
+		void receive(int len) {
+			if (bytes == 0) first = chrono::steady_clock::now();
+
+			bytes += len;
+		}
+	};
+
+	struct CommandSnapshot {
+		string name;
+		long long calls = 0;
+		long long errors = 0;
+		RedisHistogram::Snapshot write;
+		RedisHistogram::Snapshot ttfb;
+		RedisHistogram::Snapshot reply;
+	};
+
+	// 连接池的使用情况
+	struct PoolSnapshot {
+		string name;
+		int length = 0; // 容量
+		int used = 0; // 正在使用的连接数
+		long long grasps = 0;
+		long long fails = 0;
+		long long connects = 0;
+		long long errors = 0;
+		long long waits = 0;
+		long long waittime = 0;
+		long long rtt = 0;
+	};
+
+	struct Snapshot {
+		long long sent = 0; // 发送的字节数
+		long long received = 0; // 接收的字节数
+		long long misses = 0; // 返回空值（NOTFOUND）的命令数
+		map<string, long long> errors; // 按返回值名称统计的错误次数
+		RedisHistogram::Snapshot connect;
+		RedisHistogram::Snapshot wait;
+		vector<CommandSnapshot> cmds;
+		vector<PoolSnapshot> pools;
+	};
+
+protected:
+	atomic<long long> sent;
+	atomic<long long> received;
+	atomic<long long> misses;
+	atomic<long long> errors[ERROR_COUNT];
+	RedisHistogram connect;
+	RedisHistogram wait;
+	Command other;
+	atomic<Command*> table[TABLE_SIZE];
+
+	static atomic<bool>& GetEnabled() {
+		static atomic<bool> enabled(false);
+		return enabled;
+	}
+
+	// 收集全部连接池的使用情况，在 RedisConnect.h 中实现
+	static void Collect(Snapshot& res);
+
+	static string Escape(const string& str) {
+		string res;
+
+		for (char ch : str) {
+			if (ch == '\\' || ch == '"') {
+				res += '\\';
+				res += ch;
+			}
+			else if (ch == '\n') {
+				res += "\\n";
+			}
+			else {
+				res += ch;
+			}
+		}
+
+		return res;
+	}
+
+	static void Append(string& out, const string& name, const string& labels, double val) {
+		char buf[64];
+
+		snprintf(buf, sizeof(buf), " %.6f\n", val);
+
+		out += name;
+
+		if (labels.length() > 0) out += "{" + labels + "}";
+
+		out += buf;
+	}
+
+	static void Append(string& out, const string& name, const string& labels, long long val) {
+		out += name;
+
+		if (labels.length() > 0) out += "{" + labels + "}";
+
+		out += " " + to_string(val) + "\n";
+	}
+
+	static void Header(string& out, const string& name, const char* type, const char* help) {
+		out += "# HELP " + name + " " + help + "\n";
+		out += "# TYPE " + name + " " + type + "\n";
+	}
+
+	// 以 summary 类型输出直方图，数值转换为秒
+	static void Summary(string& out, const string& name, const string& labels, const RedisHistogram::Snapshot& data) {
+		static const char* quantiles[] = {"0.5", "0.9", "0.99", "0.999"};
+
+		string prefix = labels.length() > 0 ? labels + "," : labels;
+
+		for (const char* item : quantiles) {
+			Append(out, name, prefix + "quantile=\"" + item + "\"", data.percentile(atof(item)) / 1e6);
+		}
+
+		Append(out, name + "_sum", labels, data.sum / 1e6);
+		Append(out, name + "_count", labels, data.count);
+	}
+
+public:
+	RedisMetrics() : sent(0), received(0), misses(0), other("other") {
+		for (auto& item : errors) item.store(0, memory_order_relaxed);
+
+		for (auto& item : table) item.store(NULL, memory_order_relaxed);
+	}
+
+	static RedisMetrics* Instance() {
+		static RedisMetrics* obj = new RedisMetrics();
+		return obj;
+	}
+
+	static bool IsEnabled() {
+		return GetEnabled().load(memory_order_relaxed);
+	}
+
+	static void Enable(bool flag = true) {
+		GetEnabled().store(flag, memory_order_relaxed);
+	}
+
+	// 返回值对应的名称
+	static string GetCodeName(int code) {
+		static const char* names[] = {
+			"OK", "FAIL", "IOERR", "SYSERR", "NETERR", "TIMEOUT", "DATAERR",
+			"SYSBUSY", "PARAMERR", "NOTFOUND", "NETCLOSE", "NETDELAY", "AUTHFAIL"
+		};
+
+		if (code <= 0 && -code < (int)(sizeof(names) / sizeof(names[0]))) return names[-code];
+
+		return "CODE" + to_string(code);
+	}
+
+	// 获取命令的统计对象，名称不区分大小写。首次出现的命令以原子操作加入开放寻址表，
+	// 之后的查找不加锁；名称过长或表已满时返回 other
+	Command* get(const string& name) {
+		char buf[NAME_SIZE];
+		u_int32 hash = 2166136261U;
+
+		if (name.empty() || name.length() >= NAME_SIZE) return &other;
+
+		for (size_t i = 0; i <= name.length(); i++) {
+			buf[i] = tolower(name[i]);
+			hash = (hash ^ (unsigned char)(buf[i])) * 16777619U;
+		}
+
+		for (int i = 0; i < TABLE_SIZE; i++) {
+			atomic<Command*>& slot = table[(hash + i) % TABLE_SIZE];
+			Command* item = slot.load(memory_order_acquire);
+
+			if (item == NULL) {
+				Command* tmp = new Command(buf);
+
+				if (slot.compare_exchange_strong(item, tmp, memory_order_acq_rel, memory_order_acquire)) return tmp;
+
+				delete tmp;
+			}
+
+			if (strcmp(item->name, buf) == 0) return item;
+		}
+
+		return &other;
+	}
+
+	// 记录命令的负数返回值。键不存在等空值应答是正常结果，只计入 misses，
+	// 以免读多的业务错误率虚高；返回值表示是否计为错误
+	bool error(int code) {
+		if (code == NOTFOUND) {
+			misses.fetch_add(1, memory_order_relaxed);
+
+			return false;
+		}
+
+		errors[code < 0 && code > -ERROR_COUNT ? -code : 0].fetch_add(1, memory_order_relaxed);
+
+		return true;
+	}
+
+	void send(long long bytes) {
+		sent.fetch_add(bytes, memory_order_relaxed);
+	}
+
+	void receive(long long bytes) {
+		received.fetch_add(bytes, memory_order_relaxed);
+	}
+
+	// 记录建立连接的耗时（微秒）
+	void recordConnect(long long usec) {
+		connect.record(usec);
+	}
+
+	// 记录从连接池获取连接的等待时间（微秒）
+	void recordWait(long long usec) {
+		wait.record(usec);
+	}
+
+	Snapshot snapshot() {
+		Snapshot res;
+
+		res.sent = sent.load(memory_order_relaxed);
+		res.received = received.load(memory_order_relaxed);
+		res.misses = misses.load(memory_order_relaxed);
+		res.connect = connect.snapshot();
+		res.wait = wait.snapshot();
+
+		for (int i = 1; i < ERROR_COUNT; i++) {
+			long long num = errors[i].load(memory_order_relaxed);
+
+			if (num > 0) res.errors[GetCodeName(-i)] = num;
+		}
+
+		if (errors[0].load(memory_order_relaxed) > 0) res.errors["OTHER"] = errors[0].load(memory_order_relaxed);
+
+		auto add = [&](Command* item) {
+			CommandSnapshot data;
+
+			data.name = item->name;
+			data.calls = item->calls.load(memory_order_relaxed);
+			data.errors = item->errors.load(memory_order_relaxed);
+
+			if (data.calls <= 0) return;
+
+			data.write = item->write.snapshot();
+			data.ttfb = item->ttfb.snapshot();
+			data.reply = item->reply.snapshot();
+
+			res.cmds.push_back(data);
+		};
+
+		for (auto& item : table) {
+			Command* cmd = item.load(memory_order_acquire);
+
+			if (cmd) add(cmd);
+		}
+
+		add(&other);
+
+		std::sort(res.cmds.begin(), res.cmds.end(), [](const CommandSnapshot& a, const CommandSnapshot& b) {
+			return a.name < b.name;
+		});
+
+		Collect(res);
+
+		return res;
+	}
+
+	// 清空统计数据，已出现的命令名称保留
+	void reset() {
+		sent.store(0, memory_order_relaxed);
+		received.store(0, memory_order_relaxed);
+		misses.store(0, memory_order_relaxed);
+
+		for (auto& item : errors) item.store(0, memory_order_relaxed);
+
+		connect.reset();
+		wait.reset();
+
+		auto clear = [](Command* item) {
+			item->calls.store(0, memory_order_relaxed);
+			item->errors.store(0, memory_order_relaxed);
+			item->write.reset();
+			item->ttfb.reset();
+			item->reply.reset();
+		};
+
+		for (auto& item : table) {
+			Command* cmd = item.load(memory_order_acquire);
+
+			if (cmd) clear(cmd);
+		}
+
+		clear(&other);
+	}
+
+	// 以 Prometheus 文本格式输出统计数据，时间单位为秒
+	static string ToPrometheus(const Snapshot& data) {
+		string out;
+		string name;
+
+		Header(out, name = "redis_client_sent_bytes_total", "counter", "Bytes written to redis servers.");
+		Append(out, name, "", data.sent);
+
+		Header(out, name = "redis_client_received_bytes_total", "counter", "Bytes read from redis servers.");
+		Append(out, name, "", data.received);
+
+		Header(out, name = "redis_client_errors_total", "counter", "Commands finished with a negative return code other than NOTFOUND.");
+
+		for (auto& item : data.errors) Append(out, name, "code=\"" + item.first + "\"", item.second);
+
+		Header(out, name = "redis_client_misses_total", "counter", "Commands answered with a nil reply (NOTFOUND).");
+		Append(out, name, "", data.misses);
+
+		Header(out, name = "redis_client_connect_seconds", "summary", "Time to establish a connection.");
+		Summary(out, name, "", data.connect);
+
+		Header(out, name = "redis_client_pool_wait_seconds", "summary", "Time to check a connection out of a pool.");
+		Summary(out, name, "", data.wait);
+
+		Header(out, name = "redis_client_command_calls_total", "counter", "Commands executed.");
+
+		for (auto& item : data.cmds) Append(out, name, "command=\"" + Escape(item.name) + "\"", item.calls);
+
+		Header(out, name = "redis_client_command_errors_total", "counter", "Commands finished with a negative return code other than NOTFOUND.");
+
+		for (auto& item : data.cmds) Append(out, name, "command=\"" + Escape(item.name) + "\"", item.errors);
+
+		Header(out, name = "redis_client_command_write_seconds", "summary", "Time to write a request.");
+
+		for (auto& item : data.cmds) Summary(out, name, "command=\"" + Escape(item.name) + "\"", item.write);
+
+		Header(out, name = "redis_client_command_ttfb_seconds", "summary", "Time from the request to the first reply byte.");
+
+		for (auto& item : data.cmds) Summary(out, name, "command=\"" + Escape(item.name) + "\"", item.ttfb);
+
+		Header(out, name = "redis_client_command_duration_seconds", "summary", "Time from the request to the complete reply.");
+
+		for (auto& item : data.cmds) Summary(out, name, "command=\"" + Escape(item.name) + "\"", item.reply);
+
+		if (data.pools.empty()) return out;
+
+		Header(out, name = "redis_client_pool_connections", "gauge", "Connections of a pool by state.");
+
+		for (auto& item : data.pools) {
+			string label = "pool=\"" + Escape(item.name) + "\"";
+
+			Append(out, name, label + ",state=\"used\"", (long long)(item.used));
+			Append(out, name, label + ",state=\"max\"", (long long)(item.length));
+		}
+
+		Header(out, name = "redis_client_pool_grasps_total", "counter", "Connection checkouts.");
+
+		for (auto& item : data.pools) Append(out, name, "pool=\"" + Escape(item.name) + "\"", item.grasps);
+
+		Header(out, name = "redis_client_pool_grasp_failures_total", "counter", "Connection checkouts that returned no connection.");
+
+		for (auto& item : data.pools) Append(out, name, "pool=\"" + Escape(item.name) + "\"", item.fails);
+
+		Header(out, name = "redis_client_pool_connects_total", "counter", "Connections opened.");
+
+		for (auto& item : data.pools) Append(out, name, "pool=\"" + Escape(item.name) + "\"", item.connects);
+
+		Header(out, name = "redis_client_pool_connect_errors_total", "counter", "Connections that failed to open.");
+
+		for (auto& item : data.pools) Append(out, name, "pool=\"" + Escape(item.name) + "\"", item.errors);
+
+		Header(out, name = "redis_client_pool_waits_total", "counter", "Checkouts that had to wait for a free connection.");
+
+		for (auto& item : data.pools) Append(out, name, "pool=\"" + Escape(item.name) + "\"", item.waits);
+
+		Header(out, name = "redis_client_pool_wait_time_seconds_total", "counter", "Total time spent waiting for a free connection.");
+
+		for (auto& item : data.pools) Append(out, name, "pool=\"" + Escape(item.name) + "\"", item.waittime / 1e6);
+
+		Header(out, name = "redis_client_pool_rtt_seconds", "gauge", "Moving average of the command round trip time.");
+
+		for (auto& item : data.pools) Append(out, name, "pool=\"" + Escape(item.name) + "\"", item.rtt / 1e6);
+
+		return out;
+	}
+
+	string toPrometheus() {
+		return ToPrometheus(snapshot());
+	}
+};
+
+#endif
@@ -0,0 +1,1468 @@
+#ifndef REDIS_MOCK_H
+#define REDIS_MOCK_H
+///////////////////////////////////////////////////////////////
+#include "RedisCluster.h"
+
+#include <set>
+#include <list>
+#include <unordered_map>
+#include <unordered_set>
+
+#ifdef XG_LINUX
+#include <netinet/tcp.h>
+#endif
+
+// 进程内的 RESP 模拟服务器，用于在没有 Redis 的环境中测量客户端的解析和连接池性能，
+// 以及回归测试。支持字符串、哈希、集合、有序集合的常用命令、SCAN 游标遍历和过期时间，
+// 命令在一把全局锁内串行执行，与 Redis 的单线程语义一致；每个连接由独立的线程读取请求，
+// 同一批到达的多条请求（管道）的应答合并为一次写入。
+// EVAL 不执行 Lua，而是按脚本原文查找通过 setScript 注册的处理函数。
+// 支持 SUBSCRIBE/UNSUBSCRIBE/PUBLISH，订阅状态下的连接仍然可以执行其它命令。
+// 支持 HELLO 3 和广播模式的 CLIENT TRACKING：写命令执行成功后向前缀匹配的跟踪连接推送失效消息，
+// FLUSHALL/FLUSHDB 推送空值，用于测试客户端本地缓存。
+// 通过 addSlots 设置槽位表后进入集群模式：支持 CLUSTER SLOTS，不属于本节点的键返回 MOVED，
+// 迁移中的槽位返回 ASK，导入中的槽位接受 ASKING 之后的一条命令，用于测试集群客户端。
+class RedisMock {
+public:
+	// 脚本处理函数，返回 RESP 格式的应答。在全局锁内执行，可以调用 call 执行其它命令
+	typedef function<string(RedisMock* mock, const vector<string>& keys, const vector<string>& args)> Script;
+
+protected:
+	typedef chrono::steady_clock Clock;
+
+	// 一个键的数据，type 为 0 时表示字符串
+	struct Entry {
+		int type = 0;
+		string str;
+		long long expire = 0; // 过期时间（毫秒），0表示不过期
+		unordered_map<string, string> hash;
+		unordered_set<string> members; // 集合成员
+		map<string, double> score; // 有序集合成员的分数
+		set<pair<double, string>> zset; // 按分数排序的有序集合成员
+	};
+
+	// 一个客户端连接
+	struct Client {
+		SOCKET sock;
+		thread worker;
+		mutex wmtx; // 发布消息的线程与连接自身的线程都会写入套接字
+		atomic<bool> closed;
+		bool asking = false; // 上一条命令是否为 ASKING
+
+		Client(SOCKET sock) : sock(sock), closed(false) {}
+	};
+
+	enum {
+		STRING = 0,
+		HASH = 1,
+		ZSET = 2,
+		SET = 3
+	};
+
+	int port = 0;
+	atomic<int> delay; // 每批应答发送前的延迟微秒数，可以在服务过程中修改
+	SOCKET sock = INVALID_SOCKET;
+	thread acceptor;
+	atomic<bool> running;
+
+	mutex cmtx; // 保护 clients
+	list<unique_ptr<Client>> clients;
+
+	mutex dbmtx; // 保护以下全部数据
+	unordered_map<string, Entry> db;
+	map<string, Script> scripts;
+	map<string, set<Client*>> channels; // 各频道的订阅者
+	map<Client*, vector<string>> tracking; // 开启广播跟踪的连接和键前缀，前缀为空时跟踪全部键
+	map<int, pair<int, int>> ranges; // 集群槽位表，起始槽位到结束槽位和负责节点端口
+	map<int, int> migrating; // 正在迁出的槽位和目标节点端口
+	set<int> importing; // 正在导入的槽位
+	set<string> disabled; // 按未知命令处理的命令
+	atomic<long long> cmds; // 执行的命令数
+
+	static long long Now() {
+		return chrono::duration_cast<chrono::milliseconds>(Clock::now().time_since_epoch()).count();
+	}
+
+	static void Shutdown(SOCKET sock) {
+#ifdef XG_LINUX
+		::shutdown(sock, SHUT_RDWR);
+#else
+		::shutdown(sock, SD_BOTH);
+#endif
+	}
+
+	static bool Equal(const string& a, const char* b) {
+		return strcasecmp(a.c_str(), b) == 0;
+	}
+
+	static bool ToInteger(const string& str, long long& val) {
+		char* end = NULL;
+
+		if (str.empty()) return false;
+
+		val = strtoll(str.c_str(), &end, 10);
+
+		return *end == 0;
+	}
+
+	static bool ToDouble(const string& str, double& val) {
+		char* end = NULL;
+
+		if (str.empty()) return false;
+
+		val = strtod(str.c_str(), &end);
+
+		return *end == 0;
+	}
+
+	static string ToString(double val) {
+		char buf[64];
+
+		snprintf(buf, sizeof(buf), "%.17g", val);
+
+		return buf;
+	}
+
+	// 按 Redis 的规则匹配通配符：* ? [abc] [^a-z] 和 \ 转义
+	static bool Match(const char* pattern, const char* str) {
+		while (*pattern) {
+			switch (*pattern) {
+			case '*':
+				while (pattern[1] == '*') pattern++;
+
+				if (pattern[1] == 0) return true;
+
+				for (; *str; str++) {
+					if (Match(pattern + 1, str)) return true;
+				}
+
+				return false;
+			case '?':
+				if (*str == 0) return false;
+
+				str++;
+				break;
+			case '[': {
+				bool neg = pattern[1] == '^';
+				bool found = false;
+
+				if (*str == 0) return false;
+
+				for (pattern += neg ? 2 : 1; *pattern && *pattern != ']'; pattern++) {
+					if (*pattern == '\\' && pattern[1]) {
+						if (*++pattern == *str) found = true;
+					}
+					else if (pattern[1] == '-' && pattern[2] && pattern[2] != ']') {
+						if (*str >= pattern[0] && *str <= pattern[2]) found = true;
+
+						pattern += 2;
+					}
+					else if (*pattern == *str) {
+						found = true;
+					}
+				}
+
+				if (found == neg) return false;
+
+				if (*pattern == 0) return true;
+
+				str++;
+				break;
+			}
+			case '\\':
+				if (pattern[1]) pattern++;
+				// fall through - 转义后的字符按普通字符比较
+			default:
+				if (*pattern != *str) return false;
+
+				str++;
+				break;
+			}
+
+			pattern++;
+		}
+
+		return *str == 0;
+	}
+
+	// 解析一条请求，支持 RESP 数组和以空格分隔的内联命令。
+	// 数据不完整时返回0，格式错误时返回-1，否则返回请求的长度
+	static int Parse(const char* data, int len, vector<string>& args) {
+		const char* end = data + len;
+		const char* line = (const char*)(memchr(data, '\n', len));
+
+		args.clear();
+
+		if (line == NULL) return len > 64 * 1024 ? -1 : 0;
+
+		if (*data != '*') {
+			const char* str = data;
+
+			while (str < line) {
+				while (str < line && (*str == ' ' || *str == '\r')) str++;
+
+				const char* tmp = str;
+
+				while (str < line && *str != ' ' && *str != '\r') str++;
+
+				if (str > tmp) args.push_back(string(tmp, str));
+			}
+
+			return line + 1 - data;
+		}
+
+		long long cnt = atoll(data + 1);
+		const char* str = line + 1;
+
+		if (cnt < 0 || cnt > 1024 * 1024) return -1;
+
+		for (long long i = 0; i < cnt; i++) {
+			if (str >= end) return 0;
+
+			if (*str != '$') return -1;
+
+			if ((line = (const char*)(memchr(str, '\n', end - str))) == NULL) return 0;
+
+			long long sz = atoll(str + 1);
+
+			if (sz < 0 || sz > 512 * 1024 * 1024) return -1;
+
+			str = line + 1;
+
+			if (end - str < sz + 2) return 0;
+
+			args.push_back(string(str, sz));
+			str += sz + 2;
+		}
+
+		return str - data;
+	}
+
+	// 查找未过期的键，type 不匹配时 wrong 为 true
+	Entry* find(const string& key, int type, bool& wrong) {
+		auto it = db.find(key);
+
+		wrong = false;
+
+		if (it == db.end()) return NULL;
+
+		if (it->second.expire > 0 && it->second.expire <= Now()) {
+			db.erase(it);
+
+			return NULL;
+		}
+
+		if (it->second.type != type) {
+			wrong = true;
+
+			return NULL;
+		}
+
+		return &it->second;
+	}
+
+	// 查找或创建指定类型的键，类型不匹配时返回 NULL
+	Entry* fetch(const string& key, int type) {
+		bool wrong = false;
+		Entry* item = find(key, type, wrong);
+
+		if (wrong) return NULL;
+
+		if (item) return item;
+
+		item = &db[key];
+		item->type = type;
+
+		return item;
+	}
+
+	bool exists(const string& key) {
+		bool wrong = false;
+
+		return find(key, STRING, wrong) || wrong;
+	}
+
+	void zinsert(Entry& item, const string& member, double score) {
+		auto it = item.score.find(member);
+
+		if (it != item.score.end()) {
+			item.zset.erase(make_pair(it->second, member));
+			it->second = score;
+		}
+		else {
+			item.score[member] = score;
+		}
+
+		item.zset.insert(make_pair(score, member));
+	}
+
+	// DUMP 的数据格式只在模拟服务器内部使用：类型、元素个数，之后为长度前缀的字符串，
+	// 有序集合的分数以文本形式保存
+	static string Serialize(const Entry& item) {
+		vector<string> vec;
+		string res = "MOCK" + to_string(item.type);
+
+		if (item.type == STRING) vec.push_back(item.str);
+
+		for (auto& elem : item.hash) vec.insert(vec.end(), {elem.first, elem.second});
+
+		for (auto& elem : item.members) vec.push_back(elem);
+
+		for (auto& elem : item.score) vec.insert(vec.end(), {elem.first, ToString(elem.second)});
+
+		for (const string& elem : vec) res += to_string(elem.length()) + ":" + elem;
+
+		return res;
+	}
+
+	static bool Deserialize(const string& data, Entry& item) {
+		vector<string> vec;
+		size_t pos = 5;
+
+		if (data.length() < pos || data.compare(0, 4, "MOCK") != 0 || data[4] < '0' || data[4] > '3') return false;
+
+		while (pos < data.length()) {
+			size_t end = data.find(':', pos);
+			long long len = 0;
+
+			if (end == string::npos || !ToInteger(data.substr(pos, end - pos), len) || len < 0 || end + 1 + len > data.length()) return false;
+
+			vec.push_back(data.substr(end + 1, len));
+			pos = end + 1 + len;
+		}
+
+		item = Entry();
+		item.type = data[4] - '0';
+
+		if (item.type == STRING) {
+			if (vec.size() != 1) return false;
+
+			item.str = vec[0];
+		}
+		else if (item.type == SET) {
+			item.members.insert(vec.begin(), vec.end());
+		}
+		else {
+			if (vec.size() % 2) return false;
+
+			for (size_t i = 0; i < vec.size(); i += 2) {
+				double score = 0;
+
+				if (item.type == HASH) {
+					item.hash[vec[i]] = vec[i + 1];
+				}
+				else if (ToDouble(vec[i + 1], score)) {
+					item.score[vec[i]] = score;
+					item.zset.insert(make_pair(score, vec[i]));
+				}
+				else {
+					return false;
+				}
+			}
+		}
+
+		return true;
+	}
+
+	// SCAN 类命令按元素名称的哈希值顺序遍历，游标为下一个元素的哈希值，
+	// 遍历期间增删其它元素不会影响已返回和未返回元素的位置，与 Redis 的保证相同
+	static unsigned long long GetScanHash(const string& name) {
+		return (std::hash<string>()(name) >> 2) + 1;
+	}
+
+	// 从 names 中取出哈希值不小于 cursor 的 count 个元素（哈希值相同的元素一并取出），
+	// 与 Redis 一样先取出再按 pattern 过滤，因此一批结果可能为空。返回下一批的游标，遍历结束时返回0
+	static unsigned long long ScanBatch(vector<pair<unsigned long long, string>>& names, unsigned long long cursor, const string& pattern, long long count, vector<string>& res) {
+		long long num = 0;
+
+		std::sort(names.begin(), names.end());
+
+		auto it = std::lower_bound(names.begin(), names.end(), make_pair(cursor, string()));
+
+		for (; it != names.end(); ++it, ++num) {
+			if (num >= count && it->first != (it - 1)->first) return it->first;
+
+			if (Match(pattern.c_str(), it->second.c_str())) res.push_back(it->second);
+		}
+
+		return 0;
+	}
+
+	static bool Send(Client* client, const string& msg) {
+		int len = 0;
+		lock_guard<mutex> lk(client->wmtx);
+
+		for (size_t sent = 0; sent < msg.length(); sent += len) {
+			if ((len = ::send(client->sock, msg.c_str() + sent, msg.length() - sent, 0)) <= 0) return false;
+		}
+
+		return true;
+	}
+
+	// 订阅或取消订阅频道，UNSUBSCRIBE 不带参数时取消全部订阅，调用前需持有 dbmtx
+	string subscribe(Client* client, const vector<string>& args) {
+		string res;
+		vector<string> names(args.begin() + 1, args.end());
+		const bool add = Equal(args[0], "subscribe");
+
+		if (add && names.empty()) return Error("ERR wrong number of arguments for 'subscribe' command");
+
+		if (names.empty()) {
+			for (auto& item : channels) {
+				if (item.second.count(client)) names.push_back(item.first);
+			}
+		}
+
+		for (const string& name : names) {
+			if (add) {
+				channels[name].insert(client);
+			}
+			else if (channels.count(name)) {
+				channels[name].erase(client);
+
+				if (channels[name].empty()) channels.erase(name);
+			}
+
+			long long cnt = 0;
+
+			for (auto& item : channels) cnt += item.second.count(client);
+
+			res += Array(3) + Bulk(add ? "subscribe" : "unsubscribe") + Bulk(name) + Integer(cnt);
+		}
+
+		return res;
+	}
+
+	// 开启或关闭广播模式的键跟踪，只支持 CLIENT TRACKING ON|OFF [BCAST] [PREFIX 前缀]...，调用前需持有 dbmtx
+	string track(Client* client, const vector<string>& args) {
+		if (args.size() < 3 || !Equal(args[1], "tracking")) return Error("ERR unknown subcommand");
+
+		if (Equal(args[2], "off")) {
+			tracking.erase(client);
+
+			return Status("OK");
+		}
+
+		vector<string> prefixes;
+
+		for (size_t i = 3; i < args.size(); i++) {
+			if (Equal(args[i], "prefix") && i + 1 < args.size()) {
+				prefixes.push_back(args[++i]);
+			}
+			else if (!Equal(args[i], "bcast")) {
+				return Error("ERR syntax error");
+			}
+		}
+
+		if (!Equal(args[2], "on")) return Error("ERR syntax error");
+
+		tracking[client] = prefixes;
+
+		return Status("OK");
+	}
+
+	// 写命令执行成功后向跟踪连接推送失效消息，调用前需持有 dbmtx
+	void invalidate(const vector<string>& args, const string& res) {
+		if (tracking.empty() || res.empty() || res[0] == '-' || RedisConnect::IsReadOnly(args[0])) return;
+
+		vector<string> keys;
+		const string& name = args[0];
+		const bool flush = Equal(name, "flushall") || Equal(name, "flushdb");
+
+		if (Equal(name, "del") || Equal(name, "unlink")) {
+			keys.assign(args.begin() + 1, args.end());
+		}
+		else if (Equal(name, "mset") || Equal(name, "msetnx")) {
+			for (size_t i = 1; i < args.size(); i += 2) keys.push_back(args[i]);
+		}
+		else if (!flush && GetKey(args)) {
+			keys.push_back(*GetKey(args));
+		}
+
+		if (keys.empty() && !flush) return;
+
+		for (auto& item : tracking) {
+			string msg;
+			vector<string> vec;
+
+			for (const string& key : keys) {
+				bool matched = item.second.empty();
+
+				for (const string& prefix : item.second) matched = matched || key.compare(0, prefix.length(), prefix) == 0;
+
+				if (matched) vec.push_back(key);
+			}
+
+			if (flush) {
+				msg = Nil();
+			}
+			else if (vec.empty()) {
+				continue;
+			}
+			else {
+				msg = Array(vec.size());
+
+				for (const string& key : vec) msg += Bulk(key);
+			}
+
+			Send(item.first, ">2\r\n" + Bulk("invalidate") + msg);
+		}
+	}
+
+	// 获取命令的第一个键，没有键的命令返回 NULL
+	static const string* GetKey(const vector<string>& args) {
+		static const char* names[] = {"ping", "echo", "auth", "select", "quit", "flushall", "flushdb", "dbsize", "keys", "scan", "publish", "cluster", "asking"};
+		const string& name = args[0];
+
+		for (const char* item : names) {
+			if (Equal(name, item)) return NULL;
+		}
+
+		if (Equal(name, "eval")) return args.size() > 3 && atoi(args[2].c_str()) > 0 ? &args[3] : NULL;
+
+		return args.size() > 1 ? &args[1] : NULL;
+	}
+
+	// 集群模式下检查命令的键是否由本节点负责，需要重定向时返回 MOVED 或 ASK 错误，
+	// 可以在本节点执行时返回空字符串，调用前需持有 dbmtx
+	string route(const vector<string>& args, bool asking) {
+		const string* key = GetKey(args);
+
+		if (ranges.empty() || key == NULL) return string();
+
+		int slot = RedisClusterConnect::GetSlot(*key);
+		auto it = ranges.upper_bound(slot);
+		int owner = it == ranges.begin() || slot > (--it)->second.first ? 0 : it->second.second;
+
+		if (asking && importing.count(slot)) return string();
+
+		if (owner != port) return Error("MOVED " + to_string(slot) + " 127.0.0.1:" + to_string(owner));
+
+		auto item = migrating.find(slot);
+
+		if (item != migrating.end() && !exists(*key)) return Error("ASK " + to_string(slot) + " 127.0.0.1:" + to_string(item->second));
+
+		return string();
+	}
+
+	// 执行一条命令，调用前需持有 dbmtx
+	string exec(const vector<string>& args) {
+		static const string wrongtype = Error("WRONGTYPE Operation against a key holding the wrong kind of value");
+		static const string syntax = Error("ERR syntax error");
+
+		bool wrong = false;
+		const string& name = args[0];
+		const size_t argc = args.size();
+
+		for (const string& item : disabled) {
+			if (Equal(name, item.c_str())) return Error("ERR unknown command '" + name + "'");
+		}
+
+		cmds++;
+
+		auto arity = [&]() {
+			return Error("ERR wrong number of arguments for '" + name + "' command");
+		};
+
+		if (Equal(name, "ping")) return argc > 1 ? Bulk(args[1]) : Status("PONG");
+
+		if (Equal(name, "echo")) return argc == 2 ? Bulk(args[1]) : arity();
+
+		if (Equal(name, "auth") || Equal(name, "select") || Equal(name, "quit")) return Status("OK");
+
+		if (Equal(name, "flushall") || Equal(name, "flushdb")) {
+			db.clear();
+
+			return Status("OK");
+		}
+
+		if (Equal(name, "dbsize")) return Integer(db.size());
+
+		if (Equal(name, "cluster")) {
+			if (argc != 2 || !Equal(args[1], "slots")) return Error("ERR unknown subcommand");
+
+			if (ranges.empty()) return Error("ERR This instance has cluster support disabled");
+
+			string res = Array(ranges.size());
+
+			for (auto& item : ranges) {
+				res += Array(3) + Integer(item.first) + Integer(item.second.first);
+				res += Array(3) + Bulk("127.0.0.1") + Integer(item.second.second) + Bulk(to_string(item.second.second));
+			}
+
+			return res;
+		}
+
+		if (Equal(name, "get")) {
+			if (argc != 2) return arity();
+
+			Entry* item = find(args[1], STRING, wrong);
+
+			return wrong ? wrongtype : item ? Bulk(item->str) : Nil();
+		}
+
+		if (Equal(name, "set") || Equal(name, "setex") || Equal(name, "psetex")) {
+			int flag = 0;
+			long long ttl = 0;
+			size_t pos = 3;
+
+			if (Equal(name, "set")) {
+				if (argc < 3) return arity();
+			}
+			else {
+				if (argc != 4) return arity();
+
+				if (!ToInteger(args[2], ttl) || ttl <= 0) return Error("ERR invalid expire time");
+
+				if (Equal(name, "setex")) ttl *= 1000;
+
+				vector<string> tmp = {"set", args[1], args[3], "px", to_string(ttl)};
+
+				cmds--;
+
+				return exec(tmp);
+			}
+
+			for (; pos < argc; pos++) {
+				if (Equal(args[pos], "nx")) {
+					flag = 1;
+				}
+				else if (Equal(args[pos], "xx")) {
+					flag = 2;
+				}
+				else if ((Equal(args[pos], "ex") || Equal(args[pos], "px")) && pos + 1 < argc) {
+					if (!ToInteger(args[pos + 1], ttl) || ttl <= 0) return Error("ERR invalid expire time");
+
+					if (Equal(args[pos++], "ex")) ttl *= 1000;
+				}
+				else {
+					return syntax;
+				}
+			}
+
+			bool found = exists(args[1]);
+
+			if ((flag == 1 && found) || (flag == 2 && !found)) return Nil();
+
+			Entry& item = db[args[1]];
+
+			item = Entry();
+			item.str = args[2];
+			item.expire = ttl > 0 ? Now() + ttl : 0;
+
+			return Status("OK");
+		}
+
+		if (Equal(name, "del") || Equal(name, "unlink")) {
+			long long num = 0;
+
+			if (argc < 2) return arity();
+
+			for (size_t i = 1; i < argc; i++) {
+				if (exists(args[i])) {
+					db.erase(args[i]);
+					num++;
+				}
+			}
+
+			return Integer(num);
+		}
+
+		if (Equal(name, "exists")) {
+			long long num = 0;
+
+			for (size_t i = 1; i < argc; i++) {
+				if (exists(args[i])) num++;
+			}
+
+			return Integer(num);
+		}
+
+		if (Equal(name, "expire") || Equal(name, "pexpire")) {
+			long long ttl = 0;
+
+			if (argc != 3) return arity();
+
+			if (!ToInteger(args[2], ttl)) return Error("ERR value is not an integer or out of range");
+
+			if (!exists(args[1])) return Integer(0);
+
+			if (Equal(name, "expire")) ttl *= 1000;
+
+			if (ttl <= 0) {
+				db.erase(args[1]);
+			}
+			else {
+				db[args[1]].expire = Now() + ttl;
+			}
+
+			return Integer(1);
+		}
+
+		if (Equal(name, "ttl") || Equal(name, "pttl")) {
+			if (argc != 2) return arity();
+
+			if (!exists(args[1])) return Integer(-2);
+
+			long long expire = db[args[1]].expire;
+
+			if (expire == 0) return Integer(-1);
+
+			expire -= Now();
+
+			return Integer(Equal(name, "ttl") ? (expire + 999) / 1000 : expire);
+		}
+
+		if (Equal(name, "dump")) {
+			if (argc != 2) return arity();
+
+			if (!exists(args[1])) return Nil();
+
+			return Bulk(Serialize(db[args[1]]));
+		}
+
+		if (Equal(name, "restore")) {
+			Entry item;
+			long long ttl = 0;
+
+			if (argc < 4) return arity();
+
+			if (!ToInteger(args[2], ttl) || ttl < 0) return Error("ERR Invalid TTL value, must be >= 0");
+
+			if (argc > 5 || (argc == 5 && !Equal(args[4], "replace"))) return syntax;
+
+			if (argc == 4 && exists(args[1])) return Error("BUSYKEY Target key name already exists.");
+
+			if (!Deserialize(args[3], item)) return Error("ERR DUMP payload version or checksum are wrong");
+
+			item.expire = ttl > 0 ? Now() + ttl : 0;
+			db[args[1]] = item;
+
+			return Status("OK");
+		}
+
+		if (Equal(name, "incr") || Equal(name, "decr") || Equal(name, "incrby") || Equal(name, "decrby")) {
+			long long val = 0;
+			long long step = 1;
+
+			if (argc != (name.length() > 4 ? 3 : 2)) return arity();
+
+			if (argc == 3 && !ToInteger(args[2], step)) return Error("ERR value is not an integer or out of range");
+
+			if (tolower(name[0]) == 'd') step = -step;
+
+			Entry* item = fetch(args[1], STRING);
+
+			if (item == NULL) return wrongtype;
+
+			if (item->str.length() > 0 && !ToInteger(item->str, val)) return Error("ERR value is not an integer or out of range");
+
+			item->str = to_string(val += step);
+
+			return Integer(val);
+		}
+
+		if (Equal(name, "mget")) {
+			string res = Array(argc - 1);
+
+			for (size_t i = 1; i < argc; i++) {
+				Entry* item = find(args[i], STRING, wrong);
+
+				res += item ? Bulk(item->str) : Nil();
+			}
+
+			return res;
+		}
+
+		if (Equal(name, "mset")) {
+			if (argc < 3 || argc % 2 == 0) return arity();
+
+			for (size_t i = 1; i < argc; i += 2) {
+				Entry& item = db[args[i]];
+
+				item = Entry();
+				item.str = args[i + 1];
+			}
+
+			return Status("OK");
+		}
+
+		if (Equal(name, "keys")) {
+			vector<string> vec;
+			long long now = Now();
+
+			if (argc != 2) return arity();
+
+			for (auto& item : db) {
+				if ((item.second.expire == 0 || item.second.expire > now) && Match(args[1].c_str(), item.first.c_str())) vec.push_back(item.first);
+			}
+
+			string res = Array(vec.size());
+
+			for (const string& item : vec) res += Bulk(item);
+
+			return res;
+		}
+
+		if (Equal(name, "scan") || Equal(name, "hscan") || Equal(name, "sscan") || Equal(name, "zscan")) {
+			long long count = 10;
+			long long cursor = 0;
+			string pattern = "*";
+			vector<string> vec;
+			Entry* item = NULL;
+			vector<pair<unsigned long long, string>> names;
+			const bool all = Equal(name, "scan");
+			size_t pos = all ? 1 : 2;
+
+			if (argc <= pos) return arity();
+
+			if (!ToInteger(args[pos], cursor) || cursor < 0) return Error("ERR invalid cursor");
+
+			for (pos++; pos < argc; pos += 2) {
+				if (pos + 1 >= argc) return syntax;
+
+				if (Equal(args[pos], "match")) {
+					pattern = args[pos + 1];
+				}
+				else if (Equal(args[pos], "count")) {
+					if (!ToInteger(args[pos + 1], count) || count < 1) return syntax;
+				}
+				else if (!all || !Equal(args[pos], "type")) {
+					return syntax;
+				}
+			}
+
+			if (all) {
+				long long now = Now();
+
+				for (auto& elem : db) {
+					if (elem.second.expire == 0 || elem.second.expire > now) names.push_back(make_pair(GetScanHash(elem.first), elem.first));
+				}
+			}
+			else {
+				int type = Equal(name, "hscan") ? HASH : Equal(name, "sscan") ? SET : ZSET;
+
+				item = find(args[1], type, wrong);
+
+				if (wrong) return wrongtype;
+
+				if (item && type == HASH) for (auto& elem : item->hash) names.push_back(make_pair(GetScanHash(elem.first), elem.first));
+
+				if (item && type == SET) for (auto& elem : item->members) names.push_back(make_pair(GetScanHash(elem), elem));
+
+				if (item && type == ZSET) for (auto& elem : item->score) names.push_back(make_pair(GetScanHash(elem.first), elem.first));
+			}
+
+			cursor = (long long)(ScanBatch(names, cursor, pattern, count, vec));
+
+			// HSCAN 和 ZSCAN 的每个元素后面跟随字段值或分数
+			bool withval = item && item->type != SET;
+			string res = Array(2) + Bulk(to_string(cursor)) + Array(vec.size() * (withval ? 2 : 1));
+
+			for (const string& elem : vec) {
+				res += Bulk(elem);
+
+				if (withval) res += Bulk(item->type == HASH ? item->hash[elem] : ToString(item->score[elem]));
+			}
+
+			return res;
+		}
+
+		if (Equal(name, "hset") || Equal(name, "hmset")) {
+			long long num = 0;
+
+			if (argc < 4 || argc % 2 == 1) return arity();
+
+			Entry* item = fetch(args[1], HASH);
+
+			if (item == NULL) return wrongtype;
+
+			for (size_t i = 2; i < argc; i += 2) {
+				if (item->hash.insert(make_pair(args[i], args[i + 1])).second) {
+					num++;
+				}
+				else {
+					item->hash[args[i]] = args[i + 1];
+				}
+			}
+
+			return Equal(name, "hset") ? Integer(num) : Status("OK");
+		}
+
+		if (Equal(name, "hget")) {
+			if (argc != 3) return arity();
+
+			Entry* item = find(args[1], HASH, wrong);
+
+			if (wrong) return wrongtype;
+
+			if (item == NULL) return Nil();
+
+			auto it = item->hash.find(args[2]);
+
+			return it == item->hash.end() ? Nil() : Bulk(it->second);
+		}
+
+		if (Equal(name, "hdel")) {
+			long long num = 0;
+
+			if (argc < 3) return arity();
+
+			Entry* item = find(args[1], HASH, wrong);
+
+			if (wrong) return wrongtype;
+
+			if (item == NULL) return Integer(0);
+
+			for (size_t i = 2; i < argc; i++) num += item->hash.erase(args[i]);
+
+			if (item->hash.empty()) db.erase(args[1]);
+
+			return Integer(num);
+		}
+
+		if (Equal(name, "hlen")) {
+			if (argc != 2) return arity();
+
+			Entry* item = find(args[1], HASH, wrong);
+
+			return wrong ? wrongtype : Integer(item ? item->hash.size() : 0);
+		}
+
+		if (Equal(name, "hgetall")) {
+			if (argc != 2) return arity();
+
+			Entry* item = find(args[1], HASH, wrong);
+
+			if (wrong) return wrongtype;
+
+			if (item == NULL) return Array(0);
+
+			string res = Array(item->hash.size() * 2);
+
+			for (auto& field : item->hash) res += Bulk(field.first) + Bulk(field.second);
+
+			return res;
+		}
+
+		if (Equal(name, "zadd")) {
+			long long num = 0;
+
+			if (argc < 4 || argc % 2 == 1) return arity();
+
+			for (size_t i = 2; i < argc; i += 2) {
+				double score = 0;
+
+				if (!ToDouble(args[i], score)) return Error("ERR value is not a valid float");
+			}
+
+			Entry* item = fetch(args[1], ZSET);
+
+			if (item == NULL) return wrongtype;
+
+			for (size_t i = 2; i < argc; i += 2) {
+				double score = 0;
+
+				ToDouble(args[i], score);
+
+				if (item->score.find(args[i + 1]) == item->score.end()) num++;
+
+				zinsert(*item, args[i + 1], score);
+			}
+
+			return Integer(num);
+		}
+
+		if (Equal(name, "zrem")) {
+			long long num = 0;
+
+			if (argc < 3) return arity();
+
+			Entry* item = find(args[1], ZSET, wrong);
+
+			if (wrong) return wrongtype;
+
+			if (item == NULL) return Integer(0);
+
+			for (size_t i = 2; i < argc; i++) {
+				auto it = item->score.find(args[i]);
+
+				if (it == item->score.end()) continue;
+
+				item->zset.erase(make_pair(it->second, args[i]));
+				item->score.erase(it);
+				num++;
+			}
+
+			if (item->score.empty()) db.erase(args[1]);
+
+			return Integer(num);
+		}
+
+		if (Equal(name, "zcard")) {
+			if (argc != 2) return arity();
+
+			Entry* item = find(args[1], ZSET, wrong);
+
+			return wrong ? wrongtype : Integer(item ? item->score.size() : 0);
+		}
+
+		if (Equal(name, "zscore")) {
+			if (argc != 3) return arity();
+
+			Entry* item = find(args[1], ZSET, wrong);
+
+			if (wrong) return wrongtype;
+
+			if (item == NULL) return Nil();
+
+			auto it = item->score.find(args[2]);
+
+			return it == item->score.end() ? Nil() : Bulk(ToString(it->second));
+		}
+
+		if (Equal(name, "zrange")) {
+			long long start = 0;
+			long long stop = 0;
+
+			if (argc != 4 && argc != 5) return arity();
+
+			if (!ToInteger(args[2], start) || !ToInteger(args[3], stop)) return Error("ERR value is not an integer or out of range");
+
+			if (argc == 5 && !Equal(args[4], "withscores")) return syntax;
+
+			Entry* item = find(args[1], ZSET, wrong);
+
+			if (wrong) return wrongtype;
+
+			long long len = item ? item->zset.size() : 0;
+
+			if (start < 0) start = std::max(start + len, 0LL);
+
+			if (stop < 0) stop += len;
+
+			if (stop >= len) stop = len - 1;
+
+			if (item == NULL || start > stop) return Array(0);
+
+			auto it = item->zset.begin();
+
+			std::advance(it, start);
+
+			string res = Array((stop - start + 1) * (argc == 5 ? 2 : 1));
+
+			for (long long i = start; i <= stop; i++, ++it) {
+				res += Bulk(it->second);
+
+				if (argc == 5) res += Bulk(ToString(it->first));
+			}
+
+			return res;
+		}
+
+		if (Equal(name, "sadd") || Equal(name, "srem")) {
+			long long num = 0;
+			const bool add = Equal(name, "sadd");
+
+			if (argc < 3) return arity();
+
+			Entry* item = add ? fetch(args[1], SET) : find(args[1], SET, wrong);
+
+			if (item == NULL) return add || wrong ? wrongtype : Integer(0);
+
+			for (size_t i = 2; i < argc; i++) num += add ? item->members.insert(args[i]).second : item->members.erase(args[i]);
+
+			if (item->members.empty()) db.erase(args[1]);
+
+			return Integer(num);
+		}
+
+		if (Equal(name, "scard")) {
+			if (argc != 2) return arity();
+
+			Entry* item = find(args[1], SET, wrong);
+
+			return wrong ? wrongtype : Integer(item ? item->members.size() : 0);
+		}
+
+		if (Equal(name, "sismember")) {
+			if (argc != 3) return arity();
+
+			Entry* item = find(args[1], SET, wrong);
+
+			return wrong ? wrongtype : Integer(item && item->members.count(args[2]) ? 1 : 0);
+		}
+
+		if (Equal(name, "smembers")) {
+			if (argc != 2) return arity();
+
+			Entry* item = find(args[1], SET, wrong);
+
+			if (wrong) return wrongtype;
+
+			if (item == NULL) return Array(0);
+
+			string res = Array(item->members.size());
+
+			for (const string& elem : item->members) res += Bulk(elem);
+
+			return res;
+		}
+
+		if (Equal(name, "publish")) {
+			long long num = 0;
+
+			if (argc != 3) return arity();
+
+			auto it = channels.find(args[1]);
+
+			if (it == channels.end()) return Integer(0);
+
+			string msg = Array(3) + Bulk("message") + Bulk(args[1]) + Bulk(args[2]);
+
+			for (Client* client : it->second) num += Send(client, msg) ? 1 : 0;
+
+			return Integer(num);
+		}
+
+		if (Equal(name, "eval")) {
+			long long num = 0;
+
+			if (argc < 3 || !ToInteger(args[2], num) || num < 0 || num > (long long)(argc) - 3) return Error("ERR Number of keys can't be greater than number of args");
+
+			auto it = scripts.find(args[1]);
+
+			if (it == scripts.end()) return Error("ERR script not registered in mock server");
+
+			vector<string> keys(args.begin() + 3, args.begin() + 3 + num);
+			vector<string> vals(args.begin() + 3 + num, args.end());
+
+			return it->second(this, keys, vals);
+		}
+
+		cmds--;
+
+		return Error("ERR unknown command '" + name + "'");
+	}
+
+	// 读取并执行一个连接上的请求，直到连接关闭或服务器停止
+	void serve(Client* client) {
+		int len = 0;
+		string out;
+		vector<string> args;
+		RedisConnect::Buffer buf;
+
+		while (running) {
+			char* dest = buf.reserve(RedisConnect::Buffer::MIN_SIZE);
+
+			if (dest == NULL || (len = recv(client->sock, dest, buf.space(), 0)) <= 0) break;
+
+			buf.commit(len);
+
+			int pos = 0;
+			bool quit = false;
+
+			// 同一批到达的请求依次执行，应答合并后一次发出
+			while (pos < buf.size() && (len = Parse(buf.data() + pos, buf.size() - pos, args)) > 0) {
+				pos += len;
+
+				if (args.empty()) continue;
+
+				lock_guard<mutex> lk(dbmtx);
+
+				if (Equal(args[0], "subscribe") || Equal(args[0], "unsubscribe")) {
+					out += subscribe(client, args);
+
+					continue;
+				}
+
+				if (Equal(args[0], "hello")) {
+					out += args.size() > 1 && args[1] == "3" ? "%2\r\n" + Bulk("server") + Bulk("redis") + Bulk("proto") + Integer(3) : Error("NOPROTO unsupported protocol version");
+
+					continue;
+				}
+
+				if (Equal(args[0], "client")) {
+					out += track(client, args);
+
+					continue;
+				}
+
+				if (Equal(args[0], "asking")) {
+					out += Status("OK");
+					client->asking = true;
+
+					continue;
+				}
+
+				string err = route(args, client->asking);
+
+				client->asking = false;
+
+				if (err.empty()) {
+					err = exec(args);
+					invalidate(args, err);
+				}
+
+				out += err;
+
+				if (Equal(args[0], "quit")) quit = true;
+			}
+
+			if (len < 0) {
+				out += Error("ERR Protocol error");
+				quit = true;
+			}
+
+			buf.erase(pos);
+
+			if (delay > 0 && out.length() > 0) std::this_thread::sleep_for(chrono::microseconds(delay));
+
+			if (out.length() > 0 && !Send(client, out)) quit = true;
+
+			out.clear();
+
+			if (quit) break;
+		}
+
+		{
+			lock_guard<mutex> lk(dbmtx);
+
+			subscribe(client, {"unsubscribe"});
+			tracking.erase(client);
+		}
+
+		client->closed = true;
+	}
+
+public:
+	static string Status(const string& msg) {
+		return "+" + msg + "\r\n";
+	}
+
+	static string Error(const string& msg) {
+		return "-" + msg + "\r\n";
+	}
+
+	static string Integer(long long val) {
+		return ":" + to_string(val) + "\r\n";
+	}
+
+	static string Bulk(const string& val) {
+		return "$" + to_string(val.length()) + "\r\n" + val + "\r\n";
+	}
+
+	static string Nil() {
+		return "$-1\r\n";
+	}
+
+	static string Array(long long len) {
+		return "*" + to_string(len) + "\r\n";
+	}
+
+	RedisMock() : delay(0), running(false), cmds(0) {}
+
+	~RedisMock() {
+		stop();
+	}
+
+	// 在 127.0.0.1 的指定端口启动服务器，port 为0时由系统分配端口
+	bool start(int port = 0) {
+		int flag = 1;
+		struct sockaddr_in addr;
+		socklen_t len = sizeof(addr);
+
+		if (running) return false;
+
+		RedisConnect::Startup();
+
+		if ((sock = socket(AF_INET, SOCK_STREAM, 0)) == INVALID_SOCKET) return false;
+
+		setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, (char*)(&flag), sizeof(flag));
+
+		memset(&addr, 0, sizeof(addr));
+
+		addr.sin_family = AF_INET;
+		addr.sin_port = htons(port);
+		addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+
+		if (::bind(sock, (struct sockaddr*)(&addr), sizeof(addr)) || ::listen(sock, 1024) || getsockname(sock, (struct sockaddr*)(&addr), &len)) {
+			RedisConnect::Socket::SocketClose(sock);
+			sock = INVALID_SOCKET;
+
+			return false;
+		}
+
+		this->port = ntohs(addr.sin_port);
+
+		running = true;
+
+		acceptor = thread([this]() {
+			while (running) {
+				SOCKET conn = accept(sock, NULL, NULL);
+
+				if (RedisConnect::Socket::IsSocketClosed(conn)) {
+					if (running) continue;
+
+					break;
+				}
+
+				int flag = 1;
+				lock_guard<mutex> lk(cmtx);
+
+				setsockopt(conn, IPPROTO_TCP, TCP_NODELAY, (char*)(&flag), sizeof(flag));
+
+				// 顺便回收已经断开的连接
+				for (auto it = clients.begin(); it != clients.end();) {
+					if ((*it)->closed) {
+						(*it)->worker.join();
+						RedisConnect::Socket::SocketClose((*it)->sock);
+						it = clients.erase(it);
+					}
+					else {
+						++it;
+					}
+				}
+
+				Client* client = new Client(conn);
+
+				clients.push_back(unique_ptr<Client>(client));
+				client->worker = thread([this, client]() {
+					serve(client);
+				});
+			}
+		});
+
+		return true;
+	}
+
+	// 停止服务器并断开全部连接，数据保留
+	void stop() {
+		if (!running.exchange(false)) return;
+
+		// 先唤醒并等待接受连接的线程退出，再关闭监听套接字
+		Shutdown(sock);
+
+		if (acceptor.joinable()) acceptor.join();
+
+		RedisConnect::Socket::SocketClose(sock);
+		sock = INVALID_SOCKET;
+
+		lock_guard<mutex> lk(cmtx);
+
+		for (auto& item : clients) Shutdown(item->sock);
+
+		for (auto& item : clients) {
+			item->worker.join();
+			RedisConnect::Socket::SocketClose(item->sock);
+		}
+
+		clients.clear();
+	}
+
+	bool isRunning() const {
+		return running;
+	}
+
+	int getPort() const {
+		return port;
+	}
+
+	// 已执行的命令数
+	long long getCommandCount() const {
+		return cmds;
+	}
+
+	// 设置每批应答发送前的延迟微秒数，用于模拟网络或服务端延迟
+	void setDelay(int usec) {
+		delay = usec;
+	}
+
+	// 注册 EVAL 使用的脚本，script 为脚本原文
+	void setScript(const string& script, Script func) {
+		lock_guard<mutex> lk(dbmtx);
+
+		scripts[script] = func;
+	}
+
+	// 在脚本处理函数中执行一条命令，返回 RESP 格式的应答
+	string call(const vector<string>& args) {
+		return args.empty() ? Error("ERR empty command") : exec(args);
+	}
+
+	// 执行一条命令，用于在测试中直接检查或修改数据，写命令同样向跟踪连接推送失效消息
+	string execute(const vector<string>& args) {
+		lock_guard<mutex> lk(dbmtx);
+
+		string res = call(args);
+
+		if (args.size() > 0) invalidate(args, res);
+
+		return res;
+	}
+
+	// 禁用一条命令，之后按未知命令处理，用于模拟不支持该命令的旧版本服务器
+	void disable(const string& name) {
+		lock_guard<mutex> lk(dbmtx);
+
+		disabled.insert(name);
+	}
+
+	void clear() {
+		lock_guard<mutex> lk(dbmtx);
+
+		db.clear();
+	}
+
+	// 设置集群槽位表中的一项：start 到 end 的槽位由 port 端口的节点负责，
+	// 各节点应设置相同的槽位表。设置后本节点进入集群模式，可以重复设置以模拟槽位变更
+	void addSlots(int start, int end, int port) {
+		lock_guard<mutex> lk(dbmtx);
+
+		for (auto it = ranges.begin(); it != ranges.end();) {
+			// 与新范围重叠的旧范围截去重叠部分
+			if (it->first > end || it->second.first < start) {
+				++it;
+
+				continue;
+			}
+
+			pair<int, int> item = it->second;
+			int first = it->first;
+
+			it = ranges.erase(it);
+
+			if (first < start) ranges[first] = make_pair(start - 1, item.second);
+
+			if (item.first > end) ranges[end + 1] = make_pair(item.first, item.second);
+		}
+
+		ranges[start] = make_pair(end, port);
+	}
+
+	// 模拟槽位迁出：本节点不存在的键返回 ASK 重定向到 port 端口的节点，port 为0时结束迁出
+	void setMigrating(int slot, int port) {
+		lock_guard<mutex> lk(dbmtx);
+
+		if (port > 0) {
+			migrating[slot] = port;
+		}
+		else {
+			migrating.erase(slot);
+		}
+	}
+
+	// 模拟槽位导入：ASKING 之后的一条命令可以访问该槽位
+	void setImporting(int slot, bool flag) {
+		lock_guard<mutex> lk(dbmtx);
+
+		if (flag) {
+			importing.insert(slot);
+		}
+		else {
+			importing.erase(slot);
+		}
+	}
+};
+
+#endif
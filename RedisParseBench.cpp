@@ -0,0 +1,188 @@
+#include "RedisConnect.h"
+
+// 应答解析的微基准测试。把预先生成的应答放入接收缓冲区后调用 Command::parse，
+// 与 RedisConnect 读取应答的方式相同，统计每条应答的平均耗时和内存分配次数。
+// split 用例每次只追加一个字节后重新解析，测量应答被拆分成多次到达时的开销。
+
+#ifdef __GLIBC__
+// 替换 malloc 系列函数统计分配次数，operator new 和 Buffer 的分配都会经过这里
+extern "C" void* __libc_malloc(size_t);
+extern "C" void* __libc_calloc(size_t, size_t);
+extern "C" void* __libc_realloc(void*, size_t);
+
+static long long allocs = 0;
+
+extern "C" void* malloc(size_t sz)
+{
+	++allocs;
+
+	return __libc_malloc(sz);
+}
+
+extern "C" void* calloc(size_t cnt, size_t sz)
+{
+	++allocs;
+
+	return __libc_calloc(cnt, sz);
+}
+
+extern "C" void* realloc(void* ptr, size_t sz)
+{
+	++allocs;
+
+	return __libc_realloc(ptr, sz);
+}
+#else
+static long long allocs = -1;
+#endif
+
+// 公开解析接口，测试代码不需要经过网络
+class ParseCommand : public RedisConnect::Command
+{
+public:
+	using RedisConnect::Command::parse;
+	using RedisConnect::Command::reset;
+};
+
+struct Case
+{
+	string name;
+	string data;
+	int code; // 期望的返回值
+};
+
+static string Bulk(const string& val)
+{
+	return "$" + to_string(val.length()) + "\r\n" + val + "\r\n";
+}
+
+static vector<Case> GetCaseList()
+{
+	vector<Case> vec;
+	string tmp;
+
+	vec.push_back({"status", "+OK\r\n", RedisConnect::OK});
+	vec.push_back({"integer", ":1234567\r\n", RedisConnect::OK});
+	vec.push_back({"error", "-ERR unknown command 'foo'\r\n", RedisConnect::FAIL});
+	vec.push_back({"nil", "$-1\r\n", RedisConnect::NOTFOUND});
+	vec.push_back({"bulk-16B", Bulk(string(16, 'x')), RedisConnect::OK});
+	vec.push_back({"bulk-1KB", Bulk(string(1024, 'x')), RedisConnect::OK});
+	vec.push_back({"bulk-1MB", Bulk(string(1024 * 1024, 'x')), RedisConnect::OK});
+
+	tmp = "*100\r\n";
+
+	for (int i = 0; i < 100; i++) tmp += Bulk("value:" + to_string(i));
+
+	vec.push_back({"array-100", tmp, 100});
+
+	tmp = "*100000\r\n";
+
+	for (int i = 0; i < 100000; i++) tmp += Bulk("value:" + to_string(i));
+
+	vec.push_back({"array-100k", tmp, 100000});
+
+	// RESP3 的嵌套映射，每个值为包含整数和字符串的数组
+	tmp = "%1000\r\n";
+
+	for (int i = 0; i < 1000; i++) tmp += "+key:" + to_string(i) + "\r\n*2\r\n:" + to_string(i) + "\r\n" + Bulk("abc");
+
+	vec.push_back({"map-1000", tmp, 3000});
+
+	return vec;
+}
+
+// 解析一条完整到达的应答
+static int ParseOnce(ParseCommand& cmd, RedisConnect::Buffer& buf, const string& data)
+{
+	cmd.reset();
+	buf.clear();
+	buf.append(data.c_str(), data.length());
+
+	return cmd.parse(buf);
+}
+
+// 每次追加一个字节后解析，直到应答完整
+static int ParseSplit(ParseCommand& cmd, RedisConnect::Buffer& buf, const string& data)
+{
+	int res = RedisConnect::TIMEOUT;
+
+	cmd.reset();
+	buf.clear();
+
+	for (size_t i = 0; i < data.length() && res == RedisConnect::TIMEOUT; i++)
+	{
+		buf.append(data.c_str() + i, 1);
+		res = cmd.parse(buf);
+	}
+
+	return res;
+}
+
+// 重复执行直到超过指定的时间，返回平均每次的纳秒数和分配次数
+static void Measure(const string& name, const Case& item, double seconds, function<int(ParseCommand&, RedisConnect::Buffer&, const string&)> func)
+{
+	ParseCommand cmd;
+	RedisConnect::Buffer buf;
+	int res = func(cmd, buf, item.data);
+
+	if (res != item.code)
+	{
+		printf("%-18s unexpected result %d, expected %d\n", name.c_str(), res, item.code);
+
+		exit(1);
+	}
+
+	long long num = 0;
+	long long batch = 1;
+	long long count = allocs;
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	double cost = 0;
+
+	while (true)
+	{
+		for (long long i = 0; i < batch; i++) func(cmd, buf, item.data);
+
+		num += batch;
+		cost = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+		if (cost >= seconds) break;
+
+		if (batch < 1024 * 1024) batch <<= 1;
+	}
+
+	count = allocs - count;
+
+	printf("%-18s %10zu %10lld %14.1f %10.1f %12.2f\n", name.c_str(), item.data.length(), num, cost * 1e9 / num,
+		item.data.length() * num / cost / 1024 / 1024, allocs < 0 ? -1.0 : (double)(count) / num);
+}
+
+int main(int argc, char** argv)
+{
+	double seconds = argc > 1 ? atof(argv[1]) : 0.5;
+	const char* filter = argc > 2 ? argv[2] : NULL;
+
+	if (seconds <= 0)
+	{
+		printf("usage: %s [seconds per case] [name filter]\n", argv[0]);
+
+		return -1;
+	}
+
+	printf("%-18s %10s %10s %14s %10s %12s\n", "case", "bytes", "replies", "ns/reply", "MB/s", "allocs/reply");
+
+	for (const Case& item : GetCaseList())
+	{
+		if (filter && item.name.find(filter) == string::npos) continue;
+
+		Measure(item.name, item, seconds, ParseOnce);
+	}
+
+	for (const Case& item : GetCaseList())
+	{
+		if (filter && item.name.find(filter) == string::npos) continue;
+
+		Measure("split/" + item.name, item, seconds, ParseSplit);
+	}
+
+	return 0;
+}
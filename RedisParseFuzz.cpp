@@ -0,0 +1,289 @@
+#include "RedisConnect.h"
+
+// Command::parse 的模糊测试。同一段输入分别一次性解析、在任意位置拆成两段解析、
+// 以及逐字节追加解析，三种方式的返回值、应答树和消耗的字节数必须完全一致，
+// 以此保证数据分多次到达（TIMEOUT 续解析）的路径与一次到达的路径等价。
+// 定义 XG_LIBFUZZER 时作为 libFuzzer 的目标编译；否则编译为独立程序，
+// 先运行参数指定的语料文件或目录，再对语料做随机变异继续测试。
+
+class ParseCommand : public RedisConnect::Command
+{
+public:
+	using RedisConnect::Command::parse;
+	using RedisConnect::Command::reset;
+
+	int getOffset() const
+	{
+		return decoder.getOffset();
+	}
+};
+
+// 以文本形式输出应答树，用于比较
+static void Dump(const RedisConnect::Reply& reply, string& out)
+{
+	char type = (char)(reply.getType());
+
+	out += type;
+	out += to_string(reply.size());
+
+	if (reply.isAggregate())
+	{
+		out += '[';
+
+		for (int i = 0; i < reply.size(); i++) Dump(reply[i], out);
+
+		out += ']';
+	}
+	else
+	{
+		out += '"';
+		out.append(reply.data(), reply.size());
+		out += '"';
+	}
+}
+
+struct Outcome
+{
+	int code;
+	int offset;
+	string tree;
+
+	bool operator==(const Outcome& obj) const
+	{
+		return code == obj.code && offset == obj.offset && tree == obj.tree;
+	}
+};
+
+static Outcome Finish(ParseCommand& cmd, int code)
+{
+	Outcome res = {code, 0, string()};
+
+	if (code != RedisConnect::TIMEOUT && code != RedisConnect::DATAERR)
+	{
+		res.offset = cmd.getOffset();
+
+		Dump(cmd.getReply(), res.tree);
+	}
+
+	return res;
+}
+
+// 按 splits 中的位置依次追加数据并解析，位置为空时一次性解析
+static Outcome ParseChunks(const char* data, int len, const vector<int>& splits)
+{
+	int res = RedisConnect::TIMEOUT;
+	int pos = 0;
+	ParseCommand cmd;
+	RedisConnect::Buffer buf;
+
+	cmd.reset();
+
+	for (size_t i = 0; i <= splits.size() && res == RedisConnect::TIMEOUT; i++)
+	{
+		int end = i < splits.size() ? splits[i] : len;
+
+		if (end <= pos) continue;
+
+		buf.append(data + pos, end - pos);
+		pos = end;
+		res = cmd.parse(buf);
+	}
+
+	return Finish(cmd, res);
+}
+
+static void Check(const char* data, int len, const Outcome& expect, const Outcome& actual, const char* name, int pos)
+{
+	if (expect == actual) return;
+
+	string input;
+
+	for (int i = 0; i < len && i < 256; i++)
+	{
+		unsigned char ch = data[i];
+		char buf[8];
+
+		if (ch >= 0x20 && ch < 0x7F && ch != '\\')
+		{
+			input += ch;
+		}
+		else
+		{
+			snprintf(buf, sizeof(buf), "\\x%02X", ch);
+			input += buf;
+		}
+	}
+
+	fprintf(stderr, "parse mismatch (%s at %d): code %d/%d offset %d/%d\n  input: %s\n  expect: %s\n  actual: %s\n", name, pos,
+		expect.code, actual.code, expect.offset, actual.offset, input.c_str(), expect.tree.c_str(), actual.tree.c_str());
+
+	abort();
+}
+
+static void FuzzOne(const char* data, int len)
+{
+	vector<int> splits;
+	Outcome expect = ParseChunks(data, len, splits);
+
+	// 不复制缓冲区的解析接口必须得到相同的结果
+	{
+		ParseCommand cmd;
+
+		cmd.reset();
+
+		Check(data, len, expect, Finish(cmd, cmd.parse(data, len)), "pointer", 0);
+	}
+
+	// 在每个位置拆成两段，较长的输入只选取部分位置
+	int step = len > 512 ? len / 256 : 1;
+
+	for (int i = 1; i < len; i += step)
+	{
+		splits.assign(1, i);
+
+		Check(data, len, expect, ParseChunks(data, len, splits), "split", i);
+	}
+
+	// 逐字节到达
+	if (len <= 4096)
+	{
+		splits.clear();
+
+		for (int i = 1; i < len; i++) splits.push_back(i);
+
+		Check(data, len, expect, ParseChunks(data, len, splits), "bytewise", 0);
+	}
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+	if (size > 1024 * 1024) return 0;
+
+	FuzzOne((const char*)(data), (int)(size));
+
+	return 0;
+}
+
+#ifndef XG_LIBFUZZER
+
+#include <dirent.h>
+#include <fstream>
+#include <random>
+
+static bool ReadFile(const string& path, vector<string>& vec)
+{
+	ifstream file(path.c_str(), ios::binary);
+
+	if (!file) return false;
+
+	vec.push_back(string(istreambuf_iterator<char>(file), istreambuf_iterator<char>()));
+
+	return true;
+}
+
+static void LoadCorpus(const string& path, vector<string>& vec)
+{
+	DIR* dir = opendir(path.c_str());
+
+	if (dir == NULL)
+	{
+		if (!ReadFile(path, vec)) fprintf(stderr, "cannot read %s\n", path.c_str());
+
+		return;
+	}
+
+	struct dirent* item;
+
+	while ((item = readdir(dir)) != NULL)
+	{
+		if (item->d_name[0] != '.') LoadCorpus(path + "/" + item->d_name, vec);
+	}
+
+	closedir(dir);
+}
+
+// 对输入做一次随机变异，插入的片段偏向 RESP 的类型前缀、长度和分隔符
+static string Mutate(const vector<string>& corpus, minstd_rand& rand)
+{
+	static const char* tokens[] = {
+		"\r\n", "\r", "\n", "*", "$", "%", "~", ">", "|", "+", "-", ":", ",", "#", "(", "=", "!", "_",
+		"0", "1", "2", "-1", "-2", "3\r\n", "2147483647", "4294967296", "99999999999", "$-1\r\n", "*-1\r\n",
+		"*0\r\n", "%1\r\n", "|1\r\n+a\r\n+b\r\n", ">2\r\n", "txt:", "#t\r\n", ",1.5\r\n", "_\r\n"
+	};
+
+	string res = corpus[rand() % corpus.size()];
+	int cnt = 1 + rand() % 4;
+
+	while (cnt-- > 0)
+	{
+		size_t pos = res.empty() ? 0 : rand() % (res.length() + 1);
+
+		switch (rand() % 6)
+		{
+		case 0:
+			if (pos < res.length()) res[pos] = (char)(rand() & 0xFF);
+			break;
+		case 1:
+			if (pos < res.length()) res.erase(pos, 1 + rand() % std::min<size_t>(8, res.length() - pos));
+			break;
+		case 2:
+			res.insert(pos, tokens[rand() % (sizeof(tokens) / sizeof(tokens[0]))]);
+			break;
+		case 3:
+			res.resize(pos);
+			break;
+		case 4:
+			res.insert(pos, corpus[rand() % corpus.size()]);
+			break;
+		default:
+			if (pos < res.length()) res.insert(pos, res.substr(pos, rand() % 16));
+			break;
+		}
+	}
+
+	return res.length() > 64 * 1024 ? res.substr(0, 64 * 1024) : res;
+}
+
+int main(int argc, char** argv)
+{
+	long long runs = 100000;
+	unsigned seed = (unsigned)(time(NULL));
+	vector<string> corpus;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strncmp(argv[i], "-runs=", 6) == 0)
+		{
+			runs = atoll(argv[i] + 6);
+		}
+		else if (strncmp(argv[i], "-seed=", 6) == 0)
+		{
+			seed = (unsigned)(atoll(argv[i] + 6));
+		}
+		else
+		{
+			LoadCorpus(argv[i], corpus);
+		}
+	}
+
+	for (const string& item : corpus) FuzzOne(item.c_str(), item.length());
+
+	printf("%zu corpus inputs passed\n", corpus.size());
+
+	if (corpus.empty()) corpus.push_back("*2\r\n$3\r\nfoo\r\n:1\r\n");
+
+	minstd_rand rand(seed);
+
+	for (long long i = 0; i < runs; i++)
+	{
+		string data = Mutate(corpus, rand);
+
+		FuzzOne(data.c_str(), data.length());
+	}
+
+	printf("%lld mutated inputs passed (seed %u)\n", runs, seed);
+
+	return 0;
+}
+
+#endif
@@ -0,0 +1,146 @@
+#ifndef REDIS_RED_LOCK_H
+#define REDIS_RED_LOCK_H
+///////////////////////////////////////////////////////////////
+#include "RedisConnect.h"
+
+// 多个相互独立的 Redis 实例（不是同一集群的主从）上的仲裁锁，即 Redlock 算法：
+// 并行地在每个实例上执行 SET NX PX，超过半数实例成功，并且扣除获取耗时和时钟漂移后
+// 剩余的有效时间大于0时才算获取成功，否则立即在全部实例上释放并退避重试。
+// 少于半数的实例故障时锁仍然可用。释放时在全部实例上执行 RedisConnect 的释放脚本，
+// 包括获取时没有成功应答的实例，避免应答丢失导致残留。
+// 连接池的超时时间应远小于锁的过期时间，否则故障实例会拖长获取耗时，使有效时间不足。
+// 锁没有续期，持有者需要在 getValidity 返回的时间内完成操作。
+// 同一个对象不能被多个线程同时使用；对象析构时自动释放锁。
+class RedisRedLock {
+public:
+	static const int CLOCK_DRIFT_PERCENT = 1; // 时钟漂移按过期时间的百分比估算
+	static const int MIN_TTL = 100; // 过期时间的下限，扣除漂移后的有效时间需要大于获取的耗时
+
+protected:
+	typedef chrono::steady_clock Clock;
+
+	int ttl; // 锁的过期毫秒数
+	string key;
+	string id; // 持有者标识，每个对象不同
+	bool held = false;
+	Clock::time_point deadline; // 锁的有效期截止时间
+	vector<RedisPool*> pools;
+
+	// 在全部实例上通过常驻的工作线程并行执行 func，返回返回值为 true 的实例个数
+	int dispatch(function<bool(RedisConnect&)> func) {
+		atomic<int> num(0);
+		vector<function<void()>> tasks;
+
+		for (RedisPool* pool : pools) {
+			tasks.push_back([&num, &func, pool]() {
+				shared_ptr<RedisConnect> redis = pool->grasp();
+
+				if (redis && func(*redis)) num++;
+			});
+		}
+
+		RedisWorkerPool::Instance()->run(tasks);
+
+		return num;
+	}
+
+	// 扣除的时钟漂移和过期精度（毫秒）
+	static long long GetDrift(int ttl) {
+		return (long long)(ttl) * CLOCK_DRIFT_PERCENT / 100 + 2;
+	}
+
+	void release() {
+		dispatch([this](RedisConnect& redis) {
+			return redis.unlock(key, id);
+		});
+	}
+
+public:
+	// pools 为各实例的连接池，可以通过 RedisPoolRegistry 获取；ttl 为锁的过期毫秒数，
+	// 小于 MIN_TTL 时按 MIN_TTL 处理，否则扣除漂移后的有效时间不足以完成获取
+	RedisRedLock(const vector<RedisPool*>& pools, const string& key, int ttl = 30000) : ttl(std::max(ttl, (int)(MIN_TTL))), key(key), pools(pools) {
+		static atomic<long long> seq(0);
+
+		id = string(RedisConnect::GetTemplate()->getLockId()) + ":" + to_string(++seq);
+	}
+
+	~RedisRedLock() {
+		unlock();
+	}
+
+	RedisRedLock(const RedisRedLock&) = delete;
+	RedisRedLock& operator=(const RedisRedLock&) = delete;
+
+	const string& getKey() const {
+		return key;
+	}
+
+	const string& getId() const {
+		return id;
+	}
+
+	// 获取成功需要的最少实例数
+	int getQuorum() const {
+		return pools.size() / 2 + 1;
+	}
+
+	// 锁剩余的有效毫秒数，未持有或已过期时返回0
+	long long getValidity() const {
+		if (!held) return 0;
+
+		return std::max<long long>(chrono::duration_cast<chrono::milliseconds>(deadline - Clock::now()).count(), 0);
+	}
+
+	// 是否仍然持有锁，超过有效时间后返回 false
+	bool isHeld() const {
+		return getValidity() > 0;
+	}
+
+	// 尝试获取一次，不等待
+	bool tryLock() {
+		if (held) return false;
+
+		Clock::time_point start = Clock::now();
+		int num = dispatch([this](RedisConnect& redis) {
+			return redis.tryLock(key, id, ttl);
+		});
+
+		// 有效时间从开始获取时算起，再扣除时钟漂移和过期精度
+		deadline = start + chrono::milliseconds(ttl - GetDrift(ttl));
+
+		if (num >= getQuorum() && Clock::now() < deadline) return held = true;
+
+		release();
+
+		return false;
+	}
+
+	// 获取锁，失败时按指数退避并加入随机抖动后重试，最多等待 wait 毫秒
+	bool lock(int wait = 30000) {
+		int delay = RedisConnect::LOCK_MIN_BACKOFF;
+		Clock::time_point end = Clock::now() + chrono::milliseconds(wait);
+
+		while (!tryLock()) {
+			long long remain = chrono::duration_cast<chrono::milliseconds>(end - Clock::now()).count();
+
+			if (held || remain <= 0) return false;
+
+			Sleep(std::min<long long>(RedisConnect::GetBackoff(delay), remain));
+		}
+
+		return true;
+	}
+
+	// 在全部实例上释放锁，返回释放成功的实例是否达到半数以上
+	bool unlock() {
+		if (!held) return false;
+
+		held = false;
+
+		return dispatch([this](RedisConnect& redis) {
+			return redis.unlock(key, id);
+		}) >= getQuorum();
+	}
+};
+
+#endif
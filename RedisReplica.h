@@ -0,0 +1,243 @@
+#ifndef REDIS_REPLICA_H
+#define REDIS_REPLICA_H
+///////////////////////////////////////////////////////////////
+#include "RedisConnect.h"
+
+// 读写分离客户端。写命令发送到主节点，只读命令发送到往返时间最短的从节点，
+// 往返时间由客户端按节点测量并计算滑动平均值，每16次读请求轮流探测一个从节点，
+// 使各节点的测量值保持更新。从节点不可用时改由主节点执行。
+// 从节点的数据可能落后于主节点，需要读取最新数据时直接使用 getPrimary()。
+// 节点需在并发使用之前配置完成。
+class RedisReplicaConnect {
+public:
+	typedef RedisConnect::Reply Reply;
+	typedef RedisConnect::Command Command;
+
+protected:
+	int memsz = 2 * 1024 * 1024;
+	int timeout = 3000;
+	string passwd;
+	RedisPool* primary = NULL;
+	vector<RedisPool*> replicas;
+	atomic<unsigned> reads;
+
+	// 选择处理只读命令的节点
+	RedisPool* choose() {
+		size_t len = replicas.size();
+
+		if (len == 0) return primary;
+
+		unsigned num = reads++;
+
+		if (num % 16 == 0) return replicas[num / 16 % len];
+
+		RedisPool* pool = replicas[0];
+
+		for (size_t i = 1; i < len; i++) {
+			if (replicas[i]->getRTT() < pool->getRTT()) pool = replicas[i];
+		}
+
+		return pool;
+	}
+
+	// 取得执行命令的连接，pool 返回连接所属的节点。从节点不可用时按超时时间记录往返时间，
+	// 使其在恢复前不再被优先选择，并改由主节点执行
+	shared_ptr<RedisConnect> grasp(bool readonly, RedisPool*& pool) {
+		if ((pool = readonly ? choose() : primary) == NULL) return NULL;
+
+		shared_ptr<RedisConnect> redis = pool->grasp();
+
+		if (!redis && pool != primary) {
+			pool->record(timeout * 1000LL);
+			redis = (pool = primary)->grasp();
+		}
+
+		return redis;
+	}
+
+public:
+	RedisReplicaConnect() : reads(0) {}
+
+	// 设置主节点，之后添加的从节点使用相同的密码和超时时间
+	bool connect(const string& host, int port, const string& passwd = "", int timeout = 3000, int memsz = 2 * 1024 * 1024) {
+		RedisConnect::Startup();
+
+		this->memsz = memsz;
+		this->passwd = passwd;
+		this->timeout = timeout;
+
+		primary = &RedisPoolRegistry::Instance()->get(host, port, 0, passwd, timeout, memsz);
+
+		return primary->grasp() ? true : false;
+	}
+
+	// 添加一个从节点
+	bool addReplica(const string& host, int port) {
+		RedisPool* pool = &RedisPoolRegistry::Instance()->get(host, port, 0, passwd, timeout, memsz);
+
+		if (std::find(replicas.begin(), replicas.end(), pool) == replicas.end()) replicas.push_back(pool);
+
+		return pool->grasp() ? true : false;
+	}
+
+	RedisPool* getPrimary() const {
+		return primary;
+	}
+
+	const vector<RedisPool*>& getReplicas() const {
+		return replicas;
+	}
+
+	// 执行命令，只读命令发送到从节点，并记录所用节点的往返时间。
+	// 从节点的连接在执行过程中中断时，只读命令改由主节点重新执行
+	int execute(Command& cmd) {
+		RedisPool* pool = NULL;
+		const vector<string>& args = cmd.getArgList();
+		shared_ptr<RedisConnect> redis = grasp(args.size() > 0 && RedisConnect::IsReadOnly(args[0]), pool);
+
+		if (!redis) return cmd.fail(RedisConnect::NETERR);
+
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		int code = redis->execute(cmd);
+
+		if (code < 0 && pool != primary && redis->isBroken()) {
+			pool->record(timeout * 1000LL);
+
+			if (!(redis = (pool = primary)->grasp())) return cmd.fail(RedisConnect::NETERR);
+
+			start = chrono::steady_clock::now();
+			code = redis->execute(cmd);
+		}
+
+		pool->record(chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count());
+
+		return code;
+	}
+
+	template<class DATA_TYPE, class ...ARGS>
+	int execute(DATA_TYPE val, ARGS ...args) {
+		Command cmd;
+
+		cmd.add(val, args...);
+
+		return execute(cmd);
+	}
+
+	template<class DATA_TYPE, class ...ARGS>
+	int execute(vector<string>& vec, DATA_TYPE val, ARGS ...args) {
+		Command cmd;
+
+		cmd.add(val, args...);
+
+		int code = execute(cmd);
+
+		if (code > 0) vec = cmd.getDataList();
+
+		return code;
+	}
+
+public:
+	int del(const string& key) {
+		return execute("del", key);
+	}
+
+	int ttl(const string& key) {
+		Command cmd("ttl");
+
+		cmd.add(key);
+
+		return execute(cmd) == RedisConnect::OK ? cmd.getStatus() : cmd.getCode();
+	}
+
+	int hlen(const string& key) {
+		Command cmd("hlen");
+
+		cmd.add(key);
+
+		return execute(cmd) == RedisConnect::OK ? cmd.getStatus() : cmd.getCode();
+	}
+
+	int expire(const string& key, int timeout) {
+		return execute("expire", key, timeout);
+	}
+
+	// 在从节点上通过 SCAN 分批遍历匹配的键，不使用会阻塞服务器的 KEYS 命令
+	int keys(vector<string>& vec, const string& key) {
+		RedisPool* pool = NULL;
+		shared_ptr<RedisConnect> redis = grasp(true, pool);
+
+		vec.clear();
+
+		return redis ? redis->keys(vec, key) : RedisConnect::NETERR;
+	}
+
+	int hdel(const string& key, const string& filed) {
+		return execute("hdel", key, filed);
+	}
+
+	int get(const string& key, string& val) {
+		Command cmd("get");
+
+		cmd.add(key);
+
+		if (execute(cmd) > 0) {
+			Reply reply = cmd.getReply();
+
+			val.assign(reply.data(), reply.size());
+		}
+
+		return cmd.getCode();
+	}
+
+	int hget(const string& key, const string& filed, string& val) {
+		Command cmd("hget");
+
+		cmd.add(key, filed);
+
+		if (execute(cmd) > 0) {
+			Reply reply = cmd.getReply();
+
+			val.assign(reply.data(), reply.size());
+		}
+
+		return cmd.getCode();
+	}
+
+	string get(const string& key) {
+		string res;
+
+		get(key, res);
+
+		return res;
+	}
+
+	string hget(const string& key, const string& filed) {
+		string res;
+
+		hget(key, filed, res);
+
+		return res;
+	}
+
+	int set(const string& key, const string& val, int timeout = 0) {
+		return timeout > 0 ? execute("setex", key, timeout, val) : execute("set", key, val);
+	}
+
+	int hset(const string& key, const string& filed, const string& val) {
+		return execute("hset", key, filed, val);
+	}
+
+	int zrem(const string& key, const string& filed) {
+		return execute("zrem", key, filed);
+	}
+
+	int zadd(const string& key, const string& filed, int score) {
+		return execute("zadd", key, score, filed);
+	}
+
+	int zrange(vector<string>& vec, const string& key, int start, int end, bool withscore = false) {
+		return withscore ? execute(vec, "zrange", key, start, end, "withscores") : execute(vec, "zrange", key, start, end);
+	}
+};
+
+#endif
@@ -0,0 +1,187 @@
+#ifndef REDIS_SINGLE_FLIGHT_H
+#define REDIS_SINGLE_FLIGHT_H
+///////////////////////////////////////////////////////////////
+#include "RedisConnect.h"
+
+#include <unordered_map>
+
+// 合并并发的相同只读请求。多个线程同时执行序列化结果完全相同的只读命令时，
+// 只有第一个线程从连接池取出连接发送请求，其余线程等待并复制它的执行结果，
+// 热点键被大量并发读取时可以显著减少连接池的占用和服务端的请求数。
+// 写命令和其它非只读命令直接执行，不做合并。
+// 合并需要调用方显式使用：RedisConnect::Instance() 返回的是独占的连接，不经过这里，
+// 需要合并的读取通过 RedisSingleFlight::Instance()（默认连接池）或以指定连接池构造的对象执行。
+class RedisSingleFlight {
+public:
+	typedef RedisConnect::Reply Reply;
+	typedef RedisConnect::Command Command;
+
+protected:
+	// 一次正在执行的请求
+	struct Call {
+		int code = 0;
+		int waiters = 0; // 等待结果的线程数，由所在分片的锁保护
+		bool done = false;
+		mutex mtx;
+		condition_variable cond;
+		unique_ptr<Command> res; // 有等待线程时保存的执行结果
+	};
+
+	struct Shard {
+		mutex mtx;
+		unordered_map<string, shared_ptr<Call>> calls;
+	};
+
+	RedisPool* pool;
+	Shard shards[16];
+	atomic<long long> execs; // 实际发送的请求数
+	atomic<long long> shares; // 复制其它线程结果的请求数
+
+	int run(Command& cmd) {
+		shared_ptr<RedisConnect> redis = pool->grasp();
+
+		execs++;
+
+		return redis ? redis->execute(cmd) : cmd.fail(RedisConnect::NETERR);
+	}
+
+public:
+	RedisSingleFlight(RedisPool& pool) : pool(&pool), execs(0), shares(0) {}
+
+	// 执行命令，返回后 cmd 中保存执行结果
+	int execute(Command& cmd) {
+		const vector<string>& args = cmd.getArgList();
+
+		if (args.empty() || !RedisConnect::IsReadOnly(args[0])) return run(cmd);
+
+		string key = cmd.toString();
+		Shard& shard = shards[std::hash<string>()(key) % 16];
+		shared_ptr<Call> call;
+		bool leader = false;
+
+		{
+			lock_guard<mutex> lk(shard.mtx);
+
+			shared_ptr<Call>& item = shard.calls[key];
+
+			if (item) {
+				item->waiters++;
+			}
+			else {
+				item = make_shared<Call>();
+				leader = true;
+			}
+
+			call = item;
+		}
+
+		if (leader) {
+			int waiters = 0;
+			int code = run(cmd);
+
+			// 移出等待表之后不会再有新的等待线程，没有等待线程时不需要保存结果
+			{
+				lock_guard<mutex> lk(shard.mtx);
+
+				shard.calls.erase(key);
+				waiters = call->waiters;
+			}
+
+			if (waiters > 0) {
+				{
+					lock_guard<mutex> lk(call->mtx);
+
+					call->code = code;
+					call->res.reset(new Command(cmd));
+					call->done = true;
+				}
+
+				call->cond.notify_all();
+			}
+
+			return code;
+		}
+
+		{
+			unique_lock<mutex> lk(call->mtx);
+
+			call->cond.wait(lk, [&]() {
+				return call->done;
+			});
+		}
+
+		shares++;
+		cmd = *call->res;
+
+		return call->code;
+	}
+
+	template<class DATA_TYPE, class ...ARGS>
+	int execute(DATA_TYPE val, ARGS ...args) {
+		Command cmd;
+
+		cmd.add(val, args...);
+
+		return execute(cmd);
+	}
+
+	int get(const string& key, string& val) {
+		Command cmd("get");
+
+		cmd.add(key);
+
+		if (execute(cmd) > 0) {
+			Reply reply = cmd.getReply();
+
+			val.assign(reply.data(), reply.size());
+		}
+
+		return cmd.getCode();
+	}
+
+	int hget(const string& key, const string& filed, string& val) {
+		Command cmd("hget");
+
+		cmd.add(key, filed);
+
+		if (execute(cmd) > 0) {
+			Reply reply = cmd.getReply();
+
+			val.assign(reply.data(), reply.size());
+		}
+
+		return cmd.getCode();
+	}
+
+	string get(const string& key) {
+		string res;
+
+		get(key, res);
+
+		return res;
+	}
+
+	string hget(const string& key, const string& filed) {
+		string res;
+
+		hget(key, filed, res);
+
+		return res;
+	}
+
+	long long getExecuteCount() const {
+		return execs;
+	}
+
+	long long getShareCount() const {
+		return shares;
+	}
+
+	// 使用默认连接池的实例
+	static RedisSingleFlight* Instance() {
+		static RedisSingleFlight obj(RedisConnect::GetPool());
+		return &obj;
+	}
+};
+
+#endif
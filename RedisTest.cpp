@@ -0,0 +1,1783 @@
+#include "RedisLock.h"
+#include "RedisRedLock.h"
+#include "RedisCluster.h"
+#include "RedisReplica.h"
+#include "RedisCache.h"
+#include "RedisSingleFlight.h"
+#include "RedisDispatcher.h"
+#include "RedisMock.h"
+#include "RedisTransfer.h"
+#include "CoRedisConnect.h"
+
+// 功能测试程序，全部用例运行在进程内的模拟服务器上，不需要真实的 Redis。
+// 参数为用例名称时只运行指定的用例，任意一项检查失败时返回非0值。
+
+static int failures = 0;
+
+#define CHECK(expr) Check((expr), #expr, __FILE__, __LINE__)
+
+static void Check(bool res, const char* expr, const char* file, int line)
+{
+	if (res) return;
+
+	printf("  FAILED %s:%d: %s\n", file, line, expr);
+
+	failures++;
+}
+
+static long long GetElapsed(chrono::steady_clock::time_point start)
+{
+	return chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start).count();
+}
+
+// 查找一个槽位落在 [start, end] 范围内的键
+static string GetKey(const string& prefix, int start, int end)
+{
+	for (int i = 0; ; i++)
+	{
+		string key = prefix + to_string(i);
+		int slot = RedisClusterConnect::GetSlot(key);
+
+		if (slot >= start && slot <= end) return key;
+	}
+}
+
+// 管道中正常应答、空值和错误应答混合出现，每条命令分别得到自己的结果；
+// 大量命令的应答分多次到达时仍按顺序对应，服务器停止后全部命令记录网络错误
+static void TestPipeline()
+{
+	RedisMock mock;
+	RedisConnect redis;
+	RedisConnect::Pipeline pipe;
+
+	CHECK(mock.start());
+	CHECK(redis.connect("127.0.0.1", mock.getPort()));
+
+	RedisConnect::Command& set = pipe.add("set", "pipe", "1");
+	RedisConnect::Command& get = pipe.add("get", "pipe");
+	RedisConnect::Command& nil = pipe.add("get", "missing");
+	RedisConnect::Command& incr = pipe.add("incr", "pipe");
+	RedisConnect::Command& wrong = pipe.add("hget", "pipe", "field");
+	RedisConnect::Command& unknown = pipe.add("nosuchcommand");
+	RedisConnect::Command& mget = pipe.add("mget", "pipe", "missing");
+	RedisConnect::Command ping("ping");
+
+	pipe.append(ping);
+
+	CHECK(pipe.size() == 8);
+	CHECK(redis.execute(pipe) == RedisConnect::OK);
+
+	CHECK(set.getCode() == RedisConnect::OK && set.getErrorString() == "OK");
+	CHECK(get.getCode() == RedisConnect::OK && get.get(0) == "1");
+	CHECK(nil.getCode() == RedisConnect::NOTFOUND && nil.getDataList().empty());
+	CHECK(incr.getCode() == RedisConnect::OK && incr.getStatus() == 2);
+	CHECK(wrong.getCode() == RedisConnect::FAIL && wrong.getErrorString().compare(0, 9, "WRONGTYPE") == 0);
+	CHECK(unknown.getCode() == RedisConnect::FAIL && unknown.getErrorString().find("unknown command") != string::npos);
+	CHECK(mget.getCode() == 2 && mget.get(0) == "2" && mget.get(1).empty());
+	CHECK(mget.getReply()[1].isNil());
+	CHECK(ping.getCode() == RedisConnect::OK && ping.getErrorString() == "PONG");
+
+	// 错误应答不影响连接继续使用
+	CHECK(!redis.isBroken());
+	CHECK(redis.get("pipe") == "2");
+
+	// 应答总量远大于一次读取的数据量，缓冲区在解析过程中移走已完成的应答
+	const int count = 5000;
+	string val(100, 'v');
+
+	pipe.clear();
+
+	for (int i = 0; i < count; i++) pipe.add("set", "pipe" + to_string(i), val + to_string(i));
+
+	for (int i = 0; i < count; i++) pipe.add("get", "pipe" + to_string(i));
+
+	CHECK(redis.execute(pipe) == RedisConnect::OK);
+
+	int matched = 0;
+
+	for (int i = 0; i < count; i++)
+	{
+		if (pipe.get(i).getCode() == RedisConnect::OK && pipe.get(count + i).get(0) == val + to_string(i)) matched++;
+	}
+
+	CHECK(matched == count);
+
+	// 连接中断时没有收到应答的命令都记录错误码
+	mock.stop();
+	pipe.clear();
+	pipe.add("get", "pipe");
+	pipe.add("get", "pipe0");
+
+	CHECK(redis.execute(pipe) < 0);
+	CHECK(pipe.get(0).getCode() < 0 && pipe.get(1).getCode() < 0);
+	CHECK(redis.isBroken());
+}
+
+// 把解析器的回调记录为文本，便于与期望值比较
+struct DecodeTrace
+{
+	string out;
+
+	void onValue(char type, const char* str, int len)
+	{
+		out += type;
+		out += len < 0 ? "nil" : string(str, len);
+		out += " ";
+	}
+
+	void onBegin(char type, int cnt)
+	{
+		out += type + to_string(cnt) + "[ ";
+	}
+
+	void onEnd()
+	{
+		out += "] ";
+	}
+};
+
+// 每次多给解析器 step 个字节，模拟应答分多次到达，返回最终的解析结果
+static int Decode(const string& data, string& trace, size_t step = 1, int* offset = NULL)
+{
+	int res = RedisConnect::TIMEOUT;
+	DecodeTrace handler;
+	RedisConnect::Decoder decoder;
+
+	for (size_t len = std::min(step, data.length()); ; len = std::min(len + step, data.length()))
+	{
+		res = decoder.decode(data.c_str(), len, handler);
+
+		if (res != RedisConnect::TIMEOUT || len == data.length()) break;
+	}
+
+	trace = handler.out;
+
+	if (offset) *offset = decoder.getOffset();
+
+	return res;
+}
+
+// 可续传解析器：嵌套数组、空数组、RESP3 聚合类型、属性和格式错误，逐字节到达与一次到达的结果相同
+static void TestDecoder()
+{
+	const vector<pair<string, string>> replies = {
+		{"+OK\r\n", "+OK "},
+		{"-ERR failed\r\n", "-ERR failed "},
+		{":-42\r\n", ":-42 "},
+		{"$5\r\nhello\r\n", "$hello "},
+		{"$0\r\n\r\n", "$ "},
+		{"$-1\r\n", "$nil "},
+		{"$4\r\na\r\nb\r\n", "$a\r\nb "},
+		{"*0\r\n", "*0[ ] "},
+		{"*-1\r\n", "*nil "},
+		{"*3\r\n*2\r\n:1\r\n$3\r\nfoo\r\n*-1\r\n*0\r\n", "*3[ *2[ :1 $foo ] *nil *0[ ] ] "},
+		{"*2\r\n*1\r\n*1\r\n:7\r\n+x\r\n", "*2[ *1[ *1[ :7 ] ] +x ] "},
+		{"%2\r\n+a\r\n:1\r\n$1\r\nb\r\n_\r\n", "%4[ +a :1 $b _nil ] "},
+		{"~3\r\n#t\r\n#f\r\n,1.5\r\n", "~3[ #t #f ,1.5 ] "},
+		{">3\r\n$7\r\nmessage\r\n$2\r\nch\r\n$3\r\nmsg\r\n", ">3[ $message $ch $msg ] "},
+		{">2\r\n$10\r\ninvalidate\r\n*-1\r\n", ">2[ $invalidate *nil ] "},
+		{"|1\r\n+ttl\r\n:3\r\n:42\r\n", ":42 "},
+		{"*2\r\n|1\r\n+a\r\n*1\r\n:1\r\n:2\r\n:3\r\n", "*2[ :2 :3 ] "},
+		{"(12345678901234567890\r\n", "(12345678901234567890 "},
+		{"=7\r\ntxt:abc\r\n", "=txt:abc "},
+		{"!5\r\nerror\r\n", "!error "},
+		{"_\r\n", "_nil "}
+	};
+
+	for (auto& item : replies)
+	{
+		string whole;
+		string split;
+		int offset = 0;
+
+		CHECK(Decode(item.first, whole, item.first.length(), &offset) == RedisConnect::OK);
+		CHECK(Decode(item.first, split) == RedisConnect::OK);
+		CHECK(whole == item.second);
+		CHECK(split == item.second);
+		CHECK(offset == (int)(item.first.length()));
+	}
+
+	const vector<string> invalid = {"?\r\n", "$3\r\nfooX\r\n", "*x\r\n", "$ 3\r\nfoo\r\n", ":1\n", "*1\r\n$99999999999\r\n"};
+
+	for (const string& data : invalid)
+	{
+		string trace;
+
+		CHECK(Decode(data, trace) == RedisConnect::DATAERR);
+	}
+
+	// 数据不完整时等待，一次到达的多条应答只解析第一条
+	string trace;
+	int offset = 0;
+
+	CHECK(Decode("*2\r\n:1\r\n", trace) == RedisConnect::TIMEOUT);
+	CHECK(Decode("$5\r\nhel", trace) == RedisConnect::TIMEOUT);
+	CHECK(Decode(":1\r\n:2\r\n", trace, 64, &offset) == RedisConnect::OK);
+	CHECK(trace == ":1 " && offset == 4);
+
+	// 比接收缓冲区常驻上限更大的应答分多次读取，连接仍然可以继续使用
+	RedisMock mock;
+	RedisConnect redis;
+	string val(1024 * 1024, 'x');
+	string res;
+	vector<string> vec;
+
+	for (size_t i = 0; i < val.length(); i += 1000) val[i] = 'a' + i % 26;
+
+	CHECK(mock.start());
+	CHECK(redis.connect("127.0.0.1", mock.getPort(), 3000, 64 * 1024));
+	CHECK(redis.set("large", val) == RedisConnect::OK);
+	CHECK(redis.get("large", res) == RedisConnect::OK);
+	CHECK(res == val);
+	CHECK(redis.execute(vec, "mget", "large", "missing", "large") == 3);
+	CHECK(vec.size() == 3 && vec[0] == val && vec[1].empty() && vec[2] == val);
+	CHECK(redis.ping() == RedisConnect::OK);
+
+	string data = RedisMock::Array(2) + RedisMock::Bulk(val) + RedisMock::Integer(1);
+
+	CHECK(Decode(data, trace, 4096) == RedisConnect::OK);
+	CHECK(trace == "*2[ $" + val + " :1 ] ");
+}
+
+// 直接解析给定的应答数据，用于检查应答树
+class ReplyCommand : public RedisConnect::Command
+{
+public:
+	int load(const string& data)
+	{
+		reset();
+
+		return complete(parse(data.c_str(), data.length()));
+	}
+};
+
+// 应答树的访问接口：嵌套聚合类型的子元素、空值、错误和各种标量类型
+static void TestReply()
+{
+	typedef RedisConnect::Reply Reply;
+
+	ReplyCommand cmd;
+
+	// 嵌套的数组和映射，返回值为标量元素的个数
+	CHECK(cmd.load("*4\r\n:1\r\n*2\r\n$3\r\nfoo\r\n$-1\r\n%1\r\n+k\r\n:2\r\n*0\r\n") == 5);
+
+	Reply root = cmd.getReply();
+
+	CHECK(root.getType() == Reply::ARRAY && root.isAggregate() && root.size() == 4);
+	CHECK(root.toString().empty() && *root.data() == 0);
+	CHECK(root[0].getType() == Reply::INTEGER && root[0].getInteger() == 1);
+	CHECK(root[1].getType() == Reply::ARRAY && root[1].size() == 2);
+	CHECK(root[1][0].getType() == Reply::STRING && root[1][0].toString() == "foo" && root[1][0].size() == 3);
+	CHECK(root[1][1].isNil() && root[1][1].size() == 0 && root[1][1].toString().empty());
+	CHECK(root[2].getType() == Reply::MAP && root[2].size() == 2);
+	CHECK(root[2][0].getType() == Reply::STATUS && root[2][0].toString() == "k");
+	CHECK(root[2][1].getInteger() == 2);
+	CHECK(root[3].getType() == Reply::ARRAY && root[3].size() == 0);
+
+	// 越界和对标量取下标都返回空值节点
+	CHECK(root[4].isNil() && root[-1].isNil());
+	CHECK(root[0][0].isNil() && root[1][0][0].isNil());
+	CHECK(cmd.getDataList() == vector<string>({"1", "foo", "", "k", "2"}));
+
+	// 子元素全部为标量时按下标直接定位
+	CHECK(cmd.load("*3\r\n:10\r\n:20\r\n:30\r\n") == 3);
+	CHECK(cmd.getReply()[2].getInteger() == 30 && cmd.getReply()[0].getInteger() == 10);
+
+	// 空值
+	CHECK(cmd.load("$-1\r\n") == RedisConnect::NOTFOUND);
+	CHECK(cmd.getReply().isNil() && cmd.getReply().getInteger() == 0 && cmd.getDataList().empty());
+	CHECK(cmd.load("_\r\n") == RedisConnect::NOTFOUND && cmd.getReply().isNil());
+	CHECK(cmd.load("*-1\r\n") == 0 && cmd.getReply().isNil() && !cmd.getReply().isAggregate());
+
+	// 错误应答
+	CHECK(cmd.load("-ERR bad request\r\n") == RedisConnect::FAIL);
+	CHECK(cmd.getReply().isError() && cmd.getReply().toString() == "ERR bad request");
+	CHECK(cmd.getErrorString() == "ERR bad request");
+	CHECK(cmd.load("!5\r\nerror\r\n") == RedisConnect::FAIL && cmd.getReply().isError());
+	CHECK(cmd.load("*2\r\n-ERR first\r\n:1\r\n") == 2 && cmd.getReply()[0].isError() && !cmd.getReply()[1].isError());
+
+	// 标量类型
+	CHECK(cmd.load(":-7\r\n") == RedisConnect::OK && cmd.getStatus() == -7 && cmd.getReply().getInteger() == -7);
+	CHECK(cmd.load(",3.25\r\n") == RedisConnect::OK && cmd.getReply().getType() == Reply::DOUBLE && cmd.getReply().getDouble() == 3.25);
+	CHECK(cmd.load("#t\r\n") == RedisConnect::OK && cmd.getReply().getType() == Reply::BOOLEAN && cmd.getReply().getInteger() == 1);
+	CHECK(cmd.load("#f\r\n") == RedisConnect::OK && cmd.getReply().getInteger() == 0);
+	CHECK(cmd.load("(123456789012345678901\r\n") == RedisConnect::OK && cmd.getReply().getType() == Reply::BIGNUM);
+	CHECK(cmd.load("=7\r\ntxt:abc\r\n") == RedisConnect::OK && cmd.getReply().getType() == Reply::VERBATIM && cmd.get(0) == "txt:abc");
+	CHECK(cmd.load("$0\r\n\r\n") == RedisConnect::OK && !cmd.getReply().isNil() && cmd.getReply().size() == 0);
+
+	// 没有应答的命令返回空值节点
+	Reply empty;
+	RedisConnect::Command none("get");
+
+	CHECK(empty.isNil() && empty.size() == 0 && empty[0].isNil());
+	CHECK(none.getReply().isNil());
+
+	// 通过连接执行的命令，应答树保存在命令对象中
+	RedisMock mock;
+	RedisConnect redis;
+	RedisConnect::Command scan("scan");
+
+	CHECK(mock.start());
+	CHECK(redis.connect("127.0.0.1", mock.getPort()));
+	CHECK(redis.set("reply", "1") == RedisConnect::OK);
+
+	scan.add(0, "count", 100);
+
+	CHECK(redis.execute(scan) == 2);
+	CHECK(scan.getReply()[0].toString() == "0");
+	CHECK(scan.getReply()[1].getType() == Reply::ARRAY && scan.getReply()[1][0].toString() == "reply");
+}
+
+// 用于检查连接内部缓冲区的容量
+class BufferConnect : public RedisConnect
+{
+public:
+	int getBufferCapacity() const
+	{
+		return buffer.capacity();
+	}
+
+	int getWriterCapacity() const
+	{
+		return writer.capacity();
+	}
+};
+
+// 可伸缩缓冲区按需成倍扩容；连接的接收和发送缓冲区超过常驻上限时在命令结束后释放，
+// 空闲的连接由 trim 释放接收缓冲区
+static void TestBuffer()
+{
+	typedef RedisConnect::Buffer Buffer;
+
+	Buffer buf;
+	string data(10000, 'b');
+
+	CHECK(buf.capacity() == 0 && buf.size() == 0 && buf.data() == NULL);
+	CHECK(buf.reserve(1) != NULL && buf.capacity() == Buffer::MIN_SIZE);
+	CHECK(buf.append(data.c_str(), data.length()));
+	CHECK(buf.size() == 10000 && buf.capacity() == 4 * Buffer::MIN_SIZE);
+	CHECK(string(buf.data(), buf.size()) == data);
+
+	buf.erase(9000);
+
+	CHECK(buf.size() == 1000 && string(buf.data(), buf.size()) == data.substr(9000));
+	CHECK(buf.capacity() == 4 * Buffer::MIN_SIZE);
+
+	Buffer other(buf);
+
+	buf.release();
+
+	CHECK(buf.capacity() == 0 && buf.size() == 0);
+	CHECK(other.size() == 1000 && other.capacity() == Buffer::MIN_SIZE);
+
+	other.swap(buf);
+
+	CHECK(other.capacity() == 0 && buf.size() == 1000);
+
+	RedisMock mock;
+	BufferConnect small;
+	BufferConnect large;
+	RedisConnect::Pipeline pipe;
+	string val(100 * 1024, 'v');
+	const int memsz = 64 * 1024;
+
+	CHECK(mock.start());
+	CHECK(small.connect("127.0.0.1", mock.getPort(), 3000, memsz));
+	CHECK(large.connect("127.0.0.1", mock.getPort()));
+	CHECK(small.set("buffer", val) == RedisConnect::OK);
+
+	// 小应答不会使接收缓冲区扩容
+	CHECK(small.ping() == RedisConnect::OK);
+	CHECK(small.getBufferCapacity() <= Buffer::MIN_SIZE);
+
+	// 管道中的多条大应答使缓冲区扩容到常驻上限以上，执行完毕后释放
+	for (int i = 0; i < 16; i++) pipe.add("get", "buffer");
+
+	CHECK(small.execute(pipe) == RedisConnect::OK);
+	CHECK(pipe.get(15).get(0) == val);
+	CHECK(small.getBufferCapacity() <= memsz);
+	CHECK(large.execute(pipe) == RedisConnect::OK);
+	CHECK(pipe.get(15).get(0) == val);
+	CHECK(large.getBufferCapacity() > memsz);
+
+	// 空闲的连接释放接收缓冲区
+	large.trim(-1);
+
+	CHECK(large.getBufferCapacity() == 0);
+	CHECK(large.get("buffer") == val);
+
+	// 大量小参数的请求使发送缓冲区扩容，超过常驻上限时同样释放
+	map<string, string> kvs;
+
+	for (int i = 0; i < 10000; i++) kvs["buffer" + to_string(i)] = to_string(i);
+
+	CHECK(small.mset(kvs) == RedisConnect::OK);
+	CHECK(small.getWriterCapacity() <= memsz);
+	CHECK(large.mset(kvs) == RedisConnect::OK);
+	CHECK(large.getWriterCapacity() > memsz);
+	CHECK(small.get("buffer9999") == "9999");
+}
+
+#ifdef XG_LINUX
+// 等待异步命令完成，超过 3 秒视为没有完成
+static int Wait(future<int>& res)
+{
+	return res.wait_for(chrono::seconds(3)) == future_status::ready ? res.get() : RedisConnect::SYSERR;
+}
+
+// 异步客户端：future 和回调两种方式取得结果，没有对应命令的应答被丢弃，
+// 命令超时后重建连接，服务器重启后在重试间隔之后重新连接
+static void TestAsync()
+{
+	typedef AsyncRedisConnect::Command Command;
+
+	RedisMock mock;
+	AsyncRedisConnect redis;
+	string val(200 * 1024, 'a');
+
+	CHECK(mock.start());
+	CHECK(redis.connect("127.0.0.1", mock.getPort(), "secret", 500, 2, 1, 64 * 1024));
+
+	shared_ptr<Command> set = AsyncRedisConnect::NewCommand("set", "async", val);
+	shared_ptr<Command> get = AsyncRedisConnect::NewCommand("get", "async");
+	future<int> setres = redis.execute(set);
+
+	// 两条命令可能分配到不同的连接，等写入完成后再读取
+	CHECK(Wait(setres) == RedisConnect::OK);
+
+	future<int> getres = redis.execute(get);
+
+	CHECK(Wait(getres) == RedisConnect::OK && get->get(0) == val);
+
+	// 大量命令通过回调取得结果
+	const int count = 1000;
+	atomic<int> done(0);
+	atomic<int> matched(0);
+	promise<int> finished;
+	future<int> total = finished.get_future();
+
+	for (int i = 0; i < count; i++)
+	{
+		redis.execute(AsyncRedisConnect::NewCommand("incr", "async-counter"), [&](Command& cmd) {
+			if (cmd.getCode() == RedisConnect::OK) matched++;
+
+			if (++done == count) finished.set_value(count);
+		});
+	}
+
+	CHECK(Wait(total) == count && matched == count);
+
+	get = AsyncRedisConnect::NewCommand("get", "async-counter");
+	getres = redis.execute(get);
+
+	CHECK(Wait(getres) == RedisConnect::OK && get->get(0) == to_string(count));
+
+	// 订阅后推送的消息没有对应的命令，丢弃后后续命令的应答仍然对齐
+	AsyncRedisConnect single;
+
+	CHECK(single.connect("127.0.0.1", mock.getPort()));
+
+	shared_ptr<Command> sub = AsyncRedisConnect::NewCommand("subscribe", "async-channel");
+	future<int> subres = single.execute(sub);
+
+	CHECK(Wait(subres) >= 0);
+	CHECK(mock.execute({"publish", "async-channel", "message"}) == RedisMock::Integer(1));
+
+	this_thread::sleep_for(chrono::milliseconds(100));
+
+	get = AsyncRedisConnect::NewCommand("get", "async-counter");
+	getres = single.execute(get);
+
+	CHECK(Wait(getres) == RedisConnect::OK && get->get(0) == to_string(count));
+
+	single.close();
+
+	// 应答超过超时时间，命令以 TIMEOUT 结束，随后的命令通过新连接执行
+	mock.setDelay(800 * 1000);
+
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+	getres = redis.execute(AsyncRedisConnect::NewCommand("get", "async"));
+
+	CHECK(Wait(getres) == RedisConnect::TIMEOUT);
+	CHECK(GetElapsed(start) < 800);
+
+	mock.setDelay(0);
+
+	for (int i = 0; i < 2; i++)
+	{
+		get = AsyncRedisConnect::NewCommand("get", "async-counter");
+		getres = redis.execute(get);
+
+		CHECK(Wait(getres) == RedisConnect::OK && get->get(0) == to_string(count));
+	}
+
+	// 服务器停止后命令失败，重试间隔内直接失败；服务器恢复并经过重试间隔后重新连接
+	int port = mock.getPort();
+
+	mock.stop();
+
+	for (int i = 0; i < 4; i++)
+	{
+		getres = redis.execute(AsyncRedisConnect::NewCommand("get", "async"));
+
+		CHECK(Wait(getres) < 0);
+	}
+
+	start = chrono::steady_clock::now();
+
+	CHECK(!single.connect("127.0.0.1", port));
+	CHECK(GetElapsed(start) < 500);
+	CHECK(mock.start(port));
+
+	this_thread::sleep_for(chrono::milliseconds(1100));
+
+	for (int i = 0; i < 2; i++)
+	{
+		set = AsyncRedisConnect::NewCommand("set", "async", "2");
+		setres = redis.execute(set);
+
+		CHECK(Wait(setres) == RedisConnect::OK);
+	}
+}
+#endif
+
+#if defined(XG_LINUX) && defined(__cpp_impl_coroutine)
+// 协程依次执行各类命令，把结果记录为文本后交给测试线程
+static CoRedisConnect::CoTask RunCoroutine(CoRedisConnect& redis, promise<string>& res)
+{
+	string trace;
+
+	trace += to_string(co_await redis.set("co", "value")) + " ";
+
+	auto val = co_await redis.get("co");
+
+	trace += to_string(val.code) + val.value + " ";
+
+	auto nil = co_await redis.get("co-missing");
+
+	trace += to_string(nil.code) + " ";
+	trace += to_string(co_await redis.hset("co-hash", "field", "v")) + " ";
+	trace += to_string(co_await redis.hlen("co-hash")) + " ";
+	trace += to_string(co_await redis.zadd("co-zset", "a", 1)) + " ";
+	trace += to_string(co_await redis.zadd("co-zset", "b", 2)) + " ";
+
+	auto list = co_await redis.zrange("co-zset", 0, -1, true);
+
+	trace += to_string(list.code);
+
+	for (const string& item : list.value) trace += ":" + item;
+
+	trace += " " + to_string(co_await redis.ttl("co"));
+	trace += " " + to_string(co_await redis.ping());
+
+	res.set_value(trace);
+}
+
+// 协程接口：co_await 在应答到达后由事件循环线程恢复，结果与同步接口的返回值一致
+static void TestCoroutine()
+{
+	RedisMock mock;
+	CoRedisConnect redis;
+	promise<string> res;
+	future<string> trace = res.get_future();
+
+	CHECK(mock.start());
+	CHECK(redis.connect("127.0.0.1", mock.getPort()));
+
+	RunCoroutine(redis, res);
+
+	CHECK(trace.wait_for(chrono::seconds(3)) == future_status::ready);
+	CHECK(trace.get() == "1 1value -9 1 1 1 1 4:a:1:b:2 -1 1");
+}
+#endif
+
+// 资源池中的对象，owners 记录同时持有它的线程数
+struct PoolItem
+{
+	atomic<int> owners;
+
+	PoolItem() : owners(0) {}
+};
+
+// 多个线程同时取出和归还对象，期间反复调整容量：同一个对象不会同时交给两个线程，
+// 全部归还后已取出的个数回到0，空闲对象个数与容量一致
+static void TestPoolStress()
+{
+	const int threads = 8;
+	const int rounds = 20000;
+	atomic<bool> running(true);
+	atomic<int> created(0);
+	atomic<int> misses(0);
+	atomic<int> duplicates(0);
+	vector<thread> workers;
+	ResPool<PoolItem> pool([&]() {
+		created++;
+
+		return make_shared<PoolItem>();
+	}, 4, 60);
+
+	for (int i = 0; i < threads; i++)
+	{
+		workers.push_back(thread([&]() {
+			for (int j = 0; j < rounds; j++)
+			{
+				shared_ptr<PoolItem> item = pool.get(1000);
+
+				if (!item)
+				{
+					misses++;
+
+					continue;
+				}
+
+				if (item->owners.fetch_add(1) != 0) duplicates++;
+
+				if (j % 8 == 0) this_thread::yield();
+
+				item->owners.fetch_sub(1);
+			}
+		}));
+	}
+
+	thread resizer([&]() {
+		for (int i = 0; running; i++)
+		{
+			pool.setLength(2 + i % 5);
+
+			this_thread::sleep_for(chrono::milliseconds(5));
+		}
+	});
+
+	for (thread& item : workers) item.join();
+
+	running = false;
+	resizer.join();
+
+	CHECK(misses == 0);
+	CHECK(duplicates == 0);
+	CHECK(pool.getUsedCount() == 0);
+
+	// 对象被获取100次后重新创建，创建次数不会远超过这个比例
+	pool.setLength(4);
+
+	CHECK(created < threads * rounds / 50 + 100);
+
+	// 容量内的对象可以同时取出且各不相同，超过容量时不等待直接返回空指针
+	vector<shared_ptr<PoolItem>> vec;
+
+	for (int i = 0; i < pool.getLength(); i++) vec.push_back(pool.get(0));
+
+	CHECK(pool.getUsedCount() == 4);
+	CHECK(!pool.get(0));
+
+	for (size_t i = 0; i < vec.size(); i++)
+	{
+		CHECK(vec[i] && vec[i]->owners.fetch_add(1) == 0);
+	}
+
+	vec.clear();
+
+	CHECK(pool.getUsedCount() == 0);
+}
+
+// 资源池耗尽时等待的线程在对象归还后立即被唤醒，没有归还时在截止时间返回空指针
+static void TestPoolWait()
+{
+	ResPool<PoolItem> pool([]() {
+		return make_shared<PoolItem>();
+	}, 1, 60);
+
+	shared_ptr<PoolItem> item = pool.get(0);
+
+	CHECK(item && !pool.get(0));
+
+	// 另一个线程持有对象 100 毫秒后归还，等待线程随即取得同一个对象
+	PoolItem* ptr = item.get();
+	long long waited = 0;
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	thread releaser([&]() {
+		this_thread::sleep_for(chrono::milliseconds(100));
+
+		item.reset();
+	});
+
+	shared_ptr<PoolItem> next = pool.get(3000, &waited);
+	long long elapsed = GetElapsed(start);
+
+	releaser.join();
+
+	CHECK(next.get() == ptr);
+	CHECK(elapsed >= 90 && elapsed < 1000);
+	CHECK(waited >= 90 * 1000 && waited < 1000 * 1000);
+	CHECK(pool.getWaitCount() == 1);
+
+	// 一直没有归还时等待到截止时间
+	start = chrono::steady_clock::now();
+
+	shared_ptr<PoolItem> none = pool.get(200, &waited);
+
+	elapsed = GetElapsed(start);
+
+	CHECK(!none);
+	CHECK(elapsed >= 200 && elapsed < 1000);
+	CHECK(waited >= 200 * 1000);
+	CHECK(pool.getWaitCount() == 2);
+
+	// 多个等待线程按归还的次数依次被唤醒
+	atomic<int> done(0);
+	vector<thread> waiters;
+
+	for (int i = 0; i < 3; i++)
+	{
+		waiters.push_back(thread([&]() {
+			shared_ptr<PoolItem> item = pool.get(3000);
+
+			if (item)
+			{
+				this_thread::sleep_for(chrono::milliseconds(20));
+
+				done++;
+			}
+		}));
+	}
+
+	this_thread::sleep_for(chrono::milliseconds(50));
+
+	start = chrono::steady_clock::now();
+	next.reset();
+
+	for (thread& item : waiters) item.join();
+
+	CHECK(done == 3);
+	CHECK(GetElapsed(start) < 1000);
+	CHECK(pool.getUsedCount() == 0);
+}
+
+// 连接池维护线程：启动后预先建立 min_idle 个连接，定期检查空闲连接，
+// 空闲超时的连接被重新建立，被禁用的连接归还时丢弃
+static void TestPoolMaintain()
+{
+	RedisMock mock;
+
+	CHECK(mock.start());
+
+	int minidle = RedisConnect::POOL_MINIDLE;
+
+	RedisConnect::POOL_MINIDLE = 2;
+
+	RedisPool pool("127.0.0.1", mock.getPort(), 0, "", 3000, 2 * 1024 * 1024, 4);
+
+	RedisConnect::POOL_MINIDLE = minidle;
+
+	CHECK(pool.getMinIdle() == 2);
+
+	// 预先建立的连接由后台线程创建，取出时不再建立新连接
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+	while (pool.getConnectCount() < 2 && GetElapsed(start) < 3000) this_thread::sleep_for(chrono::milliseconds(10));
+
+	CHECK(pool.getConnectCount() == 2);
+
+	{
+		shared_ptr<RedisConnect> first = pool.grasp();
+		shared_ptr<RedisConnect> second = pool.grasp();
+
+		CHECK(first && second && first != second);
+		CHECK(first->ping() == RedisConnect::OK && second->ping() == RedisConnect::OK);
+		CHECK(pool.getConnectCount() == 2);
+	}
+
+	// 空闲连接逐个检查是否可用
+	long long cmds = mock.getCommandCount();
+
+	pool.maintain(0);
+
+	CHECK(mock.getCommandCount() - cmds >= 2);
+	CHECK(pool.getConnectCount() == 2);
+
+	// 空闲超过超时时间的连接被丢弃，维护线程重新建立到 min_idle 个
+	pool.setTimeout(1);
+
+	this_thread::sleep_for(chrono::milliseconds(2100));
+
+	pool.maintain(0);
+
+	CHECK(pool.getConnectCount() == 4);
+	CHECK(pool.getConnectErrorCount() == 0);
+
+	pool.setTimeout(60);
+
+	// 被禁用的连接归还时丢弃，下次取出时建立新连接
+	{
+		shared_ptr<RedisConnect> redis = pool.grasp();
+
+		CHECK(redis != NULL);
+
+		pool.disable(redis);
+	}
+
+	shared_ptr<RedisConnect> redis = pool.grasp();
+
+	CHECK(redis && redis->ping() == RedisConnect::OK);
+	CHECK(pool.getConnectCount() == 5);
+	CHECK(pool.getUsedCount() == 1);
+}
+
+// 连接池注册表按地址、数据库和密码区分连接池；调整容量时空闲连接转移到新的位置表，
+// 调整期间被取出的连接归还时丢弃
+static void TestPoolRegistry()
+{
+	RedisMock mock;
+	RedisPoolRegistry* registry = RedisPoolRegistry::Instance();
+
+	CHECK(mock.start());
+
+	const int port = mock.getPort();
+
+	CHECK(registry->find("127.0.0.1", port) == NULL);
+
+	RedisPool& pool = registry->get("127.0.0.1", port, 0, "", 3000, 2 * 1024 * 1024, 2);
+
+	CHECK(&registry->get("127.0.0.1", port) == &pool);
+	CHECK(registry->find("127.0.0.1", port) == &pool);
+	CHECK(&registry->get("127.0.0.1", port, 1) != &pool);
+	CHECK(&registry->get("127.0.0.1", port, 0, "secret") != &pool);
+	CHECK(registry->find("127.0.0.1", port, 2) == NULL);
+	CHECK(pool.getLength() == 2 && pool.getName() == "127.0.0.1:" + to_string(port) + "/0");
+
+	vector<RedisPool*> pools = registry->getPools();
+
+	CHECK(std::count(pools.begin(), pools.end(), &pool) == 1);
+
+	// 一个连接保持取出状态，另一个归还后成为空闲连接
+	shared_ptr<RedisConnect> held = pool.grasp();
+	RedisConnect* idle = pool.grasp().get();
+
+	CHECK(held && idle && pool.getConnectCount() == 2);
+	CHECK(pool.getUsedCount() == 1);
+
+	pool.setLength(4);
+
+	CHECK(pool.getLength() == 4);
+
+	// 空闲连接转移到新的位置表，取出时不建立新连接
+	shared_ptr<RedisConnect> first = pool.grasp();
+
+	CHECK(first.get() == idle && pool.getConnectCount() == 2);
+	CHECK(first->ping() == RedisConnect::OK);
+
+	// 调整前取出的连接归还到已替换的位置表时丢弃，新表中的位置不受影响
+	held.reset();
+
+	CHECK(pool.getUsedCount() == 1);
+
+	shared_ptr<RedisConnect> second = pool.grasp();
+	shared_ptr<RedisConnect> third = pool.grasp();
+	shared_ptr<RedisConnect> fourth = pool.grasp();
+
+	CHECK(second && third && fourth && pool.getConnectCount() == 5);
+	CHECK(!pool.get(0));
+	CHECK(pool.getUsedCount() == 4);
+
+	first.reset();
+	second.reset();
+	third.reset();
+	fourth.reset();
+
+	CHECK(pool.getUsedCount() == 0);
+
+	// 注册表中的连接池保留到进程退出，丢弃连接以免后续用例的模拟服务器复用同一端口
+	for (RedisPool* item : registry->getPools()) item->clear();
+}
+
+// 读写分离：只读命令交给往返时间最短的从节点，较慢的从节点只承担定期探测；
+// 写命令发送到主节点；从节点全部停止后只读命令改由主节点执行
+static void TestReplica()
+{
+	RedisMock primary;
+	RedisMock slow;
+	RedisMock fast;
+	RedisReplicaConnect redis;
+
+	CHECK(primary.start() && slow.start() && fast.start());
+
+	// 各节点保存不同的值，根据读到的值判断命令由哪个节点执行
+	primary.execute({"set", "replica", "p"});
+	slow.execute({"set", "replica", "slow"});
+	fast.execute({"set", "replica", "fast"});
+	slow.setDelay(20 * 1000);
+
+	CHECK(redis.connect("127.0.0.1", primary.getPort(), "", 1000));
+	CHECK(redis.addReplica("127.0.0.1", slow.getPort()));
+	CHECK(redis.addReplica("127.0.0.1", fast.getPort()));
+	CHECK(redis.getReplicas().size() == 2);
+
+	map<string, int> served;
+
+	for (int i = 0; i < 48; i++) served[redis.get("replica")]++;
+
+	CHECK(served["p"] == 0);
+	CHECK(served["slow"] >= 1 && served["slow"] <= 3);
+	CHECK(served["fast"] >= 45);
+	CHECK(redis.getReplicas()[0]->getRTT() > redis.getReplicas()[1]->getRTT());
+
+	// 写命令只发送到主节点
+	CHECK(redis.set("written", "1") == RedisConnect::OK);
+	CHECK(primary.execute({"get", "written"}) == RedisMock::Bulk("1"));
+	CHECK(fast.execute({"get", "written"}) == RedisMock::Nil());
+
+	// keys 在从节点上通过 SCAN 遍历
+	vector<string> vec;
+
+	for (int i = 0; i < 250; i++)
+	{
+		slow.execute({"set", "replica-key" + to_string(i), "1"});
+		fast.execute({"set", "replica-key" + to_string(i), "1"});
+	}
+
+	long long cmds = primary.getCommandCount();
+
+	CHECK(redis.keys(vec, "replica-key*") == 250 && vec.size() == 250);
+	CHECK(primary.getCommandCount() == cmds);
+
+	// 从节点全部停止，已建立的连接中断后由主节点重新执行，之后不再选择从节点
+	slow.stop();
+	fast.stop();
+
+	served.clear();
+
+	for (int i = 0; i < 20; i++) served[redis.get("replica")]++;
+
+	CHECK(served["p"] == 20);
+	CHECK(redis.keys(vec, "replica-key*") == 0);
+	CHECK(redis.ttl("replica") == -1);
+
+	for (RedisPool* item : RedisPoolRegistry::Instance()->getPools()) item->clear();
+}
+
+// 等待条件成立，最多等待 3 秒
+static bool WaitFor(function<bool()> func)
+{
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+	while (!func())
+	{
+		if (GetElapsed(start) > 3000) return false;
+
+		this_thread::sleep_for(chrono::milliseconds(5));
+	}
+
+	return true;
+}
+
+// 本地缓存：读取结果被缓存，服务端推送失效消息后删除；读取期间键被修改时旧值不写入缓存；
+// 分片已满时访问频率低的新键不会挤掉热点键
+static void TestCache()
+{
+	RedisMock mock;
+	RedisConnect redis;
+
+	CHECK(mock.start());
+	CHECK(redis.connect("127.0.0.1", mock.getPort()));
+
+	RedisPool pool("127.0.0.1", mock.getPort());
+	RedisCache cache(4, 1);
+
+	CHECK(cache.start(pool, {"cache:"}));
+	CHECK(WaitFor([&]() { return cache.isActive(); }));
+
+	// 第二次读取命中缓存，不匹配前缀的键不缓存
+	CHECK(redis.set("cache:a", "1") == RedisConnect::OK);
+	CHECK(WaitFor([&]() { return cache.getInvalidateCount() == 1; }));
+	CHECK(cache.get("cache:a") == "1" && cache.get("cache:a") == "1");
+	CHECK(cache.getHitCount() == 1 && cache.getMissCount() == 1 && cache.size() == 1);
+	CHECK(cache.get("other") == "" && cache.get("other") == "");
+	CHECK(cache.getMissCount() == 3);
+
+	// 其它连接修改键后收到失效消息，再次读取得到新值
+	CHECK(redis.set("cache:a", "2") == RedisConnect::OK);
+	CHECK(WaitFor([&]() { return cache.getInvalidateCount() == 2; }));
+	CHECK(cache.get("cache:a") == "2");
+	CHECK(cache.getMissCount() == 4);
+
+	mock.execute({"hset", "cache:h", "f", "v"});
+
+	CHECK(WaitFor([&]() { return cache.getInvalidateCount() == 3; }));
+	CHECK(cache.hget("cache:h", "f") == "v" && cache.hget("cache:h", "f") == "v");
+	CHECK(cache.size() == 2);
+
+	// FLUSHALL 推送空值，清空全部缓存
+	CHECK(redis.execute("flushall") == RedisConnect::OK);
+	CHECK(WaitFor([&]() { return cache.size() == 0; }));
+	CHECK(cache.get("cache:a") == "");
+
+	// 读取的应答在途时键被修改，失效消息先于应答到达，读到的旧值不写入缓存
+	long long invalids = cache.getInvalidateCount();
+
+	mock.execute({"set", "cache:race", "old"});
+
+	CHECK(WaitFor([&]() { return cache.getInvalidateCount() == invalids + 1; }));
+
+	invalids = cache.getInvalidateCount();
+	mock.setDelay(300 * 1000);
+	string stale;
+	thread reader([&]() {
+		stale = cache.get("cache:race");
+	});
+
+	this_thread::sleep_for(chrono::milliseconds(100));
+
+	mock.execute({"set", "cache:race", "new"});
+
+	reader.join();
+	mock.setDelay(0);
+
+	CHECK(stale == "old");
+	CHECK(cache.getInvalidateCount() > invalids);
+	CHECK(cache.get("cache:race") == "new");
+
+	// 热点键多次读取后占满分片，只读取一次的键不被接纳
+	cache.clear();
+
+	for (int i = 0; i < 4; i++) mock.execute({"set", "cache:hot" + to_string(i), "hot"});
+
+	CHECK(WaitFor([&]() { return cache.getInvalidateCount() == invalids + 5; }));
+
+	for (int i = 0; i < 4; i++)
+	{
+		for (int j = 0; j < 3; j++) CHECK(cache.get("cache:hot" + to_string(i)) == "hot");
+	}
+
+	CHECK(cache.size() == 4);
+
+	long long rejects = cache.getRejectCount();
+	long long evicts = cache.getEvictCount();
+
+	for (int i = 0; i < 20; i++) CHECK(cache.get("cache:cold" + to_string(i)) == "");
+
+	CHECK(cache.getRejectCount() - rejects == 20);
+	CHECK(cache.getEvictCount() == evicts);
+
+	long long hits = cache.getHitCount();
+
+	for (int i = 0; i < 4; i++) CHECK(cache.get("cache:hot" + to_string(i)) == "hot");
+
+	CHECK(cache.getHitCount() - hits == 4);
+
+	// 频繁读取的新键最终被接纳并淘汰一个热点键
+	for (int i = 0; i < 6; i++) cache.get("cache:cold0");
+
+	CHECK(cache.getEvictCount() > evicts);
+
+	cache.stop();
+
+	CHECK(!cache.isActive());
+}
+
+// 多个线程同时读取同一个键只向服务器发送一次请求，其余线程复制同一个结果；写命令不合并
+static void TestSingleFlight()
+{
+	const int threads = 8;
+	RedisMock mock;
+
+	CHECK(mock.start());
+
+	mock.execute({"set", "flight", "value"});
+
+	RedisPool pool("127.0.0.1", mock.getPort());
+	RedisSingleFlight flight(pool);
+	atomic<int> ready(0);
+	atomic<int> matched(0);
+	vector<thread> workers;
+	long long cmds = mock.getCommandCount();
+
+	// 应答延迟期间全部线程都已开始等待
+	mock.setDelay(200 * 1000);
+
+	for (int i = 0; i < threads; i++)
+	{
+		workers.push_back(thread([&]() {
+			ready++;
+
+			while (ready < threads) this_thread::yield();
+
+			if (flight.get("flight") == "value") matched++;
+		}));
+	}
+
+	for (thread& item : workers) item.join();
+
+	mock.setDelay(0);
+
+	CHECK(matched == threads);
+	CHECK(mock.getCommandCount() - cmds == 1);
+	CHECK(flight.getExecuteCount() == 1);
+	CHECK(flight.getShareCount() == threads - 1);
+
+	// 结果复制给各个线程后，后续读取重新发送请求
+	CHECK(flight.get("flight") == "value");
+	CHECK(flight.getExecuteCount() == 2);
+
+	// 写命令和不存在的键
+	CHECK(flight.execute("set", "flight", "next") == RedisConnect::OK);
+	CHECK(flight.get("flight") == "next");
+	CHECK(flight.get("missing") == "");
+	CHECK(flight.getExecuteCount() == 5);
+	CHECK(mock.getCommandCount() - cmds == 5);
+}
+
+// 跨线程批量发送：多个调用线程的命令合并为管道发送，各自得到自己的结果；
+// 依赖连接状态的命令和发送线程停止后的命令直接执行；服务器停止后命令返回错误码
+static void TestDispatcher()
+{
+	const int threads = 16;
+	const int rounds = 50;
+	RedisMock mock;
+
+	CHECK(mock.start());
+
+	RedisPool pool("127.0.0.1", mock.getPort());
+	RedisDispatcher dispatcher(pool);
+	atomic<int> matched(0);
+	vector<thread> workers;
+
+	CHECK(dispatcher.start(2));
+	CHECK(!dispatcher.start(2));
+
+	// 应答稍有延迟，发送期间到达的命令在下一批中一起发出
+	mock.setDelay(2 * 1000);
+
+	for (int i = 0; i < threads; i++)
+	{
+		workers.push_back(thread([&, i]() {
+			string key = "dispatch" + to_string(i);
+
+			for (int j = 0; j < rounds; j++)
+			{
+				string val;
+				string data = to_string(i * rounds + j);
+
+				if (dispatcher.set(key, data) == RedisConnect::OK && dispatcher.get(key, val) == RedisConnect::OK && val == data) matched++;
+			}
+		}));
+	}
+
+	for (thread& item : workers) item.join();
+
+	mock.setDelay(0);
+
+	CHECK(matched == threads * rounds);
+	CHECK(dispatcher.getCommandCount() == threads * rounds * 2);
+	CHECK(dispatcher.getBatchSize() > 1);
+	CHECK(dispatcher.getBatchCount() < threads * rounds * 2);
+
+	// 不存在的键和错误应答
+	string val;
+	RedisDispatcher::Command wrong("hget");
+
+	wrong.add("dispatch0", "field");
+
+	CHECK(dispatcher.get("dispatch-missing", val) == RedisConnect::NOTFOUND);
+	CHECK(dispatcher.execute(wrong) == RedisConnect::FAIL);
+	CHECK(wrong.getErrorString().compare(0, 9, "WRONGTYPE") == 0);
+
+	// 依赖连接状态的命令不参与合并
+	long long cmds = dispatcher.getCommandCount();
+
+	CHECK(dispatcher.execute("select", 0) == RedisConnect::OK);
+	CHECK(dispatcher.getCommandCount() == cmds);
+
+	// 发送线程停止后直接执行
+	dispatcher.stop();
+
+	CHECK(dispatcher.get("dispatch0", val) == RedisConnect::OK && val == to_string(rounds - 1));
+	CHECK(dispatcher.getCommandCount() == cmds);
+
+	// 服务器停止后，发送线程持有的连接和重新获取的连接都失败
+	CHECK(dispatcher.start(1));
+
+	mock.stop();
+
+	CHECK(dispatcher.get("dispatch0", val) < 0);
+	CHECK(dispatcher.set("dispatch0", "1") < 0);
+}
+
+// Prometheus 文本格式：每个指标族只声明一次且先于样本声明，计数器以 _total 结尾，
+// summary 只带 _sum 和 _count 后缀，样本值均为数字
+static void TestMetrics()
+{
+	RedisMock mock;
+
+	CHECK(mock.start());
+
+	RedisMetrics::Enable();
+	RedisMetrics::Instance()->reset();
+
+	RedisPool& pool = RedisPoolRegistry::Instance()->get("127.0.0.1", mock.getPort());
+
+	{
+		shared_ptr<RedisConnect> redis = pool.grasp();
+
+		CHECK(redis && redis->set("metrics", "1") == RedisConnect::OK);
+		CHECK(redis->get("metrics") == "1" && redis->get("missing").empty());
+	}
+
+	string text = RedisMetrics::Instance()->toPrometheus();
+
+	RedisMetrics::Enable(false);
+
+	string family;
+	string type;
+	set<string> families;
+	stringstream stream(text);
+
+	for (string line; getline(stream, line); )
+	{
+		if (line.compare(0, 7, "# HELP ") == 0) continue;
+
+		if (line.compare(0, 7, "# TYPE ") == 0)
+		{
+			stringstream header(line.substr(7));
+
+			header >> family >> type;
+
+			// 计数器的族名不包含 _total 后缀
+			string base = family;
+
+			if (type == "counter")
+			{
+				CHECK(base.length() > 6 && base.compare(base.length() - 6, 6, "_total") == 0);
+
+				base = base.substr(0, base.length() - 6);
+			}
+
+			CHECK(type == "counter" || type == "gauge" || type == "summary");
+			CHECK(families.insert(base).second);
+
+			continue;
+		}
+
+		size_t end = line.find_first_of("{ ");
+		size_t pos = line.rfind(' ');
+		string name = line.substr(0, end);
+		string value = line.substr(pos + 1);
+		char* tail = NULL;
+
+		strtod(value.c_str(), &tail);
+
+		CHECK(!family.empty() && end != string::npos && pos != string::npos);
+		CHECK(!value.empty() && *tail == 0);
+		CHECK(name == family || (type == "summary" && (name == family + "_sum" || name == family + "_count")));
+	}
+
+	CHECK(families.count("redis_client_pool_wait_seconds") == 1);
+	CHECK(families.count("redis_client_pool_wait_time_seconds") == 1);
+	CHECK(text.find("redis_client_pool_wait_time_seconds_total{pool=\"127.0.0.1:" + to_string(mock.getPort()) + "/0\"}") != string::npos);
+	CHECK(text.find("redis_client_command_calls_total{command=\"get\"} 2") != string::npos);
+	CHECK(text.find("redis_client_misses_total 1") != string::npos);
+
+	pool.clear();
+}
+
+// 按模式删除键：分别统计遍历到的和实际删除的键，遍历后过期的键不计入删除个数；
+// 服务器不支持 UNLINK 时改用 DEL
+static void TestDels()
+{
+	RedisMock mock;
+	RedisConnect redis;
+	long long scanned = 0;
+	long long deleted = 0;
+	long long progress = 0;
+
+	CHECK(mock.start());
+	CHECK(redis.connect("127.0.0.1", mock.getPort()));
+
+	for (int i = 0; i < 2500; i++) mock.execute({"set", "dels:" + to_string(i), "1"});
+
+	for (int i = 0; i < 10; i++) mock.execute({"set", "keep:" + to_string(i), "1"});
+
+	CHECK(redis.dels("dels:*", scanned, deleted, [&](long long num, long long) {
+		progress = num;
+	}) == RedisConnect::OK);
+	CHECK(scanned == 2500 && deleted == 2500 && progress == 2500);
+	CHECK(mock.execute({"dbsize"}) == RedisMock::Integer(10));
+
+	// 没有匹配的键
+	CHECK(redis.dels("dels:*", scanned, deleted) == RedisConnect::OK);
+	CHECK(scanned == 0 && deleted == 0);
+
+	// 遍历到的键在删除之前过期
+	for (int i = 0; i < 5; i++) mock.execute({"set", "dels:ttl" + to_string(i), "1", "px", "100"});
+
+	mock.setDelay(200 * 1000);
+
+	CHECK(redis.dels("dels:ttl*", scanned, deleted) == RedisConnect::OK);
+	CHECK(scanned == 5 && deleted == 0);
+
+	mock.setDelay(0);
+
+	// 不支持 UNLINK 时改用 DEL
+	mock.disable("unlink");
+
+	CHECK(redis.execute("unlink", "keep:0") == RedisConnect::FAIL);
+	CHECK(redis.dels("keep:*", scanned, deleted) == RedisConnect::OK);
+	CHECK(scanned == 10 && deleted == 10);
+	CHECK(mock.execute({"dbsize"}) == RedisMock::Integer(0));
+
+	// 连接中断时返回错误码
+	mock.execute({"set", "dels:0", "1"});
+	mock.stop();
+
+	CHECK(redis.dels("dels:*", scanned, deleted) < 0);
+}
+
+// 从一个节点导出后导入另一个节点，比较两边的数据，并验证导入时重复的记录以最后一条为准
+static void TestTransfer()
+{
+	RedisMock a;
+	RedisMock b;
+	RedisTransfer::Config cfg;
+	RedisTransfer::Progress result;
+
+	CHECK(a.start() && b.start());
+
+	for (int i = 0; i < 100; i++) a.execute({"set", "str:" + to_string(i), "val" + to_string(i)});
+
+	a.execute({"hset", "hash", "name", "redis"});
+	a.execute({"sadd", "set", "x", "y"});
+	a.execute({"zadd", "zset", "1", "m"});
+	a.execute({"set", "ttl", "1", "px", "60000"});
+
+	auto callback = [&](const RedisTransfer::Progress& progress, bool finished) {
+		if (finished) result = progress;
+	};
+
+	FILE* fp = tmpfile();
+
+	CHECK(fp != NULL);
+
+	cfg.port = a.getPort();
+
+	CHECK(RedisTransfer(cfg).exportTo("*", fp, callback) == RedisConnect::OK);
+	CHECK(result.commands == 104 && result.errors == 0);
+
+	rewind(fp);
+	cfg.port = b.getPort();
+
+	CHECK(RedisTransfer(cfg).importFrom(fp, callback) == RedisConnect::OK);
+	CHECK(result.commands == 104 && result.errors == 0);
+	CHECK(b.execute({"dbsize"}) == RedisMock::Integer(104));
+
+	for (int i = 0; i < 100; i++) CHECK(b.execute({"get", "str:" + to_string(i)}) == RedisMock::Bulk("val" + to_string(i)));
+
+	CHECK(b.execute({"hget", "hash", "name"}) == RedisMock::Bulk("redis"));
+	CHECK(b.execute({"sismember", "set", "x"}) == RedisMock::Integer(1) && b.execute({"sismember", "set", "y"}) == RedisMock::Integer(1));
+	CHECK(b.execute({"zscore", "zset", "m"}) == a.execute({"zscore", "zset", "m"}));
+	CHECK(b.execute({"get", "ttl"}) == RedisMock::Bulk("1") && b.execute({"pttl", "ttl"}) != RedisMock::Integer(-1));
+
+	fclose(fp);
+
+	// 同一个键的两条记录，导入后保留后一条的值
+	string data = RedisTransfer::GetMagic();
+
+	for (const char* val : {"old", "new"}) {
+		RedisConnect redis;
+		RedisConnect::Command cmd("dump");
+
+		a.execute({"set", "dup", val});
+		cmd.add("dup");
+
+		CHECK(redis.connect("127.0.0.1", a.getPort()));
+		CHECK(redis.execute(cmd) > 0);
+
+		RedisConnect::Reply reply = cmd.getReply();
+
+		RedisTransfer::PutVarint(data, 3);
+		data += "dup";
+		RedisTransfer::PutVarint(data, reply.size());
+		data.append(reply.data(), reply.size());
+		RedisTransfer::PutVarint(data, 0);
+	}
+
+	fp = tmpfile();
+
+	CHECK(fp != NULL && fwrite(data.data(), 1, data.length(), fp) == data.length());
+
+	rewind(fp);
+
+	CHECK(RedisTransfer(cfg).importFrom(fp, callback) == RedisConnect::OK);
+	CHECK(result.commands == 2 && result.errors == 0);
+	CHECK(b.execute({"get", "dup"}) == RedisMock::Bulk("new"));
+
+	fclose(fp);
+}
+
+// 两个节点各负责一半槽位，验证按槽位路由以及跟随 MOVED 和 ASK 重定向
+static void TestCluster()
+{
+	RedisMock a;
+	RedisMock b;
+
+	CHECK(a.start() && b.start());
+
+	const int half = RedisClusterConnect::SLOT_COUNT / 2;
+
+	for (RedisMock* mock : {&a, &b})
+	{
+		mock->addSlots(0, half - 1, a.getPort());
+		mock->addSlots(half, RedisClusterConnect::SLOT_COUNT - 1, b.getPort());
+	}
+
+	RedisClusterConnect cluster;
+	string lo = GetKey("lo", 0, half - 1);
+	string hi = GetKey("hi", half, RedisClusterConnect::SLOT_COUNT - 1);
+
+	CHECK(cluster.connect("127.0.0.1", a.getPort()));
+	CHECK(cluster.set(lo, "1") > 0);
+	CHECK(cluster.set(hi, "2") > 0);
+	CHECK(a.execute({"get", lo}) == RedisMock::Bulk("1"));
+	CHECK(b.execute({"get", hi}) == RedisMock::Bulk("2"));
+
+	// 槽位迁到 b 之后客户端的槽位表已经过时，a 返回 MOVED
+	string moved = GetKey("moved", 0, half - 1);
+	int slot = RedisClusterConnect::GetSlot(moved);
+
+	b.execute({"set", moved, "moved"});
+
+	for (RedisMock* mock : {&a, &b}) mock->addSlots(slot, slot, b.getPort());
+
+	CHECK(cluster.get(moved) == "moved");
+	CHECK(cluster.getPool(slot) == RedisPoolRegistry::Instance()->find("127.0.0.1", b.getPort()));
+
+	// 槽位正在从 a 迁往 b，a 上不存在的键返回 ASK，b 只接受 ASKING 之后的命令
+	string ask = GetKey("ask", 0, half - 1);
+
+	slot = RedisClusterConnect::GetSlot(ask);
+	b.execute({"set", ask, "ask"});
+	a.setMigrating(slot, b.getPort());
+	b.setImporting(slot, true);
+
+	{
+		RedisConnect redis;
+
+		CHECK(redis.connect("127.0.0.1", b.getPort()));
+		CHECK(redis.execute("get", ask) == RedisConnect::FAIL);
+		CHECK(redis.getErrorString().compare(0, 6, "MOVED ") == 0);
+	}
+
+	CHECK(cluster.get(ask) == "ask");
+	CHECK(cluster.getPool(slot) == RedisPoolRegistry::Instance()->find("127.0.0.1", a.getPort()));
+
+	// 连接池耗尽时命令没有发送，返回错误码，并且只等待一次，不会反复等待同一个节点
+	string val;
+	RedisPool* pool = cluster.getPool(RedisClusterConnect::GetSlot(lo));
+	vector<shared_ptr<RedisConnect>> conns;
+	int wait = RedisConnect::POOL_WAITTIME;
+	chrono::steady_clock::time_point start;
+
+	RedisConnect::POOL_WAITTIME = 200;
+
+	while (shared_ptr<RedisConnect> redis = pool->grasp(0)) conns.push_back(redis);
+
+	start = chrono::steady_clock::now();
+
+	CHECK(cluster.get(lo, val) == RedisConnect::NETERR);
+	CHECK(GetElapsed(start) < 1000);
+
+	conns.clear();
+	RedisConnect::POOL_WAITTIME = wait;
+
+	// 节点已停止时同样返回错误码，而不是成功和空值
+	RedisClusterConnect::Command cmd("get");
+
+	start = chrono::steady_clock::now();
+	a.stop();
+	cmd.add(lo);
+
+	CHECK(cluster.execute(cmd) < 0);
+	CHECK(cmd.getCode() < 0);
+	CHECK(GetElapsed(start) < 3000);
+	CHECK(cluster.get(lo, val) < 0);
+	CHECK(cluster.get(hi, val) > 0 && val == "2");
+}
+
+// 跨节点的批量命令：各节点的管道并行执行，任意一个节点不可用时返回错误码
+static void TestClusterBatch()
+{
+	RedisMock a;
+	RedisMock b;
+
+	CHECK(a.start() && b.start());
+
+	const int half = RedisClusterConnect::SLOT_COUNT / 2;
+
+	for (RedisMock* mock : {&a, &b})
+	{
+		mock->addSlots(0, half - 1, a.getPort());
+		mock->addSlots(half, RedisClusterConnect::SLOT_COUNT - 1, b.getPort());
+	}
+
+	RedisClusterConnect cluster;
+	map<string, string> kvs;
+	vector<string> keys;
+	vector<string> vals;
+
+	CHECK(cluster.connect("127.0.0.1", a.getPort()));
+
+	for (int i = 0; i < 100; i++)
+	{
+		keys.push_back("batch" + to_string(i));
+		kvs[keys.back()] = to_string(i);
+	}
+
+	CHECK(cluster.mset(kvs) == RedisConnect::OK);
+	CHECK(a.execute({"dbsize"}) != RedisMock::Integer(0));
+	CHECK(b.execute({"dbsize"}) != RedisMock::Integer(0));
+	CHECK(cluster.mget(keys, vals) == (int)(keys.size()));
+	CHECK(vals.size() == keys.size() && vals[42] == "42");
+	CHECK(cluster.del(vector<string>(keys.begin(), keys.begin() + 10)) == 10);
+
+	// 取不到连接的节点上的命令没有发送，记录为 NETERR
+	RedisPool* pool = cluster.getPool(0);
+	vector<shared_ptr<RedisConnect>> conns;
+	int wait = RedisConnect::POOL_WAITTIME;
+
+	RedisConnect::POOL_WAITTIME = 200;
+
+	while (shared_ptr<RedisConnect> redis = pool->grasp(0)) conns.push_back(redis);
+
+	CHECK(cluster.mget(keys, vals) == RedisConnect::NETERR);
+	CHECK(cluster.mset(kvs) == RedisConnect::NETERR);
+
+	conns.clear();
+	RedisConnect::POOL_WAITTIME = wait;
+
+	CHECK(cluster.mget(keys, vals) == (int)(keys.size()));
+
+	a.stop();
+
+	CHECK(cluster.mget(keys, vals) < 0);
+	CHECK(vals.empty());
+	CHECK(cluster.mset(kvs) < 0);
+	CHECK(cluster.del(keys) < 0);
+}
+
+// 按 RedisLock 的脚本语义注册模拟服务器上的处理函数
+static void SetLockScripts(RedisMock& mock)
+{
+	mock.setScript(RedisLock::GetLockScript(), [](RedisMock* mock, const vector<string>& keys, const vector<string>& args) {
+		if (mock->call({"set", keys[0], args[0], "nx", "px", args[1]}) != RedisMock::Status("OK")) return RedisMock::Integer(0);
+
+		return mock->call({"incr", keys[1]});
+	});
+
+	mock.setScript(RedisLock::GetRenewScript(), [](RedisMock* mock, const vector<string>& keys, const vector<string>& args) {
+		if (mock->call({"get", keys[0]}) != RedisMock::Bulk(args[0])) return RedisMock::Integer(0);
+
+		return mock->call({"pexpire", keys[0], args[1]});
+	});
+
+	mock.setScript(RedisLock::GetUnlockScript(), [](RedisMock* mock, const vector<string>& keys, const vector<string>& args) {
+		if (mock->call({"get", keys[0]}) != RedisMock::Bulk(args[0])) return RedisMock::Integer(0);
+
+		mock->call({"del", keys[0]});
+		mock->call({"publish", args[1], args[0]});
+
+		return RedisMock::Integer(1);
+	});
+}
+
+// 互斥、防护令牌、看门狗续期，以及释放通知立即唤醒等待方
+static void TestLock()
+{
+	RedisMock mock;
+
+	CHECK(mock.start());
+
+	SetLockScripts(mock);
+
+	RedisPool& pool = RedisPoolRegistry::Instance()->get("127.0.0.1", mock.getPort());
+
+	// 令牌计数器与锁位于同一个槽位
+	for (const char* key : {"lock", "{user}:lock", "a{b"})
+	{
+		RedisLock lock(key, 30000, pool);
+
+		CHECK(RedisClusterConnect::GetSlot(lock.getFenceKey()) == RedisClusterConnect::GetSlot(key));
+	}
+
+	RedisLock a("lock", 300, pool);
+	RedisLock b("lock", 300, pool);
+
+	CHECK(a.tryLock());
+	CHECK(a.getToken() == 1);
+	CHECK(!b.tryLock());
+
+	// 看门狗持续续期，超过过期时间后仍然持有
+	Sleep(700);
+
+	CHECK(a.isHeld());
+	CHECK(!b.tryLock());
+
+	// 持有足够长的时间使等待方的退避间隔增长到上限，释放后等待方应由通知立即唤醒
+	long long latency = -1;
+	thread waiter([&]() {
+		b.setNotify(true);
+
+		bool res = b.lock(10000);
+		chrono::steady_clock::time_point now = chrono::steady_clock::now();
+
+		if (res) latency = chrono::duration_cast<chrono::milliseconds>(now.time_since_epoch()).count();
+	});
+
+	Sleep(2000);
+
+	long long released = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+
+	CHECK(a.unlock());
+
+	waiter.join();
+
+	CHECK(latency >= released);
+	CHECK(latency - released < RedisConnect::LOCK_MAX_BACKOFF / 4);
+	CHECK(b.isHeld());
+	CHECK(b.getToken() == 2);
+	CHECK(!a.unlock());
+	CHECK(b.unlock());
+	CHECK(mock.execute({"exists", "lock"}) == RedisMock::Integer(0));
+}
+
+// 五个独立实例上的仲裁锁：少于半数实例故障时仍可获取，半数以上故障时获取失败且不留残留
+static void TestRedLock()
+{
+	RedisMock mocks[5];
+	vector<RedisPool*> pools;
+
+	for (RedisMock& mock : mocks)
+	{
+		CHECK(mock.start());
+
+		mock.setScript(RedisConnect::GetUnlockScript(), [](RedisMock* mock, const vector<string>& keys, const vector<string>& args) {
+			if (mock->call({"get", keys[0]}) != RedisMock::Bulk(args[0])) return RedisMock::Integer(0);
+
+			return mock->call({"del", keys[0]});
+		});
+
+		pools.push_back(&RedisPoolRegistry::Instance()->get("127.0.0.1", mock.getPort()));
+	}
+
+	auto count = [&]() {
+		int num = 0;
+
+		for (RedisMock& mock : mocks)
+		{
+			if (mock.isRunning() && mock.execute({"exists", "redlock"}) == RedisMock::Integer(1)) num++;
+		}
+
+		return num;
+	};
+
+	RedisRedLock a(pools, "redlock", 5000);
+	RedisRedLock b(pools, "redlock", 5000);
+
+	CHECK(a.getQuorum() == 3);
+	CHECK(a.tryLock());
+	CHECK(a.isHeld());
+	CHECK(a.getValidity() > 0 && a.getValidity() <= 5000);
+	CHECK(count() == 5);
+	CHECK(!b.tryLock());
+	CHECK(!b.lock(100));
+	CHECK(a.unlock());
+	CHECK(count() == 0);
+
+	// 过小的过期时间按下限处理，仍然可以获取
+	{
+		RedisRedLock tiny(pools, "redlock", 1);
+
+		CHECK(tiny.tryLock());
+		CHECK(tiny.getValidity() > 0);
+	}
+
+	CHECK(count() == 0);
+
+	// 另一个客户端在两个实例上残留了锁，其余三个实例仍然达到半数以上，释放时不影响残留的锁
+	mocks[0].execute({"set", "redlock", "other"});
+	mocks[1].execute({"set", "redlock", "other"});
+
+	CHECK(a.tryLock());
+	CHECK(a.unlock());
+	CHECK(count() == 2);
+	CHECK(mocks[0].execute({"get", "redlock"}) == RedisMock::Bulk("other"));
+
+	mocks[0].execute({"del", "redlock"});
+	mocks[1].execute({"del", "redlock"});
+
+	// 两个实例故障，剩余三个实例达到半数以上
+	mocks[0].stop();
+	mocks[1].stop();
+
+	CHECK(a.tryLock());
+	CHECK(count() == 3);
+	CHECK(!b.tryLock());
+	CHECK(a.unlock());
+	CHECK(count() == 0);
+
+	// 三个实例故障时获取失败，已经获取的实例随即释放
+	mocks[2].stop();
+
+	CHECK(!a.tryLock());
+	CHECK(!a.isHeld());
+	CHECK(count() == 0);
+}
+
+int main(int argc, char** argv)
+{
+	const vector<pair<string, function<void()>>> cases = {
+		{"pipeline", TestPipeline},
+		{"decoder", TestDecoder},
+		{"reply", TestReply},
+		{"buffer", TestBuffer},
+#ifdef XG_LINUX
+		{"async", TestAsync},
+#endif
+#if defined(XG_LINUX) && defined(__cpp_impl_coroutine)
+		{"coroutine", TestCoroutine},
+#endif
+		{"pool-stress", TestPoolStress},
+		{"pool-wait", TestPoolWait},
+		{"pool-maintain", TestPoolMaintain},
+		{"pool-registry", TestPoolRegistry},
+		{"replica", TestReplica},
+		{"cache", TestCache},
+		{"singleflight", TestSingleFlight},
+		{"dispatcher", TestDispatcher},
+		{"metrics", TestMetrics},
+		{"dels", TestDels},
+		{"transfer", TestTransfer},
+		{"cluster", TestCluster},
+		{"cluster-batch", TestClusterBatch},
+		{"lock", TestLock},
+		{"redlock", TestRedLock}
+	};
+
+	for (auto& item : cases)
+	{
+		bool selected = argc <= 1;
+
+		for (int i = 1; i < argc; i++) selected = selected || item.first == argv[i];
+
+		if (!selected) continue;
+
+		int prev = failures;
+
+		printf("%s\n", item.first.c_str());
+		fflush(stdout);
+
+		item.second();
+
+		printf("  %s\n", failures == prev ? "ok" : "FAILED");
+	}
+
+	return failures > 0 ? 1 : 0;
+}
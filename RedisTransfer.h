@@ -0,0 +1,607 @@
+#ifndef REDIS_TRANSFER_H
+#define REDIS_TRANSFER_H
+///////////////////////////////////////////////////////////////
+#include "RedisConnect.h"
+
+// 批量导入导出。导入时从文件或标准输入读取命令，按第一个参数（通常为键名）的哈希值
+// 分配到多个连接，每个连接以管道方式批量发送，同一个键的命令在同一个连接上按原顺序执行；
+// 没有参数的命令固定使用第一个连接。SELECT、MULTI/EXEC 等依赖连接状态的命令
+// 只有在单个连接（clients 为1）时才能保证语义。
+// 输入可以是以空格分隔的文本命令（与 redis-cli 相同的引号规则）和 RESP 数组的任意混合，
+// 也可以是 exportTo 生成的导出文件（按文件头识别，逐条转换为 RESTORE 命令）。
+// 导出文件格式：8字节文件头 "RCDUMP1\n"，之后每个键一条记录，依次为变长整数编码的键名长度、
+// 键名、DUMP 数据长度、DUMP 数据和过期时间（剩余毫秒数加1，0表示不过期）。
+// 导入时每条记录转换为 RESTORE ... REPLACE，同一个键出现多次时以最后一条记录为准。
+class RedisTransfer {
+public:
+	typedef RedisConnect::Command Command;
+
+	struct Config {
+		string host = "127.0.0.1";
+		int port = 6379;
+		string passwd;
+		int clients = 4; // 导入使用的连接数
+		int pipeline = 1000; // 每批发送的命令数
+		int timeout = 3000;
+	};
+
+	// 执行进度，callback 每秒调用一次，结束时再调用一次
+	struct Progress {
+		long long commands = 0; // 已完成的命令数或导出的键数
+		long long errors = 0; // 返回错误的命令数
+		long long bytes = 0; // 已读取或写入的字节数
+		double seconds = 0;
+		string error; // 第一条错误信息
+
+		double getThroughput() const {
+			return seconds > 0 ? commands / seconds : 0;
+		}
+	};
+
+	typedef function<void(const Progress&, bool finished)> Callback;
+
+	static const char* GetMagic() {
+		return "RCDUMP1\n";
+	}
+
+	static void PutVarint(string& out, unsigned long long val) {
+		while (val >= 0x80) {
+			out += (char)(val | 0x80);
+			val >>= 7;
+		}
+
+		out += (char)(val);
+	}
+
+	// 从输入流中逐条读取命令，内部按块读取，内存占用与文件大小无关
+	class Reader {
+	protected:
+		FILE* fp;
+		string buf;
+		size_t pos = 0;
+		bool eof = false;
+		bool dump = false;
+		long long bytes = 0;
+
+		// 保证缓冲区中至少有 len 个未读字节，数据不足时返回 false
+		bool ensure(size_t len) {
+			while (buf.length() - pos < len && !eof) {
+				char tmp[64 * 1024];
+
+				if (pos > 0 && pos >= buf.length() / 2) {
+					buf.erase(0, pos);
+					pos = 0;
+				}
+
+				size_t num = fread(tmp, 1, sizeof(tmp), fp);
+
+				if (num == 0) {
+					eof = true;
+				}
+				else {
+					buf.append(tmp, num);
+					bytes += num;
+				}
+			}
+
+			return buf.length() - pos >= len;
+		}
+
+		// 读取一行，不包含行尾的 \r\n，没有数据时返回 false
+		bool getLine(string& line) {
+			size_t end = string::npos;
+			size_t from = pos;
+
+			while ((end = buf.find('\n', from)) == string::npos) {
+				size_t len = buf.length() - pos;
+
+				if (!ensure(len + 1)) break;
+
+				from = pos + len;
+			}
+
+			if (end == string::npos) {
+				if (pos >= buf.length()) return false;
+
+				end = buf.length();
+			}
+
+			line.assign(buf, pos, end - pos);
+			pos = std::min(end + 1, buf.length());
+
+			if (line.length() > 0 && line.back() == '\r') line.pop_back();
+
+			return true;
+		}
+
+		bool getVarint(unsigned long long& val) {
+			val = 0;
+
+			for (int shift = 0; shift < 64; shift += 7) {
+				if (!ensure(1)) return false;
+
+				unsigned char ch = buf[pos++];
+
+				val |= (unsigned long long)(ch & 0x7F) << shift;
+
+				if ((ch & 0x80) == 0) return true;
+			}
+
+			return false;
+		}
+
+		bool getBytes(size_t len, string& out) {
+			if (!ensure(len)) return false;
+
+			out.assign(buf, pos, len);
+			pos += len;
+
+			return true;
+		}
+
+		// 读取一条 RESP 数组格式的命令
+		int getArray(const string& line, Command& cmd) {
+			long long cnt = 0;
+			string item;
+
+			if (!ToInteger(line.c_str() + 1, cnt) || cnt < 0) return RedisConnect::DATAERR;
+
+			for (long long i = 0; i < cnt; i++) {
+				long long len = 0;
+
+				if (!getLine(item) || item.empty() || item[0] != '$') return RedisConnect::DATAERR;
+
+				if (!ToInteger(item.c_str() + 1, len) || len < 0 || len > RedisConnect::Decoder::MAX_LENGTH) return RedisConnect::DATAERR;
+
+				if (!getBytes(len, item) || !ensure(2) || buf.compare(pos, 2, "\r\n") != 0) return RedisConnect::DATAERR;
+
+				pos += 2;
+				cmd.add(item);
+			}
+
+			return cnt > 0 ? RedisConnect::OK : RedisConnect::DATAERR;
+		}
+
+		// 读取一条导出记录并转换为 RESTORE 命令
+		int getRecord(Command& cmd) {
+			string key;
+			string data;
+			unsigned long long len = 0;
+			unsigned long long ttl = 0;
+
+			if (!ensure(1)) return 0;
+
+			if (!getVarint(len) || !getBytes(len, key)) return RedisConnect::DATAERR;
+
+			if (!getVarint(len) || !getBytes(len, data) || !getVarint(ttl)) return RedisConnect::DATAERR;
+
+			cmd.add("restore", key, ttl > 0 ? ttl - 1 : 0, data, "replace");
+
+			return RedisConnect::OK;
+		}
+
+		static bool ToInteger(const char* str, long long& val) {
+			char* end = NULL;
+
+			if (*str == 0) return false;
+
+			val = strtoll(str, &end, 10);
+
+			return *end == 0;
+		}
+
+		static int GetHexValue(char ch) {
+			if (ch >= '0' && ch <= '9') return ch - '0';
+
+			if (ch >= 'a' && ch <= 'f') return ch - 'a' + 10;
+
+			if (ch >= 'A' && ch <= 'F') return ch - 'A' + 10;
+
+			return -1;
+		}
+
+	public:
+		// 按 redis-cli 的规则拆分一行文本命令：双引号内支持 \n \r \t \" \\ \xHH 转义，
+		// 单引号内只支持 \' 转义，引号结束后必须是空白或行尾
+		static bool Split(const string& line, vector<string>& vec) {
+			const char* str = line.c_str();
+
+			vec.clear();
+
+			while (true) {
+				while (*str && isspace((unsigned char)(*str))) str++;
+
+				if (*str == 0) return true;
+
+				string item;
+				char quote = 0;
+
+				if (*str == '"' || *str == '\'') quote = *str++;
+
+				while (true) {
+					if (quote == 0) {
+						if (*str == 0 || isspace((unsigned char)(*str))) break;
+
+						item += *str++;
+					}
+					else if (*str == 0) {
+						return false;
+					}
+					else if (*str == quote) {
+						str++;
+
+						if (*str && !isspace((unsigned char)(*str))) return false;
+
+						break;
+					}
+					else if (*str == '\\' && str[1]) {
+						char ch = *++str;
+
+						if (quote == '\'') {
+							if (ch != '\'') item += '\\';
+
+							item += ch;
+						}
+						else if (ch == 'x' && GetHexValue(str[1]) >= 0 && GetHexValue(str[2]) >= 0) {
+							item += (char)(GetHexValue(str[1]) * 16 + GetHexValue(str[2]));
+							str += 2;
+						}
+						else {
+							item += ch == 'n' ? '\n' : ch == 'r' ? '\r' : ch == 't' ? '\t' : ch == 'b' ? '\b' : ch == 'a' ? '\a' : ch;
+						}
+
+						str++;
+					}
+					else {
+						item += *str++;
+					}
+				}
+
+				vec.push_back(std::move(item));
+			}
+		}
+
+		Reader(FILE* fp) : fp(fp) {
+			size_t len = strlen(GetMagic());
+
+			if (ensure(len) && buf.compare(0, len, GetMagic()) == 0) {
+				dump = true;
+				pos = len;
+			}
+		}
+
+		// 已读取的字节数
+		long long getBytes() const {
+			return bytes;
+		}
+
+		// 读取下一条命令，成功时返回OK，输入结束时返回0，格式错误时返回 DATAERR
+		int next(Command& cmd) {
+			string line;
+			vector<string> vec;
+
+			if (dump) return getRecord(cmd);
+
+			while (getLine(line)) {
+				if (line.length() > 0 && line[0] == '*') return getArray(line, cmd);
+
+				if (!Split(line, vec)) return RedisConnect::DATAERR;
+
+				if (vec.empty()) continue;
+
+				for (string& item : vec) cmd.add(item);
+
+				return RedisConnect::OK;
+			}
+
+			return ferror(fp) ? RedisConnect::IOERR : 0;
+		}
+	};
+
+protected:
+	typedef chrono::steady_clock Clock;
+
+	// 一个导入连接待发送的命令批次，队列长度有上限，读取速度超过发送速度时阻塞读取线程
+	struct Channel {
+		mutex mtx;
+		condition_variable cv;
+		deque<vector<Command>> batches;
+		bool closed = false;
+	};
+
+	Config cfg;
+	RedisPool pool;
+
+	static const int QUEUE_SIZE = 4;
+
+	static double GetSeconds(Clock::time_point start) {
+		return chrono::duration<double>(Clock::now() - start).count();
+	}
+
+public:
+	RedisTransfer(const Config& cfg) : cfg(cfg), pool(cfg.host, cfg.port, 0, cfg.passwd, cfg.timeout, 2 * 1024 * 1024, std::max(cfg.clients, 1)) {
+		if (this->cfg.clients <= 0) this->cfg.clients = 1;
+
+		if (this->cfg.pipeline <= 0) this->cfg.pipeline = 1;
+	}
+
+	const Config& getConfig() const {
+		return cfg;
+	}
+
+	// 从 fp 读取全部命令并执行，命令返回的错误计入 errors 后继续执行。
+	// 成功时返回OK，连接失败、网络错误或输入格式错误时返回对应的错误码
+	int importFrom(FILE* fp, Callback callback = NULL) {
+		int res = RedisConnect::OK;
+		Progress progress;
+		Reader reader(fp);
+		mutex mtx; // 保护 progress 中的错误信息和 res
+		atomic<bool> failed(false);
+		atomic<long long> commands(0);
+		atomic<long long> errors(0);
+		vector<thread> workers;
+		vector<unique_ptr<Channel>> channels;
+		vector<shared_ptr<RedisConnect>> conns;
+		Clock::time_point start = Clock::now();
+		Clock::time_point mark = start;
+
+		for (int i = 0; i < cfg.clients; i++) {
+			shared_ptr<RedisConnect> redis = pool.create();
+
+			if (!redis) return RedisConnect::NETERR;
+
+			conns.push_back(redis);
+			channels.push_back(unique_ptr<Channel>(new Channel()));
+		}
+
+		auto fail = [&](int code, const string& msg) {
+			lock_guard<mutex> lk(mtx);
+
+			if (res > 0) {
+				res = code;
+				progress.error = msg;
+			}
+
+			failed = true;
+
+			// 在各队列的锁内通知，避免等待方检查条件后、进入等待前错过通知
+			for (auto& item : channels) {
+				lock_guard<mutex> tmp(item->mtx);
+
+				item->cv.notify_all();
+			}
+		};
+
+		for (int i = 0; i < cfg.clients; i++) {
+			workers.push_back(thread([&, i]() {
+				Channel& channel = *channels[i];
+				RedisConnect& redis = *conns[i];
+
+				while (true) {
+					vector<Command> batch;
+
+					{
+						unique_lock<mutex> lk(channel.mtx);
+
+						channel.cv.wait(lk, [&]() { return channel.closed || failed || channel.batches.size() > 0; });
+
+						if (failed || channel.batches.empty()) return;
+
+						batch = std::move(channel.batches.front());
+						channel.batches.pop_front();
+					}
+
+					channel.cv.notify_all();
+
+					RedisConnect::Pipeline pipe;
+
+					for (Command& cmd : batch) pipe.append(cmd);
+
+					if (redis.execute(pipe) < 0) {
+						fail(redis.getErrorCode(), redis.getErrorString());
+
+						return;
+					}
+
+					for (Command& cmd : batch) {
+						if (cmd.getCode() != RedisConnect::FAIL) continue;
+
+						if (errors++ == 0) {
+							lock_guard<mutex> lk(mtx);
+
+							if (progress.error.empty()) progress.error = cmd.getArgList()[0] + ": " + cmd.getErrorString();
+						}
+					}
+
+					commands += batch.size();
+				}
+			}));
+		}
+
+		auto report = [&](bool finished) {
+			if (!callback) return;
+
+			lock_guard<mutex> lk(mtx);
+
+			progress.commands = commands;
+			progress.errors = errors;
+			progress.bytes = reader.getBytes();
+			progress.seconds = GetSeconds(start);
+
+			callback(progress, finished);
+		};
+
+		// 把一批命令交给指定的连接，队列已满时等待
+		auto push = [&](int idx, vector<Command>& batch) {
+			Channel& channel = *channels[idx];
+			unique_lock<mutex> lk(channel.mtx);
+
+			channel.cv.wait(lk, [&]() { return failed || channel.batches.size() < QUEUE_SIZE; });
+
+			channel.batches.push_back(std::move(batch));
+			batch.clear();
+			channel.cv.notify_all();
+		};
+
+		vector<vector<Command>> pending(cfg.clients);
+
+		while (!failed) {
+			Command cmd;
+			int code = reader.next(cmd);
+
+			if (code <= 0) {
+				if (code < 0) fail(code, "invalid command near offset " + to_string(reader.getBytes()));
+
+				break;
+			}
+
+			const vector<string>& args = cmd.getArgList();
+			int idx = args.size() > 1 ? (int)(std::hash<string>()(args[1]) % cfg.clients) : 0;
+
+			pending[idx].push_back(std::move(cmd));
+
+			if ((int)(pending[idx].size()) >= cfg.pipeline) push(idx, pending[idx]);
+
+			if (GetSeconds(mark) >= 1) {
+				mark = Clock::now();
+				report(false);
+			}
+		}
+
+		for (int i = 0; i < cfg.clients; i++) {
+			if (pending[i].size() > 0 && !failed) push(i, pending[i]);
+
+			lock_guard<mutex> lk(channels[i]->mtx);
+
+			channels[i]->closed = true;
+			channels[i]->cv.notify_all();
+		}
+
+		for (thread& item : workers) item.join();
+
+		report(true);
+
+		return res;
+	}
+
+	// 使用 SCAN 遍历匹配的键，每批键通过管道执行 DUMP 和 PTTL 后写入 fp。
+	// 遍历期间被删除或已过期的键会被跳过。服务器扩容或缩容时 SCAN 可能重复返回同一个键，
+	// 导出时记录已写入的键名并跳过重复的键，内存占用与导出的键数成正比。
+	// 成功时返回OK，否则返回错误码
+	int exportTo(const string& pattern, FILE* fp, Callback callback = NULL) {
+		string out;
+		Progress progress;
+		unordered_set<string> exported;
+		shared_ptr<RedisConnect> redis = pool.create();
+		Clock::time_point start = Clock::now();
+		Clock::time_point mark = start;
+
+		if (!redis) return RedisConnect::NETERR;
+
+		auto report = [&](bool finished) {
+			if (!callback) return;
+
+			progress.seconds = GetSeconds(start);
+
+			callback(progress, finished);
+		};
+
+		auto write = [&]() {
+			if (out.length() > 0 && fwrite(out.data(), 1, out.length(), fp) != out.length()) return false;
+
+			progress.bytes += out.length();
+			out.clear();
+
+			return true;
+		};
+
+		int code = RedisConnect::OK;
+
+		out = GetMagic();
+
+		int res = redis->scan(pattern, [&](vector<string>& vec) {
+			RedisConnect::Pipeline pipe;
+
+			// 跳过已经导出过的键，同一批中的重复键也只保留一个
+			size_t num = 0;
+
+			for (size_t i = 0; i < vec.size(); i++) {
+				if (!exported.insert(vec[i]).second) continue;
+
+				if (num < i) vec[num] = std::move(vec[i]);
+
+				num++;
+			}
+
+			vec.resize(num);
+
+			for (const string& key : vec) {
+				pipe.add("dump", key);
+				pipe.add("pttl", key);
+			}
+
+			if (pipe.size() > 0 && redis->execute(pipe) < 0) {
+				code = redis->getErrorCode();
+				progress.error = redis->getErrorString();
+
+				return false;
+			}
+
+			for (size_t i = 0; i < vec.size(); i++) {
+				Command& data = pipe.get(i * 2);
+				Command& ttl = pipe.get(i * 2 + 1);
+
+				if (data.getCode() == RedisConnect::FAIL || ttl.getCode() == RedisConnect::FAIL) {
+					if (progress.errors++ == 0) progress.error = data.getCode() == RedisConnect::FAIL ? data.getErrorString() : ttl.getErrorString();
+
+					continue;
+				}
+
+				long long expire = ttl.getReply().getInteger();
+
+				// 键已被删除或即将过期
+				if (data.getCode() == RedisConnect::NOTFOUND || expire == -2 || expire == 0) continue;
+
+				RedisConnect::Reply reply = data.getReply();
+
+				PutVarint(out, vec[i].length());
+				out += vec[i];
+				PutVarint(out, reply.size());
+				out.append(reply.data(), reply.size());
+				PutVarint(out, expire > 0 ? expire + 1 : 0);
+
+				progress.commands++;
+			}
+
+			if (out.length() >= 1024 * 1024 && !write()) {
+				code = RedisConnect::IOERR;
+				progress.error = "write failed";
+
+				return false;
+			}
+
+			if (GetSeconds(mark) >= 1) {
+				mark = Clock::now();
+				report(false);
+			}
+
+			return true;
+		});
+
+		if (res < 0) {
+			code = res;
+			progress.error = redis->getErrorString();
+		}
+
+		if (code > 0 && (!write() || fflush(fp) != 0)) {
+			code = RedisConnect::IOERR;
+			progress.error = "write failed";
+		}
+
+		report(true);
+
+		return code;
+	}
+};
+
+#endif
@@ -4,7 +4,11 @@
 #include "typedef.h"
 
 #include <ctime>
+#include <atomic>
+#include <chrono>
+#include <deque>
 #include <mutex>
+#include <condition_variable>
 #include <vector>
 #include <string>
 #include <memory>
@@ -13,213 +17,551 @@
 #include <iostream>
 #include <iterator>
 #include <typeinfo>
+#include <type_traits>
 #include <algorithm>
 #include <functional>
 
 using namespace std;
 
 // 一个资源池，用于管理共享资源的分配和释放。
+// 空闲对象保存在无锁的空闲链表中，取出和归还都是 O(1) 的原子操作；
+// 取出的对象通过自定义删除器归还，最后一个引用释放时自动回到空闲链表。
 template<typename T> class ResPool {
-    // 一个内部类 Data，用于存储资源的信息，包括资源对象指针、最近一次使用时间、以及资源对象被获取的次数。
-    // Data 类的构造函数接受一个共享指针指向的资源对象，并将其存储在内部。
-    class Data {
+    // 池中的一个位置，只有取出该位置的线程会访问其中的数据
+    class Slot {
         public:
-            int num; // 资源对象被获取的次数
-            time_t utime; // 最近一次使用时间
+            int num = 0; // 资源对象被获取的次数
+            time_t utime = 0; // 最近一次使用时间
+            time_t ctime = 0; // 对象创建时间
             shared_ptr<T> data; // 资源对象指针
+            atomic<int> next; // 空闲链表中下一个位置的编号，0表示没有
+            atomic<bool> disabled; // 归还时是否丢弃该对象
 
-            Data(shared_ptr<T> data) {
-                update(data);
+            Slot() : next(0), disabled(false) {}
+    };
+
+    // 一组固定容量的位置和对应的创建函数，调整容量或创建函数时整体替换
+    class Table {
+        public:
+            int maxlen; // 位置个数
+            unique_ptr<Slot[]> slots; // 全部位置
+            atomic<u_int64> head; // 空闲链表头，高32位为版本号，低32位为位置编号（下标加1）
+            atomic<bool> retired; // 是否已被替换，归还到已替换的表时直接丢弃对象
+            atomic<int> used; // 已取出尚未归还的对象个数
+            function<shared_ptr<T> ()> func; // 创建对象的函数
+
+            mutex mtx; // 与 cond 配合使用
+            atomic<int> waiters; // 正在等待空闲位置的线程数
+            condition_variable cond; // 有位置归还时唤醒一个等待线程
+
+            Table(int maxlen, function<shared_ptr<T> ()> func) : maxlen(maxlen), slots(new Slot[maxlen > 0 ? maxlen : 1]), head(0), retired(false), used(0), func(func), waiters(0) {
+                for (int i = maxlen - 1; i >= 0; i--) push(i);
+            }
+
+            // 从空闲链表中取出一个位置，版本号用于避免 ABA 问题
+            bool pop(int& idx) {
+                u_int64 val = head.load(memory_order_acquire);
+
+                while (true) {
+                    u_int64 pos = val & 0xFFFFFFFF;
+
+                    if (pos == 0) return false;
+
+                    u_int64 tmp = (((val >> 32) + 1) << 32) | (u_int32)(slots[pos - 1].next.load(memory_order_relaxed));
+
+                    if (head.compare_exchange_weak(val, tmp, memory_order_acq_rel, memory_order_acquire)) {
+                        idx = pos - 1;
+
+                        return true;
+                    }
+                }
+            }
+
+            // 将位置放回空闲链表头部，最近归还的对象优先被取出
+            void push(int idx) {
+                u_int64 val = head.load(memory_order_relaxed);
+
+                while (true) {
+                    slots[idx].next.store(val & 0xFFFFFFFF, memory_order_relaxed);
+
+                    u_int64 tmp = (((val >> 32) + 1) << 32) | (u_int64)(idx + 1);
+
+                    if (head.compare_exchange_weak(val, tmp, memory_order_release, memory_order_relaxed)) return;
+                }
+            }
+
+            bool empty() const {
+                return (head.load(memory_order_acquire) & 0xFFFFFFFF) == 0;
+            }
+
+            // 唤醒等待空闲位置的线程。等待线程先增加 waiters 再检查空闲链表，
+            // 归还线程先放回位置再检查 waiters，两侧的全序屏障保证不会丢失唤醒。
+            void notify(bool all) {
+                atomic_thread_fence(memory_order_seq_cst);
+
+                if (waiters.load(memory_order_relaxed) <= 0) return;
+
+                lock_guard<mutex> lk(mtx);
+
+                if (all) {
+                    cond.notify_all();
+                }
+                else {
+                    cond.notify_one();
+                }
             }
 
-            // 函数用于更新数据对象的状态
-            // 资源池中，当一个资源对象被重新获取时，需要更新它的使用次数和最近一次使用时间。
-            void update(shared_ptr<T> data) {
-                this->num = 0;
-                this->data = data;
-                this->utime = time(NULL);
+            // 空闲链表中的位置个数，只在没有并发访问时使用
+            int count() const {
+                int num = 0;
+                u_int64 pos = head.load() & 0xFFFFFFFF;
+
+                while (pos > 0) {
+                    pos = slots[pos - 1].next.load();
+                    num++;
+                }
+
+                return num;
             }
+    };
 
-            // get() 函数用于获取资源对象，并返回一个共享指针。
-            // 当一个可用的资源对象被获取时，会调用 Data 类的 get() 函数来更新该资源对象的状态。
-            // Data 类的 get() 函数会将该资源对象的使用次数加 1，
-            // 并将最近一次使用时间更新为当前时间，并返回该资源对象的共享指针。
-            shared_ptr<T> get() {
-                utime = time(NULL);
-                num++;
+    // 删除器：对象的最后一个引用释放时将其所在位置归还到空闲链表
+    class Releaser {
+        public:
+            int idx;
+            Table* table;
 
-                return data;
+            Releaser(Table* table, int idx) : idx(idx), table(table) {}
+
+            void operator()(T*) {
+                Slot& slot = table->slots[idx];
+
+                if (slot.disabled.load(memory_order_relaxed) || table->retired.load(memory_order_acquire)) {
+                    slot.data = NULL;
+                    slot.disabled.store(false, memory_order_relaxed);
+                }
+
+                table->used.fetch_sub(1, memory_order_relaxed);
+                table->push(idx);
+                table->notify(false);
             }
     };
 
 protected:
-    mutex mtx; // 一个互斥量对象，用于同步线程对共享资源的访问。
-    int maxlen; // 一个整型变量，表示vec向量的最大容量。
-    int timeout; // 一个整型变量，表示等待func函数返回结果的最大超时时间。
-    vector<Data> vec; // 一个存储Data对象的向量。
-    //一个函数对象，其返回类型为shared_ptr<T>，参数列表为空。
-    // 这个函数对象可以存储任何无参函数，并且在需要的时候调用。
-    function<shared_ptr<T> ()> func; 
+    mutex mtx; // 只用于串行化修改配置的操作，取出和归还对象不加锁
+    atomic<int> wait; // 没有空闲对象时默认的最长等待毫秒数
+    atomic<int> timeout; // 对象空闲超过该秒数后重新创建，小于等于0时不缓存对象
+    atomic<long long> waitcnt; // 发生等待的次数
+    atomic<long long> waittime; // 累计等待的微秒数
+    atomic<int> minidle; // 维护线程保持的最少空闲对象个数
+    atomic<int> lifetime; // 对象创建超过该秒数后重新创建，小于等于0时不限制
+    function<bool(T&)> checker; // 检查空闲对象是否可用的函数，修改时需持有 mtx
+    atomic<Table*> table; // 当前使用的位置表
+    // 创建过的全部位置表。被替换的表可能仍有对象未归还，因此保留到资源池销毁为止
+    vector<unique_ptr<Table>> tables;
+
+    thread worker; // 后台维护线程
+    bool running = false; // 维护线程是否继续运行，由 wmtx 保护
+    mutex wmtx;
+    condition_variable wcond; // 用于提前唤醒维护线程退出
+
+    // 对象被获取100次、空闲超时或超过最长存活时间后需要重新创建
+    bool expired(const Slot& slot, time_t now) const {
+        if (slot.num >= 100 || slot.utime + timeout <= now) return true;
+
+        int life = lifetime;
+
+        return life > 0 && slot.ctime + life <= now;
+    }
 
-public:
-    // 从对象池中获取一个对象的功能
-    shared_ptr<T> get() {
-        // 首先判断是否设置了超时时间，如果没有则直接调用func()获取一个新的对象，并返回。
-        if(timeout <= 0)
-            return func();
-        
-        // 如果设置了超时时间，定义一个名为grasp的lambda函数，并在其中实现具体的获取对象的逻辑
-        auto grasp = [&]() {
-            int len = 0;
-            int idx = -1;
-            shared_ptr<T> tmp;
-            time_t now = time(NULL);
-
-            // 首先对对象池进行加锁
-            mtx.lock();
-
-            len = vec.size();
-
-            // 然后遍历对象池中的所有对象
-            for(int i = 0; i < len; i++) {
-                Data& item = vec[i];
-                // 找到第一个未被占用且未过期的对象，并返回其指针
-                // 当 use_count 等于 1 时，说明除了该 Data 对象内部的 shared_ptr 之外，
-                // 已经没有其它 shared_ptr 或者 weak_ptr 指向该对象，即该对象没有被占用。
-                if(item.data.get() == NULL || item.data.use_count() == 1) {
-                    if(tmp = item.data) {
-                        if(item.num < 100 && item.utime+timeout > now) {
-                            shared_ptr<T> data = item.get();
-                            mtx.unlock();
-                            return data;
-                        }
-
-                        item.data = NULL;
-                    }
-                    idx = i;
+    // 替换位置表，migrate 为 true 时将旧表中的空闲对象转移到新表，调用前需持有 mtx
+    void replace(int maxlen, function<shared_ptr<T> ()> func, bool migrate) {
+        int idx = 0;
+        Table* prev = table.load();
+        Table* next = new Table(maxlen, func);
+
+        tables.push_back(unique_ptr<Table>(next));
+
+        if (prev) {
+            int pos = 0;
+            vector<int> vec;
+
+            prev->retired.store(true, memory_order_release);
+
+            while (prev->pop(idx)) {
+                Slot& slot = prev->slots[idx];
+
+                if (migrate && slot.data && next->pop(pos)) {
+                    Slot& item = next->slots[pos];
+
+                    item.num = slot.num;
+                    item.utime = slot.utime;
+                    item.ctime = slot.ctime;
+                    item.data = slot.data;
+                    vec.push_back(pos);
                 }
+
+                slot.data = NULL;
             }
 
-            mtx.unlock();
+            // 转移完成后再统一放回，避免同一个位置被重复取出
+            while (vec.size() > 0) {
+                next->push(vec.back());
+                vec.pop_back();
+            }
+        }
+
+        table.store(next, memory_order_release);
+
+        // 等待旧表的线程改为等待新表
+        if (prev) prev->notify(true);
+    }
 
-            //  vector 容器中是否存在空闲的 Data 对象
-            if(idx < 0) {
-                // 如果已经达到最大长度，则返回一个空的 shared_ptr<T> 对象。
-                if(len >= maxlen)
-                    return shared_ptr<T>();
-                
-                // 调用 func 函数创建一个新的 shared_ptr<T> 对象
-                shared_ptr<T> data = func();
+    // 从指定的位置表中取出一个对象，没有空闲位置时返回空指针，创建对象失败时 failed 为 true
+    shared_ptr<T> grasp(Table* tab, bool& failed) {
+        int idx = 0;
 
-                // 表示创建对象失败，此时返回空的 shared_ptr。
-                if(data.get() == NULL)
-                    return data;
-                
-                mtx.lock();
+        if (!tab->pop(idx))
+            return shared_ptr<T>();
 
-                if(vec.size() < maxlen)
-                    vec.push_back(data);
-                mtx.unlock();
+        Slot& slot = tab->slots[idx];
+        time_t now = time(NULL);
 
-                return data;
+        if (slot.data && expired(slot, now)) slot.data = NULL;
+
+        if (slot.data) {
+            slot.num++;
+        }
+        else {
+            slot.num = 0;
+            slot.ctime = now;
+            slot.data = tab->func();
+
+            if (slot.data.get() == NULL) {
+                failed = true;
+                tab->push(idx);
+                tab->notify(false);
+
+                return shared_ptr<T>();
             }
+        }
 
-            shared_ptr<T> data = func();
+        slot.utime = now;
+        tab->used.fetch_add(1, memory_order_relaxed);
 
-            if(data.get() == NULL)
-                return data;
-            
-            mtx.lock();
+        return shared_ptr<T>(slot.data.get(), Releaser(tab, idx));
+    }
 
-			vec[idx].update(data);
+public:
+    // 从对象池中获取一个对象的功能，没有空闲对象时按默认的最长等待时间等待
+    shared_ptr<T> get() {
+        return get(wait);
+    }
 
-			mtx.unlock();
+    // 从对象池中获取一个对象。没有空闲对象时最多等待 wait 毫秒，
+    // 期间有对象归还会立即唤醒一个等待线程；创建对象失败时立即返回空指针。
+    // waited 不为空时返回本次等待的微秒数。
+    shared_ptr<T> get(int wait, long long* waited = NULL) {
+        if (waited)
+            *waited = 0;
 
-			return data;
-        };
+        // 首先判断是否设置了超时时间，如果没有则直接调用func()获取一个新的对象，并返回。
+        if (timeout <= 0)
+            return table.load(memory_order_acquire)->func();
 
-        shared_ptr<T> data = grasp();
+        bool failed = false;
+        shared_ptr<T> data = grasp(table.load(memory_order_acquire), failed);
 
-        if(data)
+        if (data || failed || wait <= 0)
             return data;
-        
-        time_t endtime = time(NULL)+3;
-        
-        while(true) {
-            Sleep(10);
-            if(data = grasp())
-                return data;
-            if(endtime < time(NULL))
+
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        chrono::steady_clock::time_point endtime = start + chrono::milliseconds(wait);
+
+        while (true) {
+            Table* tab = table.load(memory_order_acquire);
+
+            tab->waiters++;
+
+            atomic_thread_fence(memory_order_seq_cst);
+
+            if (!(data = grasp(tab, failed)) && !failed) {
+                unique_lock<mutex> lk(tab->mtx);
+
+                tab->cond.wait_until(lk, endtime, [&]() {
+                    return !tab->empty() || tab->retired.load();
+                });
+            }
+
+            tab->waiters--;
+
+            if (data || failed)
+                break;
+
+            if (chrono::steady_clock::now() >= endtime) {
+                data = grasp(table.load(memory_order_acquire), failed);
+
                 break;
+            }
         }
 
+        long long cost = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+
+        waitcnt++;
+        waittime += cost;
+
+        if (waited)
+            *waited = cost;
+
         return data;
     }
 
+    // 发生等待的次数
+    long long getWaitCount() const {
+        return waitcnt;
+    }
 
+    // 累计等待的微秒数
+    long long getWaitTime() const {
+        return waittime;
+    }
+
+    // 已取出尚未归还的对象个数，包括被替换的位置表中的对象
+    int getUsedCount() {
+        int num = 0;
+        lock_guard<mutex> lk(mtx);
+
+        for (unique_ptr<Table>& item : tables) num += item->used.load(memory_order_relaxed);
+
+        return num;
+    }
+
+    int getWaitTimeout() const {
+        return wait;
+    }
+
+    // 设置没有空闲对象时默认的最长等待毫秒数
+    void setWaitTimeout(int wait) {
+        this->wait = wait;
+    }
+
+    // 执行一次维护：替换过期的空闲对象，检查空闲超过 interval 秒的对象是否可用，
+    // 并预先创建对象使空闲对象不少于 minidle 个。不需要处理的对象立即放回，
+    // 需要检查或创建的对象逐个处理后放回，期间其它线程仍可以取出对象。
+    // 只在取出对象时持有 mtx，检查和创建对象的网络操作不会阻塞 getUsedCount、setLength 等操作。
+    void maintain(int interval = 5) {
+        int idx = 0;
+        int alive = 0;
+        int count = minidle;
+        Table* tab = NULL;
+        vector<int> vec;
+        vector<int> todo;
+        vector<int> keep;
+        vector<int> empty;
+        function<bool(T&)> check;
+        time_t now = time(NULL);
+
+        {
+            lock_guard<mutex> lk(mtx);
+
+            tab = table.load(memory_order_acquire);
+
+            if (timeout <= 0 || !tab->func) return;
+
+            check = checker;
+
+            while (tab->pop(idx)) vec.push_back(idx);
+        }
+
+        for (int idx : vec) {
+            Slot& slot = tab->slots[idx];
+
+            if (slot.data && expired(slot, now)) slot.data = NULL;
+
+            if (slot.data) {
+                if (check && alive < count && slot.utime + interval <= now) {
+                    todo.push_back(idx);
+                }
+                else {
+                    keep.push_back(idx);
+                }
+
+                alive++;
+            }
+            else {
+                empty.push_back(idx);
+            }
+        }
+
+        // 空闲链表后进先出，先放回不需要创建对象的空位置，再放回可用的对象，
+        // 最后放回新建的对象，取出时优先得到已有的对象而不是重新建立
+        size_t num = std::min(empty.size(), (size_t)(std::max(count - alive, 0)));
+
+        for (size_t i = num; i < empty.size(); i++) tab->push(empty[i]);
+
+        for (int idx : keep) tab->push(idx);
+
+        todo.insert(todo.end(), empty.begin(), empty.begin() + num);
+
+        tab->notify(true);
+
+        for (int idx : todo) {
+            Slot& slot = tab->slots[idx];
+
+            // 处理期间位置表被替换时丢弃对象，与归还到已替换的位置表时相同
+            if (tab->retired.load(memory_order_acquire)) {
+                slot.data = NULL;
+            }
+            else {
+                if (slot.data) {
+                    if (check(*slot.data)) {
+                        slot.utime = time(NULL);
+                    }
+                    else {
+                        slot.data = NULL;
+                        alive--;
+                    }
+                }
+
+                if (!slot.data && alive < count) {
+                    slot.num = 0;
+                    slot.data = tab->func();
+                    slot.ctime = slot.utime = time(NULL);
+
+                    if (slot.data) alive++;
+                }
+            }
+
+            tab->push(idx);
+            tab->notify(false);
+        }
+    }
+
+    // 启动后台维护线程，每隔 interval 秒执行一次 maintain
+    bool start(int interval = 5) {
+        lock_guard<mutex> lk(wmtx);
+
+        if (worker.joinable()) return false;
+
+        running = true;
+
+        worker = thread([this, interval]() {
+            unique_lock<mutex> lk(wmtx);
+
+            while (running) {
+                lk.unlock();
+                maintain(interval);
+                lk.lock();
+
+                wcond.wait_for(lk, chrono::seconds(interval), [this]() {
+                    return !running;
+                });
+            }
+        });
+
+        return true;
+    }
+
+    // 停止后台维护线程
+    void stop() {
+        {
+            lock_guard<mutex> lk(wmtx);
+
+            running = false;
+        }
+
+        wcond.notify_all();
+
+        if (worker.joinable()) worker.join();
+    }
+
+    int getMinIdle() const {
+        return minidle;
+    }
+
+    // 设置维护线程保持的最少空闲对象个数
+    void setMinIdle(int minidle) {
+        this->minidle = minidle;
+    }
+
+    int getLifetime() const {
+        return lifetime;
+    }
+
+    // 设置对象的最长存活秒数，小于等于0时不限制
+    void setLifetime(int lifetime) {
+        this->lifetime = lifetime;
+    }
+
+    // 设置检查空闲对象是否可用的函数，返回 false 的对象被重新创建
+    void setChecker(function<bool(T&)> checker) {
+        lock_guard<mutex> lk(mtx);
+
+        this->checker = checker;
+    }
+
+    // 丢弃全部空闲对象，正在使用的对象归还时也会被丢弃
     void clear() {
         // lock_guard只有构造函数和析构函数, 
         // 在定义该局部对象的时候加锁（调用构造函数），出了该对象作用域的时候解锁（调用析构函数）
         lock_guard<mutex> lk(mtx);
 
-        vec.clear();
+        Table* tab = table.load();
+
+        replace(tab->maxlen, tab->func, false);
     }
 
     int getLength() const {
-        return maxlen;
+        return table.load()->maxlen;
     }
 
     int getTimeout() const {
         return timeout;
     }
 
-    // 用于手动禁用一个 Data 对象
+    // 用于手动禁用一个对象，该对象归还时被丢弃
     void disable(shared_ptr<T> data) {
-        lock_guard<mutex> lk(mtx);
+        Releaser* releaser = get_deleter<Releaser>(data);
 
-        for(Data& item: vec) {
-            if(data == item.data) {
-                item.data = NULL;
-                break;
-            }
-        }
+        if (releaser) releaser->table->slots[releaser->idx].disabled.store(true, memory_order_relaxed);
     }
 
+    // 调整容量，空闲对象转移到新的位置表中
     void setLength(int maxlen) {
 		lock_guard<mutex> lk(mtx);
 
-		this->maxlen = maxlen;
-
-		if (vec.size() > maxlen) 
-            vec.clear();
+		replace(maxlen, table.load()->func, true);
 	}
 
     void setTimeout(int timeout) {
-		lock_guard<mutex> lk(mtx);
-
 		this->timeout = timeout;
 
 		if (timeout <= 0) 
-            vec.clear();
+            clear();
 	}
 
     // 设置一个能够创建T类型对象的函数
     void setCreator(function<shared_ptr<T>()> func) {
 		lock_guard<mutex> lk(mtx);
 
-		this->func = func;
-		this->vec.clear();
+		replace(table.load()->maxlen, func, false);
 	}
 
-	ResPool(int maxlen = 8, int timeout = 60) {
-		this->timeout = timeout;
-		this->maxlen = maxlen;
+	ResPool(int maxlen = 8, int timeout = 60) : wait(3000), timeout(timeout), waitcnt(0), waittime(0), minidle(0), lifetime(0), table(NULL) {
+		replace(maxlen, NULL, false);
 	}
 
-	ResPool(function<shared_ptr<T>()> func, int maxlen = 8, int timeout = 60) {
-		this->timeout = timeout;
-		this->maxlen = maxlen;
-		this->func = func;
+	ResPool(function<shared_ptr<T>()> func, int maxlen = 8, int timeout = 60) : wait(3000), timeout(timeout), waitcnt(0), waittime(0), minidle(0), lifetime(0), table(NULL) {
+		replace(maxlen, func, false);
+	}
+
+	// 仍有对象未归还的位置表不能释放，否则归还时会访问已释放的内存
+	~ResPool() {
+		stop();
+
+		for (unique_ptr<Table>& item : tables) {
+			if (item->count() < item->maxlen) item.release();
+		}
 	}
 };
 